@@ -0,0 +1,51 @@
+#ifndef BENCHMARK_UTIL_HPP
+#define BENCHMARK_UTIL_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace zclient::bench {
+
+struct latency_summary {
+    std::size_t samples;
+    double mean_us;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+};
+
+inline latency_summary summarize(std::vector<std::chrono::nanoseconds> samples) {
+    if (samples.empty()) return latency_summary{};
+
+    std::sort(samples.begin(), samples.end());
+
+    const auto to_us = [](std::chrono::nanoseconds ns) { return ns.count() / 1000.0; };
+    const auto pct = [&](double p) {
+        return to_us(samples[std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()))]);
+    };
+
+    const auto total = std::accumulate(samples.begin(), samples.end(), std::chrono::nanoseconds{0});
+
+    return latency_summary{
+        .samples = samples.size(),
+        .mean_us = to_us(total) / samples.size(),
+        .p50_us = pct(0.50),
+        .p99_us = pct(0.99),
+        .p999_us = pct(0.999),
+        .max_us = to_us(samples.back())
+    };
+}
+
+inline void print_latency(const std::string& label, const latency_summary& s) {
+    std::printf("%-28s n=%-8zu mean=%9.2fus p50=%9.2fus p99=%9.2fus p99.9=%9.2fus max=%9.2fus\n",
+                label.c_str(), s.samples, s.mean_us, s.p50_us, s.p99_us, s.p999_us, s.max_us);
+}
+
+} // ns zclient::bench
+
+#endif // BENCHMARK_UTIL_HPP
@@ -0,0 +1,74 @@
+#include <iostream>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+#include "benchmark_util.hpp"
+
+/* Loopback websocket round trip latency: blocking io_context::run() versus the
+ * busy-poll loop. Usage: ./busy_poll_ws_roundtrip [iterations] [cpu] */
+
+using namespace zclient;
+
+static std::vector<std::chrono::nanoseconds>
+run_roundtrips(const std::string& port, std::size_t iterations, bool busy_poll, int cpu) {
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(iterations);
+
+    const busy_poll_options poll_options{.cpu = cpu, .socket_busy_poll_usec = 50};
+
+    zasync_exec([&]() -> zasync {
+        websocket_client ws_client;
+        if (busy_poll) {
+            ws_client.set_socket_options(busy_poll_socket_options(poll_options));
+        }
+        if (!co_await ws_client.connect("ws://127.0.0.1", port, "/echo")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        const std::string payload(64, 'x');
+
+        /* warm up connection and caches */
+        for (int i = 0; i < 1000; ++i) {
+            co_await ws_client.write(payload);
+            co_await ws_client.read();
+        }
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            co_await ws_client.write(payload);
+            co_await ws_client.read();
+            samples.push_back(std::chrono::steady_clock::now() - start);
+        }
+
+        ws_client.disconnect();
+    });
+
+    if (busy_poll) {
+        zrun_busy_poll(poll_options);
+    } else {
+        if (cpu >= 0) pin_current_thread(cpu);
+        zrun();
+    }
+
+    get_io_context().restart();
+
+    return samples;
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const int cpu = argc > 2 ? std::stoi(argv[2]) : -1;
+
+    mock::mock_server server;
+    server.add_endpoint(mock::mock_endpoint{.target = "/echo", .ws_mode = mock::websocket_mode::echo});
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    bench::print_latency("run() round trip", bench::summarize(run_roundtrips(port, iterations, false, cpu)));
+    bench::print_latency("busy poll round trip", bench::summarize(run_roundtrips(port, iterations, true, cpu)));
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include <boost/asio/use_awaitable.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+
+/* Throughput of one large download from the mock server, throttled per
+ * connection like a server or path that caps each flow: a single fetch into
+ * http_response::body versus download_to_file with 1 to 8 Range segments
+ * written straight to disk. Usage: ./segmented_download [size_mb] [mb_per_s_per_connection] [file] */
+
+using namespace zclient;
+
+static double run_fetch(const std::string& port, std::size_t expected) {
+    std::size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    zasync_exec([&]() -> zasync {
+        const http_request request{.method = http_method::get, .path = "/artifact"};
+        auto response = co_await async_fetch("http://127.0.0.1", port, request, boost::asio::use_awaitable);
+        bytes = response.body.size();
+    });
+
+    zrun();
+    get_io_context().restart();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (bytes != expected) {
+        std::cerr << "fetch returned " << bytes << " bytes" << std::endl;
+    }
+    return bytes / elapsed.count() / (1024 * 1024);
+}
+
+static double run_download(const std::string& port, const std::string& file, std::size_t segments, std::size_t expected) {
+    std::uint64_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    zasync_exec([&]() -> zasync {
+        download_options options;
+        options.segments = segments;
+        options.resume = false;
+
+        auto result = co_await download_to_file("http://127.0.0.1", port, "/artifact", file, options);
+        bytes = result.size;
+    });
+
+    zrun();
+    get_io_context().restart();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (bytes != expected || std::filesystem::file_size(file) != expected) {
+        std::cerr << "download wrote " << bytes << " bytes" << std::endl;
+    }
+    std::filesystem::remove(file);
+
+    return bytes / elapsed.count() / (1024 * 1024);
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t size_mb = argc > 1 ? std::stoul(argv[1]) : 64;
+    const std::size_t rate_mb = argc > 2 ? std::stoul(argv[2]) : 50;
+    const std::string file = argc > 3 ? argv[3] : (std::filesystem::temp_directory_path() / "zclient_segmented_download").string();
+
+    const std::size_t size = size_mb * 1024 * 1024;
+
+    mock::mock_server server;
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/artifact",
+        .body_size = size,
+        .bytes_per_second = rate_mb * 1024 * 1024,
+        .etag = "\"artifact-1\"",
+        .ranges = true
+    });
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    std::printf("%-28s %9.1f MB/s\n", "fetch into memory", run_fetch(port, size));
+    for (std::size_t segments : {1, 2, 4, 8}) {
+        const auto label = "download_to_file, " + std::to_string(segments) + " seg";
+        std::printf("%-28s %9.1f MB/s\n", label.c_str(), run_download(port, file, segments, size));
+    }
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#include <boost/asio/use_awaitable.hpp>
+#include <iostream>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+#include "benchmark_util.hpp"
+
+/* Loopback effect of socket_options: websocket round trips of two messages
+ * written back to back, with and without TCP_NODELAY (Nagle holds the second
+ * one until the first is acknowledged), and large HTTP downloads with a small
+ * fixed receive buffer versus the kernel's auto-tuning.
+ * Usage: ./socket_tuning [iterations] [download_mb] */
+
+using namespace zclient;
+
+static std::vector<std::chrono::nanoseconds>
+run_pairs(const std::string& port, std::size_t iterations, const socket_options& options) {
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(iterations);
+
+    zasync_exec([&]() -> zasync {
+        websocket_client ws_client;
+        ws_client.set_socket_options(options);
+        if (!co_await ws_client.connect("ws://127.0.0.1", port, "/echo")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        const std::string payload(64, 'x');
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            co_await ws_client.write(payload);
+            co_await ws_client.write(payload);
+            co_await ws_client.read();
+            co_await ws_client.read();
+            samples.push_back(std::chrono::steady_clock::now() - start);
+        }
+
+        ws_client.disconnect();
+    });
+
+    zrun();
+    get_io_context().restart();
+
+    return samples;
+}
+
+static double run_download(const std::string& port, std::size_t rounds, const socket_options& options) {
+    /* async_fetch picks up the process wide defaults */
+    const auto saved = default_socket_options();
+    default_socket_options() = options;
+
+    std::size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    zasync_exec([&]() -> zasync {
+        const http_request request{.method = http_method::get, .path = "/large"};
+        for (std::size_t i = 0; i < rounds; ++i) {
+            auto response = co_await async_fetch("http://127.0.0.1", port, request, boost::asio::use_awaitable);
+            bytes += response.body.size();
+        }
+    });
+
+    zrun();
+    get_io_context().restart();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    default_socket_options() = saved;
+
+    return bytes / elapsed.count() / (1024 * 1024);
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 20000;
+    const std::size_t download_mb = argc > 2 ? std::stoul(argv[2]) : 64;
+
+    mock::mock_server server;
+    server.add_endpoint(mock::mock_endpoint{.target = "/echo", .ws_mode = mock::websocket_mode::echo});
+    server.add_endpoint(mock::mock_endpoint{.target = "/large", .body_size = 8 * 1024 * 1024});
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    socket_options nagle;
+    nagle.no_delay = false;
+
+    socket_options no_delay;
+    no_delay.no_delay = true;
+    no_delay.quick_ack = true;
+
+    bench::print_latency("Nagle, 2 writes + 2 reads", bench::summarize(run_pairs(port, iterations, nagle)));
+    bench::print_latency("NODELAY + QUICKACK", bench::summarize(run_pairs(port, iterations, no_delay)));
+
+    socket_options small_buffer;
+    small_buffer.receive_buffer_size = 16 * 1024;
+
+    socket_options large_buffer;
+    large_buffer.receive_buffer_size = 4 * 1024 * 1024;
+
+    const auto rounds = std::max<std::size_t>(1, download_mb / 8);
+    std::printf("%-28s %9.1f MB/s\n", "download, SO_RCVBUF 16KB", run_download(port, rounds, small_buffer));
+    std::printf("%-28s %9.1f MB/s\n", "download, auto-tuned", run_download(port, rounds, socket_options{}));
+    std::printf("%-28s %9.1f MB/s\n", "download, SO_RCVBUF 4MB", run_download(port, rounds, large_buffer));
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#include <boost/asio/use_awaitable.hpp>
+#include <iostream>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+#include "benchmark_util.hpp"
+
+/* Latency to a sidecar on the same host over TCP loopback versus a unix domain
+ * socket: websocket echo round trips on one connection, and HTTP fetches that
+ * each open a new connection. Usage: ./unix_socket_latency [iterations] [socket_path] */
+
+using namespace zclient;
+
+using samples_t = std::vector<std::chrono::nanoseconds>;
+
+static samples_t run_ws_roundtrips(const std::string& host, const std::string& port, std::size_t iterations) {
+    samples_t samples;
+    samples.reserve(iterations);
+
+    zasync_exec([&]() -> zasync {
+        websocket_client ws_client;
+        if (!co_await ws_client.connect(host, port, "/echo")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        const std::string payload(64, 'x');
+
+        /* warm up connection and caches */
+        for (int i = 0; i < 1000; ++i) {
+            co_await ws_client.write(payload);
+            co_await ws_client.read();
+        }
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            co_await ws_client.write(payload);
+            co_await ws_client.read();
+            samples.push_back(std::chrono::steady_clock::now() - start);
+        }
+
+        ws_client.disconnect();
+    });
+
+    zrun();
+    get_io_context().restart();
+
+    return samples;
+}
+
+static samples_t run_fetches(const std::string& host, const std::string& port, std::size_t iterations) {
+    samples_t samples;
+    samples.reserve(iterations);
+
+    zasync_exec([&]() -> zasync {
+        const http_request request{.method = http_method::get, .path = "/small"};
+
+        for (std::size_t i = 0; i < iterations; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            co_await async_fetch(host, port, request, boost::asio::use_awaitable);
+            samples.push_back(std::chrono::steady_clock::now() - start);
+        }
+    });
+
+    zrun();
+    get_io_context().restart();
+
+    return samples;
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 20000;
+    const std::string socket_path = argc > 2 ? argv[2] : "/tmp/zclient_bench.sock";
+
+    mock::mock_server server{mock::mock_server_config{.unix_socket_path = socket_path}};
+    server.add_endpoint(mock::mock_endpoint{.target = "/echo", .ws_mode = mock::websocket_mode::echo});
+    server.add_endpoint(mock::mock_endpoint{.target = "/small", .body = "{\"ok\":true}"});
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    bench::print_latency("ws round trip, tcp", bench::summarize(run_ws_roundtrips("ws://127.0.0.1", port, iterations)));
+    bench::print_latency("ws round trip, unix", bench::summarize(run_ws_roundtrips("ws+unix://" + socket_path, "", iterations)));
+
+    const auto fetches = std::max<std::size_t>(1, iterations / 10);
+    bench::print_latency("http fetch, tcp", bench::summarize(run_fetches("http://127.0.0.1", port, fetches)));
+    bench::print_latency("http fetch, unix", bench::summarize(run_fetches("http+unix://" + socket_path, "", fetches)));
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
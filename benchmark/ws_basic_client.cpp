@@ -0,0 +1,77 @@
+#include <ctime>
+#include <cstdio>
+#include <iostream>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+
+/* Loopback read loop through the type-erased websocket_client, which picks the
+ * transport at connect(), against plain_websocket_client, which has it fixed at
+ * compile time. The mock server pushes messages as fast as it can on connect.
+ * Usage: ./ws_basic_client [messages] [message_size] */
+
+using namespace zclient;
+
+static double thread_cpu_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+template <typename Client>
+static void run(const std::string& label, const std::string& host, const std::string& port, std::size_t count) {
+    std::size_t checksum = 0;
+
+    zasync_exec([&]() -> zasync {
+        Client ws_client;
+        if (!co_await ws_client.connect(host, port, "/feed")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            auto message = co_await ws_client.read_view();
+            checksum += message.data.size();
+        }
+
+        ws_client.disconnect();
+    });
+
+    const auto wall_start = std::chrono::steady_clock::now();
+    const double cpu_start = thread_cpu_ms();
+
+    zrun();
+    get_io_context().restart();
+
+    const double cpu_ms = thread_cpu_ms() - cpu_start;
+    const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    std::printf("%-24s %10.0f msgs/s  cpu=%8.1fms (%5.2fus/msg)  bytes=%zu\n",
+                label.c_str(), count / wall_s, cpu_ms, cpu_ms * 1000 / count, checksum);
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 500000;
+    const std::size_t size = argc > 2 ? std::stoul(argv[2]) : 512;
+
+    mock::mock_server server;
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/feed",
+        .ws_mode = mock::websocket_mode::broadcast,
+        .ws_publish_count = count,
+        .ws_publish_size = size
+    });
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    std::printf("%zu messages of %zu bytes (client thread CPU only)\n", count, size);
+
+    run<websocket_client>("websocket_client", "ws://127.0.0.1", port, count);
+    run<plain_websocket_client>("plain_websocket_client", "127.0.0.1", port, count);
+    run<websocket_client>("websocket_client", "ws://127.0.0.1", port, count);
+    run<plain_websocket_client>("plain_websocket_client", "127.0.0.1", port, count);
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include <ctime>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+
+/* Loopback permessage-deflate cost/benefit: streams exchange-style JSON depth
+ * updates through an echo server and reports the client's CPU time against the
+ * bytes saved on the wire, for several compression settings.
+ * Usage: ./ws_compression [messages] */
+
+using namespace zclient;
+
+static std::string make_depth_update(std::mt19937_64& rng, std::uint64_t seq) {
+    std::uniform_int_distribution<int> price(4300000, 4310000);
+    std::uniform_int_distribution<int> qty(1, 50000);
+
+    char level[64];
+    std::string msg = "{\"e\":\"depthUpdate\",\"E\":" + std::to_string(1700000000000 + seq) +
+                      ",\"s\":\"BTCUSDT\",\"U\":" + std::to_string(seq * 10) +
+                      ",\"u\":" + std::to_string(seq * 10 + 9) + ",\"b\":[";
+
+    for (int side = 0; side < 2; ++side) {
+        for (int i = 0; i < 10; ++i) {
+            const int p = price(rng), q = qty(rng);
+            std::snprintf(level, sizeof(level), "%s[\"%d.%02d\",\"%d.%03d\"]",
+                          i ? "," : "", p / 100, p % 100, q / 1000, q % 1000);
+            msg += level;
+        }
+        msg += side ? "]}" : "],\"a\":[";
+    }
+
+    return msg;
+}
+
+static double thread_cpu_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void run(const std::string& label, const std::string& port, const std::vector<std::string>& messages,
+                const websocket_compression_options& options)
+{
+    websocket_stats stats{};
+
+    zasync_exec([&]() -> zasync {
+        websocket_client ws_client;
+        ws_client.set_compression_options(options);
+
+        if (!co_await ws_client.connect("ws://127.0.0.1", port, "/echo")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        /* pipelined: the writer runs ahead, the reader drains the echoes */
+        zasync_exec([&]() -> zasync {
+            for (const auto& message : messages) {
+                co_await ws_client.write(message);
+            }
+        });
+
+        for (std::size_t i = 0; i < messages.size(); ++i) {
+            co_await ws_client.read();
+        }
+
+        stats = ws_client.stats();
+        ws_client.disconnect();
+    });
+
+    const auto wall_start = std::chrono::steady_clock::now();
+    const double cpu_start = thread_cpu_ms();
+
+    zrun();
+    get_io_context().restart();
+
+    const double cpu_ms = thread_cpu_ms() - cpu_start;
+    const double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+    const double saved_mb = (static_cast<double>(stats.payload_bytes_read + stats.payload_bytes_written)
+                             - static_cast<double>(stats.wire_bytes_read + stats.wire_bytes_written)) / (1024 * 1024);
+
+    std::printf("%-34s wire out=%8.2fMB in=%8.2fMB ratio out=%5.2fx in=%5.2fx saved=%8.2fMB cpu=%8.1fms (%5.2fus/msg) wall=%8.1fms\n",
+                label.c_str(),
+                stats.wire_bytes_written / (1024.0 * 1024), stats.wire_bytes_read / (1024.0 * 1024),
+                stats.write_compression_ratio(), stats.read_compression_ratio(),
+                saved_mb, cpu_ms, cpu_ms * 1000 / messages.size(), wall_ms);
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+
+    mock::mock_server server;
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/echo",
+        .ws_mode = mock::websocket_mode::echo,
+        .ws_permessage_deflate = true
+    });
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    std::mt19937_64 rng{42};
+    std::vector<std::string> messages;
+    messages.reserve(count);
+
+    std::size_t payload = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        messages.push_back(make_depth_update(rng, i));
+        payload += messages.back().size();
+    }
+
+    std::printf("%zu messages, %.2fMB payload each way (client thread CPU only, the server runs on its own thread)\n",
+                count, payload / (1024.0 * 1024));
+
+    run("uncompressed", port, messages, {});
+    run("deflate 15 bits", port, messages, {.enabled = true});
+    run("deflate 15 bits, level 1", port, messages, {.enabled = true, .compression_level = 1});
+    run("deflate 9 bits", port, messages, {.enabled = true, .client_max_window_bits = 9, .server_max_window_bits = 9});
+    run("deflate no context takeover", port, messages,
+        {.enabled = true, .client_no_context_takeover = true, .server_no_context_takeover = true});
+    run("deflate, min size 512", port, messages, {.enabled = true, .min_message_size = 512});
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+#include "benchmark_util.hpp"
+
+/* Loopback latency from the websocket read completing on the io thread to a
+ * plain (non-io) consumer thread picking the message up: websocket_pump's
+ * lock-free ring polled by a spinning consumer, versus read() results handed
+ * over through a mutex protected queue and a condition variable.
+ * Usage: ./ws_pump_latency [messages] [interval_us] [consumer_cpu] */
+
+using namespace zclient;
+
+using samples_t = std::vector<std::chrono::nanoseconds>;
+
+static samples_t run_pump(mock::mock_server& server, const std::string& port, std::size_t count, int cpu) {
+    websocket_pump pump;
+    samples_t samples;
+    samples.reserve(count);
+
+    std::thread consumer([&] {
+        if (cpu >= 0) pin_current_thread(cpu);
+
+        while (!pump.finished()) {
+            if (auto* msg = pump.poll()) {
+                samples.push_back(std::chrono::steady_clock::now() - msg->received);
+                pump.release();
+
+                /* ends run() on the io thread */
+                if (samples.size() == count) {
+                    server.drop_websockets("/feed");
+                }
+            }
+        }
+    });
+
+    zasync_exec([&]() -> zasync {
+        websocket_client ws_client;
+        if (!co_await ws_client.connect("ws://127.0.0.1", port, "/feed")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        co_await pump.run(ws_client);
+    });
+
+    zrun();
+    get_io_context().restart();
+    consumer.join();
+
+    return samples;
+}
+
+static samples_t run_mutex_queue(const std::string& port, std::size_t count, int cpu) {
+    struct queued {
+        std::string data;
+        std::chrono::steady_clock::time_point received;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<queued> queue;
+    bool done = false;
+
+    samples_t samples;
+    samples.reserve(count);
+
+    std::thread consumer([&] {
+        if (cpu >= 0) pin_current_thread(cpu);
+
+        while (true) {
+            std::unique_lock lock{mutex};
+            cv.wait(lock, [&] { return done || !queue.empty(); });
+            if (queue.empty()) {
+                break;
+            }
+
+            auto msg = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+
+            samples.push_back(std::chrono::steady_clock::now() - msg.received);
+        }
+    });
+
+    zasync_exec([&]() -> zasync {
+        websocket_client ws_client;
+        if (!co_await ws_client.connect("ws://127.0.0.1", port, "/feed")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            auto data = co_await ws_client.read();
+            const auto received = std::chrono::steady_clock::now();
+            {
+                std::lock_guard lock{mutex};
+                queue.push_back(queued{std::move(data), received});
+            }
+            cv.notify_one();
+        }
+
+        ws_client.disconnect();
+    });
+
+    zrun();
+    get_io_context().restart();
+
+    {
+        std::lock_guard lock{mutex};
+        done = true;
+    }
+    cv.notify_one();
+    consumer.join();
+
+    return samples;
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const long interval_us = argc > 2 ? std::stol(argv[2]) : 20;
+    const int cpu = argc > 3 ? std::stoi(argv[3]) : -1;
+
+    mock::mock_server server;
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/feed",
+        .ws_mode = mock::websocket_mode::broadcast,
+        .ws_publish_count = count,
+        .ws_publish_size = 128,
+        .ws_publish_interval = std::chrono::microseconds{interval_us}
+    });
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    bench::print_latency("mutex + condition_variable", bench::summarize(run_mutex_queue(port, count, cpu)));
+    bench::print_latency("websocket_pump (spsc ring)", bench::summarize(run_pump(server, port, count, cpu)));
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include <ctime>
+#include <cstdio>
+#include <iostream>
+#include "zclient.hpp"
+#include "mock_server.hpp"
+
+/* Loopback websocket read throughput: read() returning a fresh std::string per
+ * message versus read_view() and read_into() reusing one buffer. The mock
+ * server pushes messages as fast as it can on connect. Run it from an epoll and
+ * a ZCLIENT_USE_IO_URING build to compare the two backends.
+ * Usage: ./ws_read_throughput [messages] [message_size] */
+
+using namespace zclient;
+
+enum class read_api { string, view, into };
+
+static double thread_cpu_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void run(const std::string& label, const std::string& port, std::size_t count, read_api api) {
+    std::size_t checksum = 0;
+
+    zasync_exec([&]() -> zasync {
+        websocket_client ws_client;
+        if (!co_await ws_client.connect("ws://127.0.0.1", port, "/feed")) {
+            std::cerr << "could not connect to mock server" << std::endl;
+            co_return;
+        }
+
+        std::string buffer;
+
+        for (std::size_t i = 0; i < count; ++i) {
+            switch (api) {
+            case read_api::string:
+                checksum += (co_await ws_client.read()).size();
+                break;
+            case read_api::view:
+                checksum += (co_await ws_client.read_view()).data.size();
+                break;
+            case read_api::into:
+                checksum += (co_await ws_client.read_into(buffer)).data.size();
+                break;
+            }
+        }
+
+        ws_client.disconnect();
+    });
+
+    const auto wall_start = std::chrono::steady_clock::now();
+    const double cpu_start = thread_cpu_ms();
+
+    zrun();
+    get_io_context().restart();
+
+    const double cpu_ms = thread_cpu_ms() - cpu_start;
+    const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    std::printf("%-14s %10.0f msgs/s  cpu=%8.1fms (%5.2fus/msg)  bytes=%zu\n",
+                label.c_str(), count / wall_s, cpu_ms, cpu_ms * 1000 / count, checksum);
+}
+
+int main(int argc, char *argv[]) {
+    const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 500000;
+    const std::size_t size = argc > 2 ? std::stoul(argv[2]) : 512;
+
+    mock::mock_server server;
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/feed",
+        .ws_mode = mock::websocket_mode::broadcast,
+        .ws_publish_count = count,
+        .ws_publish_size = size
+    });
+    server.start();
+
+    const auto port = std::to_string(server.plain_port());
+
+    std::printf("%zu messages of %zu bytes over %s (client thread CPU only)\n", count, size, io_backend_name());
+
+    run("read()", port, count, read_api::string);
+    run("read_view()", port, count, read_api::view);
+    run("read_into()", port, count, read_api::into);
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include "zclient.hpp"
+
+#include <chrono>
+#include <thread>
+
+/* example of spreading parallel http requests over a thread-per-core runtime,
+ * where every thread runs its own io_context instead of sharing the global one */
+
+using namespace zclient;
+
+zasync query(std::string host, std::string port, std::string path) {
+    auto resp = co_await fetch(host, port, http_request{
+        .method = http_method::get,
+        .path = path,
+        .header_data = {}
+    });
+    std::cout << "[thread " << std::this_thread::get_id() << "] " << host << path
+              << " returned with code: " << resp.return_code << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    thread_per_core_runtime runtime{runtime_options{
+        .threads = 3,
+        .pin_threads = true
+    }};
+
+    runtime.start();
+
+    /* pick a specific shard ... */
+    runtime.spawn_on(0, []{ return query("http://www.google.com", "80", "/"); });
+
+    /* ... or let the runtime pick the least loaded one. Every connection made inside
+     * a spawned coroutine lives on that coroutine's shard */
+    runtime.spawn([]{ return query("https://testnet.binance.vision", "443", "/api/v3/trades?symbol=BTCUSDT&limit=5"); });
+    runtime.spawn([]{ return query("https://en.cppreference.com", "443", "/w/cpp/language/basic_concepts"); });
+
+    /* wait for every shard to drain its work */
+    while (true) {
+        std::size_t outstanding = 0;
+        for (std::size_t i = 0; i < runtime.size(); ++i) {
+            outstanding += runtime.load(i);
+        }
+        if (!outstanding) break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    runtime.stop();
+
+    return EXIT_SUCCESS;
+}
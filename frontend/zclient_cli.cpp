@@ -4,6 +4,7 @@
 #include <thread>
 #include <mutex>
 #include <csignal>
+#include <cctype>
 
 #include "zclient.hpp"
 #include "zlogger.hpp"
@@ -36,11 +37,35 @@ static void fill_hostname_path_and_port(const std::string url_after_prefix, std:
     LOG_INFO << "Hostname = " << hostname << ", Port = " << port << ", Path = " << path;
 }
 
+/* http+unix://%2Frun%2Fsidecar.sock/path: the socket's path is percent-encoded
+ * in place of the hostname, everything from the next slash is the target */
+static void fill_socket_path_and_path(const std::string url_after_prefix, std::string& socket_path, std::string& path) {
+    auto nextslash = url_after_prefix.find("/");
+    auto encoded = url_after_prefix.substr(0, nextslash);
+    path = nextslash == std::string::npos ? "/" : url_after_prefix.substr(nextslash);
+
+    socket_path.clear();
+    for (std::size_t i = 0; i < encoded.size(); ++i) {
+        if (encoded[i] == '%' && i + 2 < encoded.size()
+            && std::isxdigit(static_cast<unsigned char>(encoded[i + 1]))
+            && std::isxdigit(static_cast<unsigned char>(encoded[i + 2]))) {
+            socket_path.push_back(static_cast<char>(std::stoi(encoded.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        } else {
+            socket_path.push_back(encoded[i]);
+        }
+    }
+
+    LOG_INFO << "Socket path = " << socket_path << ", Path = " << path;
+}
+
 enum class connection_type {
     http,
     https,
     ws,
-    wss
+    wss,
+    http_unix,
+    ws_unix
 };
 
 void signal_handler(int signal) {
@@ -55,7 +80,7 @@ int main(int argc, char *argv[]) {
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help,h", "print this help message")
-        ("url", po::value<std::string>(), "Specify the URL to request. http:// for unsecured and https:// for secured")
+        ("url", po::value<std::string>(), "Specify the URL to request. http:// for unsecured and https:// for secured, http+unix://%2Fpath%2Fto.sock/target for a unix socket")
         ("request,X", po::value<std::string>(), "Specify the HTTP request method. Supported = [GET, POST, PUT, DELETE]")
         ("headers,H", po::value<std::vector<std::string>>()->multitoken(), "Specify the headers. Format = 'key1:value1 key2:value2 ...'")
         ("data,d", po::value<std::string>(), "Send data with the request body.")
@@ -87,7 +112,7 @@ int main(int argc, char *argv[]) {
     connection_type conntype;
 
     if (!vm.count("url")) {
-        std::cout << "URL must be provided. Prefixes: 'http://', 'https://', 'ws://', 'wss://'" << std::endl;
+        std::cout << "URL must be provided. Prefixes: 'http://', 'https://', 'ws://', 'wss://', 'http+unix://', 'ws+unix://'" << std::endl;
         std::cout << desc << std::endl;
         return EXIT_FAILURE;
     }
@@ -95,7 +120,15 @@ int main(int argc, char *argv[]) {
     /* split URL into hostname and path */
     std::string url = vm["url"].as<std::string>();
     size_t idx = 0;
-    if ((idx = url.find("http://")) != std::string::npos) {
+    if ((idx = url.find("http+unix://")) != std::string::npos) {
+        fill_socket_path_and_path(url.substr(idx + strlen("http+unix://")), hostname, req.path);
+        hostname = "http+unix://" + hostname;
+        conntype = connection_type::http_unix;
+    } else if ((idx = url.find("ws+unix://")) != std::string::npos) {
+        fill_socket_path_and_path(url.substr(idx + strlen("ws+unix://")), hostname, req.path);
+        hostname = "ws+unix://" + hostname;
+        conntype = connection_type::ws_unix;
+    } else if ((idx = url.find("http://")) != std::string::npos) {
         fill_hostname_path_and_port(url.substr(idx + strlen("http://")), hostname, req.path, port, "http://");
         hostname = "http://" + hostname; // TODO: optimise
         if (!port.length()) port = "80";
@@ -116,7 +149,7 @@ int main(int argc, char *argv[]) {
         if (!port.length()) port = "443";
         conntype = connection_type::wss;
     } else {
-        std::cerr << "Unrecognized prefix. Only http:// or http:// supported" << std::endl;
+        std::cerr << "Unrecognized prefix. Only http://, https://, ws://, wss://, http+unix:// or ws+unix:// supported" << std::endl;
         return EXIT_FAILURE;
     }
 
@@ -176,7 +209,7 @@ int main(int argc, char *argv[]) {
         response_print_limit = vm["limit_response"].as<unsigned>();
     }
     
-    if (conntype == connection_type::http || conntype == connection_type::https) {
+    if (conntype == connection_type::http || conntype == connection_type::https || conntype == connection_type::http_unix) {
         zclient::zasync_exec(
             [hostname = std::move(hostname),
             port = std::move(port),
@@ -26,6 +26,22 @@ inline boost::asio::io_context& get_io_context() {
     return asio_context_provider::get_instance().get_io_context();
 }
 
+/* the kernel interface behind every io_context, fixed at build time
+ * (cmake -DZCLIENT_USE_IO_URING=ON selects io_uring, experimental) */
+constexpr const char* io_backend_name() {
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+    return "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+    return "kqueue";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+    return "iocp";
+#else
+    return "select";
+#endif
+}
+
 } // ns zclient
 
 #endif // ASIO_CONTEXT_PROVIDER_HPP
\ No newline at end of file
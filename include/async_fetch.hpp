@@ -0,0 +1,516 @@
+#ifndef ASYNC_FETCH_HPP
+#define ASYNC_FETCH_HPP
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/compose.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/system_executor.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/beast/http/write.hpp>
+#include <boost/beast/ssl/ssl_stream.hpp>
+#include <openssl/ssl.h>
+
+#include "asio_context_provider.hpp"
+#include "dns_resolver.hpp"
+#include "http_client.hpp"
+#include "rx_timestamp.hpp"
+#include "socket_options.hpp"
+#include "transport.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+namespace detail {
+
+/* host with its http://, https:// or http+unix:// prefix stripped */
+struct fetch_target {
+    std::string host;
+    bool use_ssl;
+    bool use_unix = false;
+};
+
+/* throws std::invalid_argument on an unrecognized prefix */
+fetch_target parse_fetch_host(const std::string& host);
+
+boost::beast::http::request<boost::beast::http::string_body>
+translate_http_request(const std::string& host, const http_request& request);
+
+http_response
+translate_http_response(boost::beast::http::response<boost::beast::http::string_body>&& res);
+
+/* verifying client context shared by every async_fetch, so a fetch does not
+ * pay for loading the trust store */
+boost::asio::ssl::context& shared_ssl_context();
+
+/* cancels a wait made directly on the socket, which the stream's own timeout
+ * does not cover, once HTTP_TIMEOUT_SECONDS pass. Clear the returned flag when
+ * the wait completes first, so a late timer cannot cancel the read after it */
+template <typename Socket>
+std::shared_ptr<bool> arm_wait_timeout(boost::asio::steady_timer& timer, Socket& socket) {
+    auto waiting = std::make_shared<bool>(true);
+    timer.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+    timer.async_wait([&socket, waiting](boost::system::error_code ec) {
+        if (!ec && *waiting) {
+            socket.cancel();
+        }
+    });
+    return waiting;
+}
+
+/* what a fetch takes from the client it is made for, the defaults for a
+ * bare async_fetch */
+struct fetch_settings {
+    socket_options options = default_socket_options();
+
+    /* nullptr for the system's getaddrinfo() */
+    std::shared_ptr<dns_resolver> resolver;
+
+    tls_shutdown_policy tls_shutdown = default_tls_shutdown_policy();
+};
+
+/* Over TLS 1.3 the first bytes to arrive after the request are usually the
+ * server's NewSessionTicket rather than the response, so their timestamp says
+ * nothing about the response. Instead this watches the records OpenSSL opens
+ * and keeps the timestamp of the read by the rx_timestamp_stream below TLS
+ * that completed the first application data record. Installed on ssl until
+ * destroyed, which must happen before the layer is */
+class tls_rx_stamp {
+public:
+    template <typename Layer>
+    tls_rx_stamp(SSL* ssl, const Layer& layer)
+        :ssl_{ssl}
+        ,last_rx_{[&layer]() { return layer.last_rx_timestamp(); }}
+    {
+        SSL_set_msg_callback_arg(ssl_, this);
+        SSL_set_msg_callback(ssl_, &tls_rx_stamp::on_record);
+    }
+
+    ~tls_rx_stamp() {
+        SSL_set_msg_callback(ssl_, nullptr);
+        SSL_set_msg_callback_arg(ssl_, nullptr);
+    }
+
+    tls_rx_stamp(const tls_rx_stamp& other) = delete;
+    tls_rx_stamp& operator=(const tls_rx_stamp& other) = delete;
+
+    /* epoch until application data has arrived */
+    rx_time_point timestamp() const noexcept { return stamp_; }
+
+private:
+    static void on_record(int write_p, int, int content_type, const void* buf, std::size_t len, SSL* ssl, void* arg) {
+        auto* self = static_cast<tls_rx_stamp*>(arg);
+        if (write_p || len == 0 || self->stamp_ != rx_time_point{}) {
+            return;
+        }
+
+        /* TLS 1.3 records all claim to be application data, the real type
+         * is only known once the record is decrypted */
+        const int type_field = SSL_version(ssl) >= TLS1_3_VERSION ? SSL3_RT_INNER_CONTENT_TYPE : SSL3_RT_HEADER;
+        if (content_type == type_field && *static_cast<const unsigned char*>(buf) == SSL3_RT_APPLICATION_DATA) {
+            self->stamp_ = self->last_rx_();
+        }
+    }
+
+    SSL* ssl_;
+    std::function<rx_time_point()> last_rx_;
+    rx_time_point stamp_{};
+};
+
+template <typename Transport>
+struct fetch_state {
+    static constexpr bool use_ssl = std::is_same_v<Transport, tls_transport>;
+    static constexpr bool use_unix = std::is_same_v<Transport, unix_transport>;
+
+    using stream_type = std::conditional_t<use_ssl,
+        boost::beast::ssl_stream<rx_timestamp_stream<boost::beast::tcp_stream>>,
+        std::conditional_t<use_unix,
+            boost::beast::basic_stream<boost::asio::local::stream_protocol>,
+            boost::beast::tcp_stream>>;
+
+    template <typename Executor>
+    fetch_state(
+        const Executor& ex,
+        std::string host_,
+        std::string port_,
+        const http_request& request,
+        const fetch_settings& settings
+    )
+        :resolver{ex}
+        ,dns{settings.resolver}
+        ,stream{make_stream(ex)}
+        ,host{std::move(host_)}
+        ,port{std::move(port_)}
+        /* a unix socket's path makes no sense as the Host header */
+        ,req{translate_http_request(use_unix ? "localhost" : host, request)}
+        ,options{settings.options}
+        ,rx_timer{ex}
+        ,tls_shutdown{settings.tls_shutdown}
+    {
+        if constexpr (use_ssl) {
+            // Set SNI Hostname (many hosts need this to handshake successfully)
+            if (!SSL_set_tlsext_host_name(stream.native_handle(), host.c_str())) {
+                init_ec.assign(static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category());
+            }
+        }
+    }
+
+    template <typename Executor>
+    static stream_type make_stream(const Executor& ex) {
+        if constexpr (use_ssl) {
+            return stream_type{boost::beast::tcp_stream{ex}, shared_ssl_context()};
+        } else {
+            return stream_type{ex};
+        }
+    }
+
+    boost::asio::ip::tcp::resolver resolver;
+    std::shared_ptr<dns_resolver> dns;
+    boost::asio::ip::tcp::resolver::results_type results;
+    stream_type stream;
+
+    std::string host;
+    std::string port;
+    boost::beast::http::request<boost::beast::http::string_body> req;
+    boost::beast::flat_buffer buffer;
+    boost::beast::http::response<boost::beast::http::string_body> res;
+    socket_options options;
+
+    boost::asio::steady_timer rx_timer;
+    std::shared_ptr<bool> rx_waiting;
+    std::optional<tls_rx_stamp> tls_rx;
+    rx_time_point rx_timestamp{};
+
+    tls_shutdown_policy tls_shutdown;
+
+    boost::system::error_code init_ec;
+};
+
+/* resolve -> connect -> [handshake] -> write -> read -> shutdown as a stackless
+ * composed operation (a unix socket skips the resolve). All state lives in one
+ * heap block owned by the op */
+template <typename Transport>
+class fetch_op : boost::asio::coroutine {
+public:
+    using state_type = fetch_state<Transport>;
+
+    explicit fetch_op(std::unique_ptr<state_type> state)
+        :state_{std::move(state)}
+    {}
+
+    template <typename Self>
+    void operator()(Self& self, boost::system::error_code ec = {}, std::size_t = 0) {
+        auto& s = *state_;
+        auto& lowest = boost::beast::get_lowest_layer(s.stream);
+
+        BOOST_ASIO_CORO_REENTER(*this) {
+            LOG_TRACE << "async_fetch for: " << s.host << ":" << s.port;
+
+            if (!state_type::use_unix) {
+                BOOST_ASIO_CORO_YIELD async_resolve(std::move(self));
+                if (s.init_ec) {
+                    return fail(self, s.init_ec, "SNI hostname");
+                }
+                if (ec) {
+                    return fail(self, ec, "Domain name resolution");
+                }
+            }
+
+            lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            BOOST_ASIO_CORO_YIELD async_connect(std::move(self));
+            if (ec) {
+                return fail(self, ec, "Connection");
+            }
+
+            LOG_TRACE << "Connected to: " << s.host << ":" << s.port;
+
+            /* the TCP level options do not apply to unix sockets */
+            if (!state_type::use_unix) {
+                apply_socket_options(lowest.socket(), s.options);
+            }
+
+            if (state_type::use_ssl) {
+                lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+                BOOST_ASIO_CORO_YIELD async_handshake(std::move(self));
+                if (ec) {
+                    return fail(self, ec, "SSL handshake");
+                }
+            }
+
+            lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            BOOST_ASIO_CORO_YIELD boost::beast::http::async_write(s.stream, s.req, std::move(self));
+            if (ec) {
+                return fail(self, ec, "Write");
+            }
+
+            /* stamp the first response bytes before the read consumes them,
+             * over TLS the first record of the response (see tls_rx_stamp) */
+            if (s.options.rx_timestamps && !state_type::use_unix) {
+                s.rx_waiting = arm_wait_timeout(s.rx_timer, lowest.socket());
+                if (state_type::use_ssl) {
+                    start_tls_rx_stamp();
+                } else {
+                    BOOST_ASIO_CORO_YIELD lowest.socket().async_wait(boost::asio::socket_base::wait_read, std::move(self));
+                    *s.rx_waiting = false;
+                    s.rx_timer.cancel();
+                    if (ec) {
+                        return fail(self, ec == boost::asio::error::operation_aborted ? boost::beast::error::timeout : ec, "Read");
+                    }
+                    s.rx_timestamp = peek_rx_timestamp(lowest.socket().native_handle());
+                }
+            }
+
+            BOOST_ASIO_CORO_YIELD boost::beast::http::async_read(s.stream, s.buffer, s.res, std::move(self));
+            if (s.tls_rx) {
+                finish_tls_rx_stamp(ec);
+            }
+            if (ec) {
+                return fail(self, ec, "Read");
+            }
+
+            LOG_TRACE << "Response received from " << s.host << ":" << s.port;
+
+            if (state_type::use_ssl && s.tls_shutdown != tls_shutdown_policy::wait) {
+                auto response = translate_http_response(std::move(s.res));
+                response.rx_timestamp = s.rx_timestamp;
+
+                /* the state outlives the op in the shutdown's handler */
+                if (s.tls_shutdown == tls_shutdown_policy::background) {
+                    shutdown_in_background(std::move(state_));
+                }
+
+                self.complete(boost::system::error_code{}, std::move(response));
+                return;
+            }
+
+            if (state_type::use_ssl) {
+                BOOST_ASIO_CORO_YIELD async_shutdown(std::move(self));
+                // http://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
+                if (ec == boost::asio::error::eof || ec == boost::asio::ssl::error::stream_truncated) {
+                    ec = {};
+                }
+            } else {
+                lowest.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+                // not_connected happens sometimes so don't bother reporting it
+                if (ec == boost::beast::errc::not_connected) {
+                    ec = {};
+                }
+            }
+
+            if (ec) {
+                return fail(self, ec, "Shutdown");
+            }
+
+            LOG_TRACE << "Connection closed for " << s.host << ":" << s.port;
+
+            {
+                auto response = translate_http_response(std::move(s.res));
+                response.rx_timestamp = s.rx_timestamp;
+                self.complete(boost::system::error_code{}, std::move(response));
+            }
+        }
+    }
+
+    template <typename Self>
+    void operator()(Self& self, boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results) {
+        state_->results = std::move(results);
+        (*this)(self, ec);
+    }
+
+    /* the lookup through a dns_resolver */
+    template <typename Self>
+    void operator()(Self& self, std::exception_ptr e, boost::asio::ip::tcp::resolver::results_type results) {
+        boost::system::error_code ec;
+        if (e) {
+            try {
+                std::rethrow_exception(e);
+            } catch (const boost::system::system_error& error) {
+                ec = error.code();
+            } catch (const std::exception& error) {
+                LOG_ERROR << "Domain name resolution failed for " << state_->host << " with error: " << error.what();
+                ec = boost::asio::error::host_not_found;
+            }
+        }
+        (*this)(self, ec, std::move(results));
+    }
+
+    template <typename Self>
+    void operator()(Self& self, boost::system::error_code ec, const boost::asio::ip::tcp::endpoint&) {
+        (*this)(self, ec);
+    }
+
+private:
+    template <typename Self>
+    void fail(Self& self, const boost::system::error_code& ec, const char* stage) {
+        LOG_ERROR << stage << " failed for " << state_->host << ":" << state_->port << " with error: " << ec.message();
+        self.complete(ec, http_response{});
+    }
+
+    template <typename Self>
+    void async_resolve(Self&& self) {
+        if constexpr (!state_type::use_unix) {
+            if (state_->dns) {
+                /* the state, and with it host and port, lives until the op completes */
+                boost::asio::co_spawn(state_->resolver.get_executor(),
+                    state_->dns->resolve(state_->host, state_->port), std::move(self));
+            } else {
+                state_->resolver.async_resolve(state_->host, state_->port, std::move(self));
+            }
+        }
+    }
+
+    template <typename Self>
+    void async_connect(Self&& self) {
+        auto& lowest = boost::beast::get_lowest_layer(state_->stream);
+        if constexpr (state_type::use_unix) {
+            lowest.async_connect(boost::asio::local::stream_protocol::endpoint{state_->host}, std::move(self));
+        } else {
+            lowest.async_connect(state_->results, std::move(self));
+        }
+    }
+
+    template <typename Self>
+    void async_handshake(Self&& self) {
+        if constexpr (state_type::use_ssl) {
+            state_->stream.async_handshake(boost::asio::ssl::stream_base::client, std::move(self));
+        }
+    }
+
+    /* the layer reads the socket itself, so the response read is timed by
+     * rx_timer rather than the stream */
+    void start_tls_rx_stamp() {
+        if constexpr (state_type::use_ssl) {
+            auto& layer = state_->stream.next_layer();
+            layer.enable();
+            state_->tls_rx.emplace(state_->stream.native_handle(), layer);
+        }
+    }
+
+    void finish_tls_rx_stamp(boost::system::error_code& ec) {
+        if constexpr (state_type::use_ssl) {
+            *state_->rx_waiting = false;
+            state_->rx_timer.cancel();
+            state_->rx_timestamp = state_->tls_rx->timestamp();
+            state_->tls_rx.reset();
+
+            /* the shutdown is timed by the stream again */
+            state_->stream.next_layer().disable();
+
+            if (ec == boost::asio::error::operation_aborted) {
+                ec = boost::beast::error::timeout;
+            }
+        }
+    }
+
+    template <typename Self>
+    void async_shutdown(Self&& self) {
+        if constexpr (state_type::use_ssl) {
+            state_->stream.async_shutdown(std::move(self));
+        }
+    }
+
+    static void shutdown_in_background(std::unique_ptr<state_type> state) {
+        if constexpr (state_type::use_ssl) {
+            auto& stream = state->stream;
+            boost::beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(TLS_SHUTDOWN_TIMEOUT_SECONDS));
+            stream.async_shutdown([state = std::move(state)](boost::system::error_code ec) {
+                LOG_TRACE << "Background TLS shutdown for " << state->host << " ended with: " << ec.message();
+            });
+        }
+    }
+
+    std::unique_ptr<state_type> state_;
+};
+
+/* the I/O runs on the handler's executor (e.g. the awaiting coroutine's), or on
+ * the global io_context for handlers without one such as plain callbacks and use_future */
+template <typename Handler>
+boost::asio::any_io_executor fetch_io_executor(const Handler& handler) {
+    using executor_type = boost::asio::associated_executor_t<Handler>;
+
+    if constexpr (std::is_same_v<executor_type, boost::asio::system_executor>
+                  || !std::is_constructible_v<boost::asio::ip::tcp::resolver, const executor_type&>) {
+        return get_io_context().get_executor();
+    } else {
+        return boost::asio::get_associated_executor(handler);
+    }
+}
+
+template <typename Transport, typename Handler>
+void start_fetch(Handler&& handler, const fetch_target& target, const std::string& port,
+                 const http_request& request, const fetch_settings& settings)
+{
+    auto ex = fetch_io_executor(handler);
+
+    auto state = std::make_unique<fetch_state<Transport>>(ex, target.host, port, request, settings);
+    auto& io_object = boost::beast::get_lowest_layer(state->stream);
+
+    boost::asio::async_compose<std::decay_t<Handler>, void(boost::system::error_code, http_response)>(
+        fetch_op<Transport>{std::move(state)}, handler, io_object);
+}
+
+/* picks the transport from host's prefix */
+template <typename Handler>
+void start_fetch_for_host(Handler&& handler, const std::string& host, const std::string& port,
+                 const http_request& request, const fetch_settings& settings)
+{
+    auto target = parse_fetch_host(host);
+
+    if (target.use_unix) {
+        start_fetch<unix_transport>(std::forward<Handler>(handler), target, port, request, settings);
+    } else if (target.use_ssl) {
+        start_fetch<tls_transport>(std::forward<Handler>(handler), target, port, request, settings);
+    } else {
+        start_fetch<plain_transport>(std::forward<Handler>(handler), target, port, request, settings);
+    }
+}
+
+} // ns detail
+
+/* Fetch with any asio completion token (plain callback, use_future, deferred,
+ * use_awaitable, as_tuple(...), ...) and signature
+ * void(boost::system::error_code, http_response). Unlike fetch_then, no
+ * coroutine frame or std::function is involved, and the handler runs on its
+ * associated executor (the global io_context if it has none). Fetches with
+ * default_socket_options(), the system's resolver and
+ * default_tls_shutdown_policy(); http_client::fetch_then uses its client's.
+ *
+ * host takes the same http:// / https:// / http+unix:// prefixes as http_client::fetch */
+template <typename CompletionToken>
+auto async_fetch(
+    const std::string& host,
+    const std::string& port,
+    const http_request& request,
+    CompletionToken&& token
+)
+{
+    /* lazy tokens (use_awaitable, deferred) run the initiation after we return,
+     * so it only sees the caller's arguments, never our locals */
+    return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, http_response)>(
+        [](auto handler, const std::string& h, const std::string& p, const http_request& r) {
+            detail::start_fetch_for_host(std::move(handler), h, p, r, detail::fetch_settings{});
+        },
+        token, host, port, request);
+}
+
+} // ns zclient
+
+#endif // ASYNC_FETCH_HPP
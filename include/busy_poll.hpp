@@ -0,0 +1,41 @@
+#ifndef BUSY_POLL_HPP
+#define BUSY_POLL_HPP
+
+#include <chrono>
+#include <boost/asio/io_context.hpp>
+
+#include "socket_options.hpp"
+
+namespace zclient {
+
+struct busy_poll_options {
+    /* pin the polling thread to this cpu, -1 = leave unpinned */
+    int cpu = -1;
+
+    /* keep spinning on poll() for this long after the last handler ran before
+     * backing off. duration::max() never backs off */
+    std::chrono::microseconds spin_duration{1000};
+
+    /* once backed off, block in the reactor for at most this long per wait.
+     * Any completion puts the loop straight back into spinning */
+    std::chrono::microseconds idle_wait{1000};
+
+    /* SO_BUSY_POLL for the sockets of the clients on this loop, handed to
+     * them through busy_poll_socket_options() (see socket_options::busy_poll_usec) */
+    int socket_busy_poll_usec = 0;
+};
+
+/* Low latency alternative to io_context::run(). Spins on poll() so completions
+ * are picked up without waking from epoll, falling back to blocking waits when
+ * idle. Like run(), returns once the io_context is stopped or runs out of work.
+ * Meant for a dedicated (ideally pinned and isolated) core */
+void run_busy_poll(boost::asio::io_context& ioc, const busy_poll_options& options = {});
+
+/* base with options.socket_busy_poll_usec applied, for set_socket_options()
+ * of the clients run by the loop. run_busy_poll() leaves sockets alone, and
+ * default_socket_options() with them, as other loops in the process share it */
+socket_options busy_poll_socket_options(const busy_poll_options& options, socket_options base = default_socket_options());
+
+} // ns zclient
+
+#endif // BUSY_POLL_HPP
@@ -0,0 +1,211 @@
+#ifndef COALESCING_STREAM_HPP
+#define COALESCING_STREAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/compose.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/role.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+
+namespace zclient {
+
+/* Stream layer that can hold writes back and send them as one socket write.
+ * While corked, async_write_some copies the bytes into a pending buffer and
+ * completes straight away, so several small websocket frames written back to
+ * back end up in a single async_flush(). Writes that arrive during a flush wait
+ * for it to finish, so frames never interleave on the wire.
+ *
+ * It also counts the bytes that cross it, which for a websocket stream are the
+ * frame bytes after compression (and before TLS).
+ *
+ * All operations must be initiated from the stream's executor (a strand when
+ * the io_context is run from several threads). */
+template <typename NextLayer>
+class coalescing_stream {
+public:
+    using next_layer_type = NextLayer;
+    using executor_type = typename NextLayer::executor_type;
+
+    template <typename... Args>
+    explicit coalescing_stream(Args&&... args)
+        :next_layer_{std::forward<Args>(args)...}
+        ,flushed_{next_layer_.get_executor()}
+    {
+        flushed_.expires_at(std::chrono::steady_clock::time_point::max());
+    }
+
+    executor_type get_executor() noexcept { return next_layer_.get_executor(); }
+
+    next_layer_type& next_layer() noexcept { return next_layer_; }
+    const next_layer_type& next_layer() const noexcept { return next_layer_; }
+
+    /* buffer subsequent writes until the next async_flush() */
+    void cork() noexcept { corked_ = true; }
+    bool corked() const noexcept { return corked_; }
+
+    std::size_t pending() const noexcept { return pending_.size(); }
+
+    /* safe to read from any thread */
+    std::uint64_t bytes_read() const noexcept { return bytes_read_.load(std::memory_order_relaxed); }
+    std::uint64_t bytes_written() const noexcept { return bytes_written_.load(std::memory_order_relaxed); }
+
+    /* uncork and write everything buffered in one go. Completes with void(error_code) */
+    template <typename CompletionToken>
+    auto async_flush(CompletionToken&& token) {
+        return boost::asio::async_compose<CompletionToken, void(boost::system::error_code)>(
+            flush_op{*this}, token, next_layer_);
+    }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+        return boost::asio::async_compose<ReadHandler, void(boost::system::error_code, std::size_t)>(
+            read_op<MutableBufferSequence>{*this, buffers}, handler, next_layer_);
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+        return boost::asio::async_compose<WriteHandler, void(boost::system::error_code, std::size_t)>(
+            write_op<ConstBufferSequence>{*this, buffers}, handler, next_layer_);
+    }
+
+    /* synchronous operations bypass the cork, they are only used to close */
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers) {
+        return next_layer_.read_some(buffers);
+    }
+
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& ec) {
+        return next_layer_.read_some(buffers, ec);
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers) {
+        return next_layer_.write_some(buffers);
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers, boost::system::error_code& ec) {
+        return next_layer_.write_some(buffers, ec);
+    }
+
+private:
+    template <typename MutableBufferSequence>
+    struct read_op : boost::asio::coroutine {
+        read_op(coalescing_stream& s_, const MutableBufferSequence& buffers_)
+            :s{s_}
+            ,buffers{buffers_}
+        {}
+
+        coalescing_stream& s;
+        MutableBufferSequence buffers;
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, std::size_t n = 0) {
+            BOOST_ASIO_CORO_REENTER(*this) {
+                BOOST_ASIO_CORO_YIELD s.next_layer_.async_read_some(buffers, std::move(self));
+                s.bytes_read_.fetch_add(n, std::memory_order_relaxed);
+                self.complete(ec, n);
+            }
+        }
+    };
+
+    template <typename ConstBufferSequence>
+    struct write_op : boost::asio::coroutine {
+        write_op(coalescing_stream& s_, const ConstBufferSequence& buffers_)
+            :s{s_}
+            ,buffers{buffers_}
+        {}
+
+        coalescing_stream& s;
+        ConstBufferSequence buffers;
+        std::size_t buffered = 0;
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, std::size_t n = 0) {
+            BOOST_ASIO_CORO_REENTER(*this) {
+                while (s.flushing_) {
+                    /* woken by the cancel at the end of the flush */
+                    BOOST_ASIO_CORO_YIELD s.flushed_.async_wait(std::move(self));
+                }
+
+                if (s.corked_) {
+                    buffered = boost::asio::buffer_size(buffers);
+                    s.pending_.commit(boost::asio::buffer_copy(s.pending_.prepare(buffered), buffers));
+
+                    /* never complete from inside the initiating function */
+                    BOOST_ASIO_CORO_YIELD boost::asio::post(s.get_executor(), std::move(self));
+                    return self.complete(boost::system::error_code{}, buffered);
+                }
+
+                BOOST_ASIO_CORO_YIELD s.next_layer_.async_write_some(buffers, std::move(self));
+                s.bytes_written_.fetch_add(n, std::memory_order_relaxed);
+                self.complete(ec, n);
+            }
+        }
+    };
+
+    struct flush_op : boost::asio::coroutine {
+        explicit flush_op(coalescing_stream& s_)
+            :s{s_}
+        {}
+
+        coalescing_stream& s;
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, std::size_t n = 0) {
+            BOOST_ASIO_CORO_REENTER(*this) {
+                s.corked_ = false;
+
+                if (s.pending_.size() == 0) {
+                    BOOST_ASIO_CORO_YIELD boost::asio::post(s.get_executor(), std::move(self));
+                    return self.complete(boost::system::error_code{});
+                }
+
+                s.flushing_ = true;
+                BOOST_ASIO_CORO_YIELD boost::asio::async_write(s.next_layer_, s.pending_.data(), std::move(self));
+
+                s.flushing_ = false;
+                s.pending_.clear();
+                s.bytes_written_.fetch_add(n, std::memory_order_relaxed);
+                s.flushed_.cancel();
+
+                self.complete(ec);
+            }
+        }
+    };
+
+    NextLayer next_layer_;
+    boost::beast::flat_buffer pending_;
+    boost::asio::steady_timer flushed_;
+    bool corked_ = false;
+    bool flushing_ = false;
+
+    std::atomic<std::uint64_t> bytes_read_{0};
+    std::atomic<std::uint64_t> bytes_written_{0};
+};
+
+template <typename NextLayer>
+void teardown(boost::beast::role_type role, coalescing_stream<NextLayer>& stream, boost::system::error_code& ec) {
+    using boost::beast::websocket::teardown;
+    teardown(role, stream.next_layer(), ec);
+}
+
+template <typename NextLayer, typename TeardownHandler>
+void async_teardown(boost::beast::role_type role, coalescing_stream<NextLayer>& stream, TeardownHandler&& handler) {
+    using boost::beast::websocket::async_teardown;
+    async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+}
+
+} // ns zclient
+
+#endif // COALESCING_STREAM_HPP
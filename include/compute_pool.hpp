@@ -0,0 +1,142 @@
+#ifndef COMPUTE_POOL_HPP
+#define COMPUTE_POOL_HPP
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/execution/outstanding_work.hpp>
+#include <boost/asio/prefer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace zclient {
+
+/* move-only type-erased task, so handlers that cannot be copied (e.g. coroutine
+ * continuations) can be queued without a std::function */
+class compute_task {
+public:
+    compute_task() = default;
+
+    template <typename F>
+        requires (!std::is_same_v<std::decay_t<F>, compute_task>)
+    compute_task(F&& f)
+        :p_{std::make_unique<model<std::decay_t<F>>>(std::forward<F>(f))}
+    {}
+
+    void operator()() { p_->invoke(); }
+    explicit operator bool() const { return static_cast<bool>(p_); }
+
+private:
+    struct base {
+        virtual ~base() = default;
+        virtual void invoke() = 0;
+    };
+
+    template <typename F>
+    struct model : base {
+        explicit model(F&& f) : f_{std::move(f)} {}
+        explicit model(const F& f) : f_{f} {}
+        void invoke() override { f_(); }
+        F f_;
+    };
+
+    std::unique_ptr<base> p_;
+};
+
+/* Work-stealing thread pool for CPU heavy handlers, kept separate from the
+ * io_context threads so that parsing a large response never stalls other
+ * sockets. Each worker owns a deque: tasks posted from a worker go to its own
+ * deque (popped LIFO for cache locality), tasks from outside are spread round
+ * robin, and idle workers steal FIFO from the others. */
+class compute_pool {
+public:
+    /* 0 = one worker per hardware thread */
+    explicit compute_pool(unsigned threads = 0);
+
+    /* runs the tasks already queued, then joins the workers */
+    ~compute_pool();
+
+    compute_pool(const compute_pool& other) = delete;
+    compute_pool& operator=(const compute_pool& other) = delete;
+
+    void post(compute_task task);
+    std::size_t size() const;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+namespace detail {
+
+template <typename R>
+struct offload_signature {
+    using type = void(std::exception_ptr, R);
+};
+
+template <>
+struct offload_signature<void> {
+    using type = void(std::exception_ptr);
+};
+
+} // ns detail
+
+/* Run f on the compute pool and complete with its result (or exception) on the
+ * token's associated executor. With the default use_awaitable token:
+ *
+ *     auto doc = co_await offload(pool, [&]{ return parse(resp.body); });
+ *
+ * runs parse() on a pool worker and resumes the coroutine back on its io thread.
+ * Non-void results must be default constructible (they are left empty on error). */
+template <typename F, typename CompletionToken = boost::asio::use_awaitable_t<>>
+auto offload(compute_pool& pool, F&& f, CompletionToken&& token = {}) {
+    using result_type = std::invoke_result_t<std::decay_t<F>&>;
+    using signature = typename detail::offload_signature<result_type>::type;
+
+    return boost::asio::async_initiate<CompletionToken, signature>(
+        [&pool](auto handler, auto fn) {
+            /* keep the completion executor (and so its io_context) alive while the work runs */
+            auto ex = boost::asio::prefer(
+                boost::asio::get_associated_executor(handler),
+                boost::asio::execution::outstanding_work.tracked);
+
+            pool.post([handler = std::move(handler), fn = std::move(fn), ex = std::move(ex)]() mutable {
+                std::exception_ptr e;
+
+                if constexpr (std::is_void_v<result_type>) {
+                    try {
+                        fn();
+                    } catch (...) {
+                        e = std::current_exception();
+                    }
+
+                    boost::asio::dispatch(ex, [handler = std::move(handler), e]() mutable {
+                        std::move(handler)(e);
+                    });
+                } else {
+                    std::optional<result_type> result;
+                    try {
+                        result.emplace(fn());
+                    } catch (...) {
+                        e = std::current_exception();
+                    }
+
+                    boost::asio::dispatch(ex, [handler = std::move(handler), e, result = std::move(result)]() mutable {
+                        std::move(handler)(e, result ? std::move(*result) : result_type{});
+                    });
+                }
+            });
+        },
+        token,
+        std::forward<F>(f)
+    );
+}
+
+} // ns zclient
+
+#endif // COMPUTE_POOL_HPP
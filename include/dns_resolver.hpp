@@ -0,0 +1,70 @@
+#ifndef DNS_RESOLVER_HPP
+#define DNS_RESOLVER_HPP
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+namespace zclient {
+
+struct dns_resolver_options {
+    /* queried in order on every attempt. Empty falls back to 127.0.0.1:53 */
+    std::vector<boost::asio::ip::udp::endpoint> nameservers;
+
+    /* domains appended to names with fewer than ndots dots, which are tried
+     * with them first and as given last (the other way round otherwise) */
+    std::vector<std::string> search;
+    int ndots = 1;
+
+    /* per query and nameserver, with every nameserver tried attempts times */
+    std::chrono::milliseconds timeout{2000};
+    int attempts = 2;
+
+    /* ask for AAAA records alongside A. IPv4 addresses are listed first */
+    bool ipv6 = true;
+
+    /* consulted before any query, empty to skip */
+    std::string hosts_file = "/etc/hosts";
+
+    /* nameservers, search domains, ndots, timeout and attempts from
+     * resolv.conf, the rest defaulted */
+    static dns_resolver_options from_system(const std::string& resolv_conf = "/etc/resolv.conf");
+};
+
+/* DNS stub resolver that runs on the io_context of the awaiting coroutine,
+ * unlike tcp::resolver, which hands each lookup to a blocking getaddrinfo() on
+ * a hidden thread. A and AAAA queries go out together over UDP, falling back to
+ * TCP for truncated answers, and nothing blocks, so concurrent lookups do not
+ * queue behind each other and a lookup is cancelled like any other awaitable
+ * operation.
+ *
+ * A resolver holds only its configuration and may be shared by any number of
+ * clients and threads. Select it with set_dns_resolver() on the clients */
+class dns_resolver {
+public:
+    /* configured from the system's resolv.conf */
+    dns_resolver();
+    explicit dns_resolver(dns_resolver_options options);
+
+    /* same results as tcp::resolver::async_resolve. host may also be an IP
+     * literal; service is a port number or http/https/ws/wss. Throws
+     * boost::system::system_error with host_not_found when no address exists,
+     * timed_out when no nameserver answers */
+    boost::asio::awaitable<boost::asio::ip::tcp::resolver::results_type>
+    resolve(const std::string& host, const std::string& service);
+
+    const dns_resolver_options& options() const { return options_; }
+
+private:
+    dns_resolver_options options_;
+    std::unordered_multimap<std::string, boost::asio::ip::address> hosts_;
+};
+
+} // ns zclient
+
+#endif // DNS_RESOLVER_HPP
@@ -0,0 +1,124 @@
+#ifndef FEED_ARBITRATOR_HPP
+#define FEED_ARBITRATOR_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio/awaitable.hpp>
+
+#include "resilient_websocket_client.hpp"
+
+namespace zclient {
+
+/* one copy of the feed: an endpoint serving the same stream as the others */
+struct feed_line {
+    std::string host;   /* prefixed with ws:// or wss:// */
+    std::string port;
+    std::string target;
+};
+
+struct feed_arbitrator_options {
+    /* how long to hold messages back after a gap, waiting for the other lines
+     * to fill it, before skipping the missing sequence numbers. 0 = skip at once */
+    std::chrono::microseconds gap_timeout{2000};
+
+    /* out of order messages held while waiting on a gap, skipped past beyond this */
+    std::size_t max_pending = 65536;
+
+    /* sequence numbers remembered for matching duplicates to the first copy.
+     * Copies arriving further behind are still dropped, but not timed */
+    std::size_t history = 65536;
+
+    /* every line reconnects on its own. A warm standby per line is usually
+     * redundant here, as the other lines already cover for it */
+    resilient_websocket_options line_options = [] {
+        resilient_websocket_options options;
+        options.warm_standby = false;
+        return options;
+    }();
+};
+
+struct feed_line_stats {
+    /* sequenced messages received on this line */
+    std::uint64_t messages;
+
+    /* messages this line delivered first */
+    std::uint64_t first;
+
+    /* late copies of messages another line already delivered */
+    std::uint64_t duplicates;
+
+    /* how far behind the first copy this line's late copies arrived */
+    std::chrono::nanoseconds total_lag;
+    std::chrono::nanoseconds max_lag;
+
+    /* how far ahead of the later copies this line's first copies arrived */
+    std::chrono::nanoseconds total_lead;
+};
+
+struct feed_arbitrator_stats {
+    std::uint64_t delivered;
+
+    /* sequence numbers no line delivered before the gap timeout */
+    std::uint64_t missed;
+
+    /* messages the extractor returned no sequence number for, dropped */
+    std::uint64_t unsequenced;
+
+    std::vector<feed_line_stats> lines;
+};
+
+struct arbitrated_message {
+    std::string data;
+    std::uint64_t sequence;
+
+    /* index of the line whose copy arrived first */
+    std::size_t line;
+};
+
+/* Reads the same stream over several websocket connections and delivers every
+ * message once, in sequence order, from whichever line had it first. Late
+ * copies are dropped, a gap on one line is filled from the others, and each
+ * line's lead or lag behind the first copy is recorded.
+ *
+ * Use from a single thread, or a single strand */
+class feed_arbitrator {
+public:
+    /* the message's sequence number, nullopt for messages that have none
+     * (subscription acks, heartbeats...), which are dropped */
+    using sequence_extractor = std::function<std::optional<std::uint64_t>(std::string_view)>;
+
+    feed_arbitrator(sequence_extractor extractor, const feed_arbitrator_options& options = {});
+    ~feed_arbitrator();
+
+    feed_arbitrator(const feed_arbitrator& other) = delete;
+    feed_arbitrator& operator=(const feed_arbitrator& other) = delete;
+
+    /* run on every connection of every line when it connects, to subscribe */
+    void set_handshake(resilient_websocket_client::handshake_function handshake);
+
+    /* connects all lines. Returns true when at least one is up, the others keep
+     * retrying in the background */
+    boost::asio::awaitable<bool> connect(const std::vector<feed_line>& lines);
+
+    /* the next message in sequence. Throws websocket_server_disconnected_exception
+     * after disconnect() */
+    boost::asio::awaitable<arbitrated_message> read();
+
+    void disconnect();
+
+    feed_arbitrator_stats stats() const;
+
+private:
+    struct impl;
+    std::shared_ptr<impl> pimpl_;
+};
+
+} // ns zclient
+
+#endif // FEED_ARBITRATOR_HPP
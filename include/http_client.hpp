@@ -1,6 +1,7 @@
 #ifndef HTTPS_CLIENT_HPP
 #define HTTPS_CLIENT_HPP
 
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <string>
@@ -8,8 +9,14 @@
 #include <boost/asio/awaitable.hpp>
 #include <boost/asio/ssl/context.hpp>
 
+#include "dns_resolver.hpp"
+#include "socket_options.hpp"
+#include "transport.hpp"
+
 namespace zclient {
 
+class compute_pool;
+
 enum class http_method {
     get,
     post,
@@ -22,17 +29,98 @@ struct http_request {
     std::string path;
     std::vector<std::pair<std::string,std::string>> header_data;
     std::string body;
+
+    /* the request may be sent as TLS 1.3 early data (0-RTT), saving the
+     * handshake's round trip when an https:// fetch resumes a session that
+     * allows it. Early data can be replayed by an attacker, so only set this
+     * on requests that are safe to repeat. GETs only, ignored otherwise */
+    bool replay_safe = false;
 };
 
 struct http_response {
     unsigned return_code;
     std::string body;
     std::vector<std::pair<std::string,std::string>> header_data;
+
+    /* kernel receive time of the first response bytes when
+     * socket_options::rx_timestamps is set, epoch otherwise. Over TLS, of the
+     * first record of the response, not of a session ticket sent ahead of it */
+    std::chrono::system_clock::time_point rx_timestamp{};
 };
 
 #define HTTP_TIMEOUT_SECONDS 30
 #define HTTP_VERSION 11 /* version 1.1 */
 
+/* bound on a close_notify exchange left running after the response is returned */
+#define TLS_SHUTDOWN_TIMEOUT_SECONDS 5
+
+/* what a TLS fetch does with the connection once the response has been read */
+enum class tls_shutdown_policy {
+    /* return the response at once and exchange close_notify afterwards */
+    background,
+    /* exchange close_notify before returning the response, costing a round trip */
+    wait,
+    /* close the socket without close_notify. Fine for responses with a length,
+     * which cannot be truncated unnoticed */
+    skip
+};
+
+/* process wide default picked up by clients when they are constructed, and by async_fetch */
+inline tls_shutdown_policy& default_tls_shutdown_policy() {
+    static tls_shutdown_policy policy = tls_shutdown_policy::background;
+    return policy;
+}
+
+/* HTTP client with the scheme fixed by Transport (plain_transport for http://,
+ * tls_transport for https://, unix_transport for http+unix://), so fetch()
+ * neither parses a prefix nor branches on it */
+template <typename Transport>
+class basic_http_client {
+public:
+    basic_http_client();
+    ~basic_http_client();
+
+    basic_http_client(const basic_http_client& other) = delete;
+    basic_http_client& operator=(const basic_http_client& other) = delete;
+
+    basic_http_client(basic_http_client&& other);
+    basic_http_client& operator=(basic_http_client&& other);
+
+    boost::asio::awaitable<http_response>
+    fetch(
+        /* without the http:// / https:// prefix. For unix_transport the socket's
+         * path, and the port is ignored */
+        const std::string& host,
+        const std::string& port,
+        const http_request& request
+    );
+
+    /* applied to the sockets of subsequent fetches. Defaults to default_socket_options() */
+    void set_socket_options(const socket_options& options);
+
+    /* resolves the hosts of subsequent fetches, nullptr (the default) for the
+     * system's getaddrinfo(). Unused by unix_transport */
+    void set_dns_resolver(std::shared_ptr<dns_resolver> resolver);
+
+    /* applied to subsequent fetches. Defaults to default_tls_shutdown_policy().
+     * Only tls_transport has anything to shut down */
+    void set_tls_shutdown_policy(tls_shutdown_policy policy);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+extern template class basic_http_client<plain_transport>;
+extern template class basic_http_client<tls_transport>;
+extern template class basic_http_client<unix_transport>;
+
+using plain_http_client = basic_http_client<plain_transport>;
+using tls_http_client = basic_http_client<tls_transport>;
+using unix_http_client = basic_http_client<unix_transport>;
+
+/* picks plain_http_client, tls_http_client or unix_http_client on each fetch
+ * from the host's prefix */
 class http_client {
 public:
     http_client();
@@ -46,12 +134,23 @@ public:
 
     boost::asio::awaitable<http_response> 
     fetch(
-        /* prefix with http:// for unsecured or https:// for secured. No http prefix = unsecured */
+        /* prefix with http:// for unsecured or https:// for secured. No http prefix = unsecured.
+         * http+unix:///path/to.sock connects to a unix socket, ignoring the port */
         const std::string& host,
         const std::string& port,
         const http_request& request
     );
 
+    /* applied to the sockets of subsequent fetches. Defaults to default_socket_options() */
+    void set_socket_options(const socket_options& options);
+
+    /* resolves the hosts of subsequent fetches, nullptr (the default) for the
+     * system's getaddrinfo() */
+    void set_dns_resolver(std::shared_ptr<dns_resolver> resolver);
+
+    /* applied to subsequent https:// fetches. Defaults to default_tls_shutdown_policy() */
+    void set_tls_shutdown_policy(tls_shutdown_policy policy);
+
     /* callback-style fetch */
     void fetch_then(
         /* prefix with http:// for unsecured or https:// for secured. No http prefix = unsecured */
@@ -61,6 +160,16 @@ public:
         std::function<void(http_response&&)> callback
     );
 
+    /* callback-style fetch where the callback runs on a compute_pool worker
+     * rather than the io thread, for handlers too heavy to block other sockets */
+    void fetch_then(
+        const std::string& host,
+        const std::string& port,
+        const http_request& request,
+        compute_pool& pool,
+        std::function<void(http_response&&)> callback
+    );
+
 private:
     struct impl;
     std::unique_ptr<impl> pimpl_;
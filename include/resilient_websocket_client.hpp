@@ -0,0 +1,110 @@
+#ifndef RESILIENT_WEBSOCKET_CLIENT_HPP
+#define RESILIENT_WEBSOCKET_CLIENT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <boost/asio/awaitable.hpp>
+
+#include "socket_options.hpp"
+#include "websocket_client.hpp"
+
+namespace zclient {
+
+struct resilient_websocket_options {
+    /* keep a second connection open (DNS, TCP, TLS and upgrade done) to switch
+     * to when the active one fails */
+    bool warm_standby = true;
+
+    /* connect the standby to another of the host's resolved addresses when
+     * there is more than one, so a single bad server does not take out both */
+    bool standby_on_different_address = true;
+
+    /* the standby is not read from, so it does not answer the server's pings.
+     * It is replaced by a fresh connection this often, before servers give up on it */
+    std::chrono::milliseconds standby_max_age{60000};
+
+    /* backoff between failed connection attempts, doubling up to the max */
+    std::chrono::milliseconds reconnect_delay{50};
+    std::chrono::milliseconds max_reconnect_delay{5000};
+
+    /* applied to every connection */
+    socket_options socket = default_socket_options();
+    websocket_write_options write;
+    websocket_compression_options compression;
+    websocket_ping_options ping;
+
+    /* looks up the host's addresses, nullptr for the system's getaddrinfo() */
+    std::shared_ptr<dns_resolver> resolver;
+};
+
+struct resilient_websocket_stats {
+    /* switched over to the warm standby */
+    std::uint64_t failovers;
+
+    /* no usable standby, connected from scratch */
+    std::uint64_t cold_reconnects;
+
+    /* standby connections opened, including replacements of aged ones */
+    std::uint64_t standby_connects;
+
+    /* time from noticing the failure until the new connection has replayed the
+     * handshake and is handed back to the reader */
+    std::chrono::nanoseconds last_gap;
+    std::chrono::nanoseconds max_gap;
+    std::chrono::nanoseconds total_gap;
+};
+
+/* Websocket client that survives a dropped connection. A standby connection is
+ * kept open next to the active one; when a read or write fails, the standby
+ * takes over, the handshake function (subscriptions, authentication...) is
+ * replayed on it and the read or write is retried, so the caller only sees a
+ * gap in the feed. Without a usable standby it reconnects from scratch.
+ *
+ * Messages queued by write() but not yet sent when the connection failed are
+ * lost. Use from a single thread, or a single strand */
+class resilient_websocket_client {
+public:
+    using handshake_function = std::function<boost::asio::awaitable<void>(websocket_client&)>;
+
+    explicit resilient_websocket_client(const resilient_websocket_options& options = {});
+    ~resilient_websocket_client();
+
+    resilient_websocket_client(const resilient_websocket_client& other) = delete;
+    resilient_websocket_client& operator=(const resilient_websocket_client& other) = delete;
+
+    /* run on every connection when it becomes the active one, including the first */
+    void set_handshake(handshake_function handshake);
+
+    /* prefix with ws:// for unsecured or wss:// for secured. Returns true once the
+     * first connection is up and has run the handshake; the standby connects
+     * in the background */
+    boost::asio::awaitable<bool> connect(
+        const std::string& host,
+        const std::string& port,
+        const std::string& target
+    );
+
+    bool is_connected() const;
+
+    /* only throw websocket_server_disconnected_exception after disconnect() */
+    boost::asio::awaitable<std::string> read();
+    boost::asio::awaitable<ws_message> read_view();
+    boost::asio::awaitable<void> write(const std::string& message);
+    boost::asio::awaitable<void> write(std::string_view message, ws_message_type type);
+
+    void disconnect();
+
+    resilient_websocket_stats stats() const;
+
+private:
+    struct impl;
+    std::shared_ptr<impl> pimpl_;
+};
+
+} // ns zclient
+
+#endif // RESILIENT_WEBSOCKET_CLIENT_HPP
@@ -0,0 +1,296 @@
+#ifndef RX_TIMESTAMP_HPP
+#define RX_TIMESTAMP_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <optional>
+#include <utility>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/compose.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/beast/core/role.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+namespace zclient {
+
+/* Kernel receive timestamps, enabled with socket_options::rx_timestamps. They
+ * are CLOCK_REALTIME, so system_clock::now() - rx_timestamp is the time from
+ * the packet reaching the host to the application seeing it. A default
+ * constructed (epoch) time_point means no timestamp was available */
+using rx_time_point = std::chrono::system_clock::time_point;
+
+#ifdef __linux__
+
+/* the kernel timestamp in a recvmsg's control data, if any. A hardware stamp
+ * (in the NIC's clock, which must be synchronized to be comparable) is
+ * preferred over the software one when the device provides it */
+inline std::optional<rx_time_point> parse_rx_timestamp(const msghdr& msg) {
+    const auto to_time_point = [](const timespec& ts) {
+        return rx_time_point{std::chrono::duration_cast<rx_time_point::duration>(
+            std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec})};
+    };
+
+    for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            const auto* stamps = reinterpret_cast<const scm_timestamping*>(CMSG_DATA(cmsg));
+            if (stamps->ts[2].tv_sec || stamps->ts[2].tv_nsec) {
+                return to_time_point(stamps->ts[2]);
+            }
+            if (stamps->ts[0].tv_sec || stamps->ts[0].tv_nsec) {
+                return to_time_point(stamps->ts[0]);
+            }
+        } else if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            return to_time_point(*reinterpret_cast<const timespec*>(CMSG_DATA(cmsg)));
+        }
+    }
+
+    return std::nullopt;
+}
+
+/* room for either control message */
+constexpr std::size_t rx_control_size = CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(timespec));
+
+/* the timestamp of the first bytes waiting on the socket, without consuming
+ * them. Epoch if nothing is waiting or the socket has no timestamps */
+inline rx_time_point peek_rx_timestamp(int fd) {
+    char byte;
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char control[rx_control_size];
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (::recvmsg(fd, &msg, MSG_PEEK | MSG_DONTWAIT) <= 0) {
+        return rx_time_point{};
+    }
+
+    return parse_rx_timestamp(msg).value_or(rx_time_point{});
+}
+
+#else
+
+inline rx_time_point peek_rx_timestamp(int) {
+    return rx_time_point{};
+}
+
+#endif
+
+/* Stream layer directly above a beast::tcp_stream that, once enabled, reads with
+ * recvmsg() so it can keep the kernel receive timestamp of the latest read.
+ * Placed below TLS, so it sees the timestamps of the encrypted records.
+ * Disabled, or off Linux, it forwards to the next layer untouched (keeping
+ * its timeouts, which the recvmsg path does not apply).
+ *
+ * All operations must be initiated from the stream's executor */
+template <typename NextLayer>
+class rx_timestamp_stream {
+public:
+    using next_layer_type = NextLayer;
+    using executor_type = typename NextLayer::executor_type;
+    /* for asio's ssl::stream, which reaches the socket through it */
+    using lowest_layer_type = typename NextLayer::socket_type;
+
+    template <typename... Args>
+    explicit rx_timestamp_stream(Args&&... args)
+        :next_layer_{std::forward<Args>(args)...}
+    {}
+
+    executor_type get_executor() noexcept { return next_layer_.get_executor(); }
+
+    next_layer_type& next_layer() noexcept { return next_layer_; }
+    const next_layer_type& next_layer() const noexcept { return next_layer_; }
+
+    lowest_layer_type& lowest_layer() noexcept { return next_layer_.socket(); }
+    const lowest_layer_type& lowest_layer() const noexcept { return next_layer_.socket(); }
+
+    /* the socket must have timestamping turned on (see apply_socket_options) */
+    void enable() noexcept {
+#ifdef __linux__
+        enabled_ = true;
+#endif
+    }
+
+    /* back to the next layer's reads, and its timeouts */
+    void disable() noexcept {
+        enabled_ = false;
+    }
+
+    bool enabled() const noexcept { return enabled_; }
+
+    /* of the most recent read that returned data */
+    rx_time_point last_rx_timestamp() const noexcept { return last_rx_; }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+        return boost::asio::async_compose<ReadHandler, void(boost::system::error_code, std::size_t)>(
+            read_op<MutableBufferSequence>{*this, buffers}, handler, next_layer_);
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+        return next_layer_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+    }
+
+    /* synchronous operations are only used to close */
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers) {
+        return next_layer_.read_some(buffers);
+    }
+
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& ec) {
+        return next_layer_.read_some(buffers, ec);
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers) {
+        return next_layer_.write_some(buffers);
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers, boost::system::error_code& ec) {
+        return next_layer_.write_some(buffers, ec);
+    }
+
+private:
+    template <typename MutableBufferSequence>
+    struct read_op : boost::asio::coroutine {
+        read_op(rx_timestamp_stream& s_, const MutableBufferSequence& buffers_)
+            :s{s_}
+            ,buffers{buffers_}
+        {}
+
+        rx_timestamp_stream& s;
+        MutableBufferSequence buffers;
+        boost::system::error_code result_ec;
+        std::size_t result_n = 0;
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, std::size_t n = 0) {
+            BOOST_ASIO_CORO_REENTER(*this) {
+                if (!s.enabled_) {
+                    BOOST_ASIO_CORO_YIELD s.next_layer_.async_read_some(buffers, std::move(self));
+                    return self.complete(ec, n);
+                }
+
+                /* data already waiting is read straight away, but never
+                 * completed from inside the initiating function */
+                if (s.try_receive(buffers, result_ec, result_n)) {
+                    BOOST_ASIO_CORO_YIELD boost::asio::post(s.get_executor(), std::move(self));
+                    return self.complete(result_ec, result_n);
+                }
+
+                while (true) {
+                    BOOST_ASIO_CORO_YIELD s.next_layer_.socket().async_wait(
+                        boost::asio::socket_base::wait_read, std::move(self));
+                    if (ec) {
+                        return self.complete(ec, 0);
+                    }
+
+                    if (s.try_receive(buffers, result_ec, result_n)) {
+                        return self.complete(result_ec, result_n);
+                    }
+                }
+            }
+        }
+    };
+
+    /* false if nothing could be read yet */
+    template <typename MutableBufferSequence>
+    bool try_receive(const MutableBufferSequence& buffers, boost::system::error_code& ec, std::size_t& n) {
+#ifdef __linux__
+        constexpr std::size_t max_iov = 16;
+        iovec iov[max_iov];
+        std::size_t count = 0;
+
+        for (auto it = boost::asio::buffer_sequence_begin(buffers);
+             it != boost::asio::buffer_sequence_end(buffers) && count < max_iov; ++it) {
+            const boost::asio::mutable_buffer buffer{*it};
+            if (buffer.size()) {
+                iov[count++] = iovec{buffer.data(), buffer.size()};
+            }
+        }
+
+        if (count == 0) {
+            ec = {};
+            n = 0;
+            return true;
+        }
+
+        alignas(cmsghdr) char control[rx_control_size];
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        const auto fd = next_layer_.socket().native_handle();
+        const auto received = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return false;
+            }
+            ec.assign(errno, boost::system::system_category());
+            n = 0;
+            return true;
+        }
+
+        if (received == 0) {
+            ec = boost::asio::error::eof;
+            n = 0;
+            return true;
+        }
+
+        if (auto stamp = parse_rx_timestamp(msg)) {
+            last_rx_ = *stamp;
+        }
+
+        ec = {};
+        n = static_cast<std::size_t>(received);
+        return true;
+#else
+        (void)buffers;
+        (void)ec;
+        (void)n;
+        return false;
+#endif
+    }
+
+    NextLayer next_layer_;
+    bool enabled_ = false;
+    rx_time_point last_rx_{};
+};
+
+template <typename NextLayer>
+void teardown(boost::beast::role_type role, rx_timestamp_stream<NextLayer>& stream, boost::system::error_code& ec) {
+    using boost::beast::websocket::teardown;
+    teardown(role, stream.next_layer(), ec);
+}
+
+template <typename NextLayer, typename TeardownHandler>
+void async_teardown(boost::beast::role_type role, rx_timestamp_stream<NextLayer>& stream, TeardownHandler&& handler) {
+    using boost::beast::websocket::async_teardown;
+    async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+}
+
+} // ns zclient
+
+#endif // RX_TIMESTAMP_HPP
@@ -0,0 +1,79 @@
+#ifndef SEGMENTED_DOWNLOAD_HPP
+#define SEGMENTED_DOWNLOAD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <boost/asio/awaitable.hpp>
+
+#include "dns_resolver.hpp"
+#include "socket_options.hpp"
+
+namespace zclient {
+
+struct download_options {
+    /* concurrent Range requests, each on its own connection */
+    std::size_t segments = 4;
+
+    /* files are not split into segments smaller than this */
+    std::size_t min_segment_size = 1024 * 1024;
+
+    /* reconnects to continue a failed segment from where it stopped, with a
+     * short backoff, before giving up on the download */
+    int retries = 3;
+
+    /* continue the segments recorded in the control file of an interrupted
+     * download to the same path, if the size and validator still match */
+    bool resume = true;
+
+    socket_options socket = default_socket_options();
+
+    /* nullptr for the system's getaddrinfo() */
+    std::shared_ptr<dns_resolver> resolver;
+};
+
+struct download_result {
+    std::uint64_t size;
+
+    /* the ETag (Last-Modified without one) every segment was checked against,
+     * empty if the server sent neither */
+    std::string validator;
+
+    std::size_t segments;
+
+    /* body bytes received by this call, less than size when resumed */
+    std::uint64_t bytes_transferred;
+    bool resumed;
+};
+
+/* the file changed on the server during the download, or the server answered a
+ * Range request with something other than the requested range. Not retried */
+class download_mismatch_exception : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/* Downloads target into the file at path over several connections at once,
+ * each fetching one byte range and writing it straight to its offset in the
+ * preallocated file, so the body is never held in memory. Progress is kept in
+ * path + ".zdl" until the download completes, letting a later call with
+ * resume set continue an interrupted one. Servers without Range support get a
+ * single streamed GET.
+ *
+ * host takes the same http:// / https:// prefixes as http_client::fetch (not
+ * http+unix://). Throws download_mismatch_exception as above, and the
+ * connection's errors once a segment has used up its retries. Segments still
+ * running finish first, so their progress is kept for the next attempt */
+boost::asio::awaitable<download_result> download_to_file(
+    const std::string& host,
+    const std::string& port,
+    const std::string& target,
+    const std::string& path,
+    const download_options& options = {}
+);
+
+} // ns zclient
+
+#endif // SEGMENTED_DOWNLOAD_HPP
@@ -0,0 +1,157 @@
+#ifndef SOCKET_OPTIONS_HPP
+#define SOCKET_OPTIONS_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/system/error_code.hpp>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#endif
+
+#include "zlogger.hpp"
+
+namespace zclient {
+
+/* Socket level tuning, applied by the clients to every socket right after it
+ * connects. 0 leaves a setting at the system default */
+struct socket_options {
+    /* TCP_NODELAY: send small writes at once instead of holding them back
+     * (Nagle) until the previous segment is acknowledged */
+    bool no_delay = true;
+
+    /* TCP_QUICKACK: acknowledge at once instead of delaying ACKs up to 40ms.
+     * The kernel drops back to delayed ACKs on its own, so websocket clients
+     * re-arm it after every read. Linux only */
+    bool quick_ack = false;
+
+    /* SO_RCVBUF / SO_SNDBUF in bytes (the kernel doubles them for its own
+     * bookkeeping). Setting them turns off the kernel's auto-tuning. Set after
+     * the handshake, the receive buffer still grows the window fully on Linux:
+     * the window scale was sized for the tcp_rmem maximum */
+    int receive_buffer_size = 0;
+    int send_buffer_size = 0;
+
+    /* SO_KEEPALIVE with TCP_KEEPIDLE / TCP_KEEPINTVL / TCP_KEEPCNT: probe an
+     * idle connection after keepalive_idle_sec, every keepalive_interval_sec,
+     * and drop it after keepalive_count unanswered probes. Keepalive is on when
+     * keepalive_idle_sec is set; the interval and count are Linux only */
+    int keepalive_idle_sec = 0;
+    int keepalive_interval_sec = 0;
+    int keepalive_count = 0;
+
+    /* TCP_USER_TIMEOUT: drop the connection when sent data stays
+     * unacknowledged this long, rather than after minutes of retransmits.
+     * Linux only */
+    int user_timeout_msec = 0;
+
+    /* SO_BUSY_POLL: microseconds the kernel may busy poll the device queue
+     * for this socket instead of waiting for an interrupt. 0 = off. Linux only,
+     * values above the net.core.busy_read sysctl may need CAP_NET_ADMIN */
+    int busy_poll_usec = 0;
+
+    /* SO_TIMESTAMPING (SO_TIMESTAMPNS where that is refused): the kernel stamps
+     * every received packet, and the stamps are reported as rx_timestamp on
+     * websocket messages and on HTTP responses (their first bytes). Software
+     * stamps are taken as the packet enters the network stack; the NIC's are
+     * used instead on devices with hardware timestamping turned on. Linux only */
+    bool rx_timestamps = false;
+};
+
+/* process wide defaults picked up by clients when they are constructed */
+inline socket_options& default_socket_options() {
+    static socket_options options;
+    return options;
+}
+
+namespace detail {
+
+#ifdef __linux__
+template <typename Socket>
+void set_tcp_option(Socket& socket, int name, int value, const char* label) {
+    if (::setsockopt(socket.native_handle(), IPPROTO_TCP, name, &value, sizeof(value)) != 0) {
+        LOG_WARN << "Could not set " << label << ": " << boost::system::error_code(errno, boost::system::system_category()).message();
+    }
+}
+#endif
+
+template <typename Socket, typename Option>
+void set_socket_option(Socket& socket, const Option& option, const char* label) {
+    boost::system::error_code ec;
+    socket.set_option(option, ec);
+    if (ec) {
+        LOG_WARN << "Could not set " << label << ": " << ec.message();
+    }
+}
+
+} // ns detail
+
+template <typename Socket>
+void apply_socket_options(Socket& socket, const socket_options& options) {
+    if (options.no_delay) {
+        detail::set_socket_option(socket, boost::asio::ip::tcp::no_delay{true}, "TCP_NODELAY");
+    }
+    if (options.receive_buffer_size > 0) {
+        detail::set_socket_option(socket, boost::asio::socket_base::receive_buffer_size{options.receive_buffer_size}, "SO_RCVBUF");
+    }
+    if (options.send_buffer_size > 0) {
+        detail::set_socket_option(socket, boost::asio::socket_base::send_buffer_size{options.send_buffer_size}, "SO_SNDBUF");
+    }
+    if (options.keepalive_idle_sec > 0) {
+        detail::set_socket_option(socket, boost::asio::socket_base::keep_alive{true}, "SO_KEEPALIVE");
+    }
+
+#ifdef __linux__
+    if (options.quick_ack) {
+        detail::set_tcp_option(socket, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    }
+    if (options.keepalive_idle_sec > 0) {
+        detail::set_tcp_option(socket, TCP_KEEPIDLE, options.keepalive_idle_sec, "TCP_KEEPIDLE");
+        if (options.keepalive_interval_sec > 0) {
+            detail::set_tcp_option(socket, TCP_KEEPINTVL, options.keepalive_interval_sec, "TCP_KEEPINTVL");
+        }
+        if (options.keepalive_count > 0) {
+            detail::set_tcp_option(socket, TCP_KEEPCNT, options.keepalive_count, "TCP_KEEPCNT");
+        }
+    }
+    if (options.user_timeout_msec > 0) {
+        detail::set_tcp_option(socket, TCP_USER_TIMEOUT, options.user_timeout_msec, "TCP_USER_TIMEOUT");
+    }
+
+    if (options.busy_poll_usec > 0) {
+        int value = options.busy_poll_usec;
+        if (::setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) != 0) {
+            LOG_WARN << "Could not set SO_BUSY_POLL: " << boost::system::error_code(errno, boost::system::system_category()).message();
+        }
+    }
+
+    if (options.rx_timestamps) {
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+            | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (::setsockopt(socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0) {
+            int on = 1;
+            if (::setsockopt(socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0) {
+                LOG_WARN << "Could not enable receive timestamps: " << boost::system::error_code(errno, boost::system::system_category()).message();
+            }
+        }
+    }
+#endif
+}
+
+/* TCP_QUICKACK does not stick, call after each read to keep it on */
+template <typename Socket>
+void rearm_quick_ack(Socket& socket) {
+#ifdef __linux__
+    int on = 1;
+    ::setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+#else
+    (void)socket;
+#endif
+}
+
+} // ns zclient
+
+#endif // SOCKET_OPTIONS_HPP
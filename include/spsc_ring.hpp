@@ -0,0 +1,115 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace zclient {
+
+/* Lock-free single producer, single consumer ring of preallocated slots. The
+ * producer fills a slot in place and publishes it, the consumer reads it in
+ * place and pops it, so nothing is allocated or copied by the ring itself and
+ * neither side ever makes a syscall. Each index lives on its own cache line,
+ * and each side caches the other's index so it only touches the shared line
+ * when the ring looks full (or empty).
+ *
+ *     producer:  if (auto* slot = ring.claim()) { fill(*slot); ring.publish(); }
+ *     consumer:  if (auto* slot = ring.front()) { use(*slot); ring.pop(); } */
+template <typename T>
+class spsc_ring {
+public:
+    /* capacity is rounded up to a power of two */
+    explicit spsc_ring(std::size_t capacity)
+        :slots_(round_up(capacity)),
+        mask_{slots_.size() - 1}
+    {}
+
+    /* prepare runs once on every slot, e.g. to reserve its storage */
+    template <typename Prepare>
+    spsc_ring(std::size_t capacity, Prepare prepare)
+        :spsc_ring(capacity)
+    {
+        for (auto& slot : slots_) {
+            prepare(slot);
+        }
+    }
+
+    spsc_ring(const spsc_ring& other) = delete;
+    spsc_ring& operator=(const spsc_ring& other) = delete;
+
+    /* producer: the next free slot, nullptr while the ring is full */
+    T* claim() noexcept {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size()) {
+                return nullptr;
+            }
+        }
+        return &slots_[tail & mask_];
+    }
+
+    /* producer: hands the claimed slot to the consumer */
+    void publish() noexcept {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* consumer: the oldest published slot, nullptr while the ring is empty */
+    T* front() noexcept {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    /* consumer: returns the front slot to the producer */
+    void pop() noexcept {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* exact only from the consumer (empty) or the producer (full) */
+    bool empty() const noexcept {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    std::size_t size() const noexcept {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const noexcept {
+        return slots_.size();
+    }
+
+private:
+    static std::size_t round_up(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    static constexpr std::size_t cache_line = 64;
+
+    std::vector<T> slots_;
+    const std::size_t mask_;
+
+    /* consumer side */
+    alignas(cache_line) std::atomic<std::size_t> head_{0};
+    std::size_t cached_tail_ = 0;
+
+    /* producer side */
+    alignas(cache_line) std::atomic<std::size_t> tail_{0};
+    std::size_t cached_head_ = 0;
+
+    char padding_[cache_line - sizeof(std::atomic<std::size_t>) - sizeof(std::size_t)];
+};
+
+} // ns zclient
+
+#endif // SPSC_RING_HPP
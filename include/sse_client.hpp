@@ -0,0 +1,146 @@
+#ifndef SSE_CLIENT_HPP
+#define SSE_CLIENT_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <boost/asio/awaitable.hpp>
+
+#include "dns_resolver.hpp"
+#include "socket_options.hpp"
+
+namespace zclient {
+
+/* thrown by sse_client::read() after disconnect(), or when the server ends the
+ * stream for good (204, or an error status other than 5xx) */
+class sse_stream_closed_exception : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct sse_event {
+    /* "message" unless the server named it */
+    std::string type;
+
+    /* the event's data lines, joined by '\n' */
+    std::string data;
+
+    /* the last id the stream set, on this event or an earlier one. Sent back
+     * as Last-Event-ID when reconnecting */
+    std::string id;
+};
+
+/* Incremental text/event-stream parser: feed() the body as it arrives, in
+ * pieces of any size, and take the events completed so far with next() */
+class sse_parser {
+public:
+    /* an event or line over max_event_size throws std::length_error */
+    explicit sse_parser(std::size_t max_event_size = 16 * 1024 * 1024);
+
+    void feed(std::string_view data);
+    std::optional<sse_event> next();
+
+    /* drops the event in progress, as a dropped connection does, keeping the
+     * last id and the stream's retry delay */
+    void reset();
+
+    const std::string& last_event_id() const { return last_event_id_; }
+    void set_last_event_id(std::string id) { last_event_id_ = id_buffer_ = std::move(id); }
+
+    /* the stream's "retry:" field, if it sent one */
+    std::optional<std::chrono::milliseconds> retry() const { return retry_; }
+
+private:
+    void parse_line(std::string_view line);
+    void dispatch();
+
+    std::size_t max_event_size_;
+
+    std::string line_;
+    bool skip_lf_ = false;
+    bool at_start_ = true;
+
+    std::string type_;
+    std::string data_;
+    std::string id_buffer_;
+    std::string last_event_id_;
+    std::optional<std::chrono::milliseconds> retry_;
+
+    std::vector<sse_event> ready_;
+    std::size_t ready_pos_ = 0;
+};
+
+struct sse_options {
+    /* wait before reconnecting after the stream ends or fails, doubling on each
+     * failed attempt up to the max. A "retry:" from the server replaces the base */
+    std::chrono::milliseconds reconnect_delay{1000};
+    std::chrono::milliseconds max_reconnect_delay{30000};
+
+    /* reconnect when nothing, not even a comment, arrives for this long. 0 waits forever */
+    std::chrono::milliseconds idle_timeout{0};
+
+    /* sent as Last-Event-ID on the first connection, to resume an earlier stream */
+    std::string last_event_id;
+
+    /* added to every request, next to Accept: text/event-stream */
+    std::vector<std::pair<std::string, std::string>> header_data;
+
+    std::size_t max_event_size = 16 * 1024 * 1024;
+
+    socket_options socket = default_socket_options();
+
+    /* nullptr for the system's getaddrinfo() */
+    std::shared_ptr<dns_resolver> resolver;
+};
+
+/* Reads a Server-Sent Events stream (or any long-lived, e.g. chunked, response
+ * with read_data()) as it arrives over one connection, instead of waiting for a
+ * response that never ends. When the connection drops or the server ends the
+ * response, it reconnects after the retry delay with Last-Event-ID, so the
+ * server can carry on from the last event read.
+ *
+ * Use either read() or read_data() on a client, from a single thread or strand */
+class sse_client {
+public:
+    explicit sse_client(const sse_options& options = {});
+    ~sse_client();
+
+    sse_client(const sse_client& other) = delete;
+    sse_client& operator=(const sse_client& other) = delete;
+
+    /* prefix with http://, https:// or http+unix:// (ignoring the port). Returns
+     * true once the server has answered with 200; false if this first attempt
+     * failed, in which case read() keeps trying */
+    boost::asio::awaitable<bool> connect(
+        const std::string& host,
+        const std::string& port,
+        const std::string& target
+    );
+
+    bool is_connected() const;
+
+    /* the next event, reconnecting as needed */
+    boost::asio::awaitable<sse_event> read();
+
+    /* the next piece of the body as it arrives, chunked encoding removed */
+    boost::asio::awaitable<std::string> read_data();
+
+    const std::string& last_event_id() const;
+
+    /* closes the connection; pending and later reads throw sse_stream_closed_exception */
+    void disconnect();
+
+private:
+    struct impl;
+    std::shared_ptr<impl> pimpl_;
+};
+
+} // ns zclient
+
+#endif // SSE_CLIENT_HPP
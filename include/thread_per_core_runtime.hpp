@@ -0,0 +1,70 @@
+#ifndef THREAD_PER_CORE_RUNTIME_HPP
+#define THREAD_PER_CORE_RUNTIME_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include "busy_poll.hpp"
+
+namespace zclient {
+
+/* pin the calling thread to a cpu. Linux only, logs and carries on elsewhere */
+void pin_current_thread(int cpu);
+
+struct runtime_options {
+    /* number of shards, each one an io_context with its own thread. 0 = one per hardware thread */
+    unsigned threads = 0;
+
+    /* pin shard i's thread to cpus[i] (or to cpu i if cpus is empty). Linux only */
+    bool pin_threads = false;
+    std::vector<int> cpus;
+
+    /* run every shard with run_busy_poll() instead of run() */
+    std::optional<busy_poll_options> busy_poll;
+};
+
+/* Thread-per-core alternative to the global io_context. Every shard owns an
+ * io_context that is only ever run by its own thread, so completions never
+ * contend on a shared scheduler queue. Clients pick up the executor of the
+ * coroutine they are used from, so a connection opened inside work spawned on
+ * a shard stays on that shard for its whole lifetime. */
+class thread_per_core_runtime {
+public:
+    explicit thread_per_core_runtime(runtime_options options = {});
+    ~thread_per_core_runtime();
+
+    thread_per_core_runtime(const thread_per_core_runtime& other) = delete;
+    thread_per_core_runtime& operator=(const thread_per_core_runtime& other) = delete;
+
+    /* spawn one thread per shard. Shards keep running (even when idle) until stop() */
+    void start();
+
+    /* stop all shards and join their threads */
+    void stop();
+
+    std::size_t size() const;
+    boost::asio::io_context& shard(std::size_t index);
+
+    /* number of coroutines spawned on the shard that have not completed yet */
+    std::size_t load(std::size_t index) const;
+    std::size_t least_loaded_shard() const;
+
+    /* execute an asynchronous function on a specific shard */
+    void spawn_on(std::size_t index, std::function<boost::asio::awaitable<void>()> async_fcn);
+
+    /* execute an asynchronous function on the least loaded shard, returns the shard index used */
+    std::size_t spawn(std::function<boost::asio::awaitable<void>()> async_fcn);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+} // ns zclient
+
+#endif // THREAD_PER_CORE_RUNTIME_HPP
@@ -0,0 +1,92 @@
+#ifndef TLS_SESSION_HPP
+#define TLS_SESSION_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/stream_traits.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/write.hpp>
+#include <openssl/ssl.h>
+
+namespace zclient::detail {
+
+/* TLS sessions the servers handed out on connections made with one context,
+ * by host:port, so the next connection to the same server resumes instead of
+ * running a full handshake. A TLS 1.3 ticket is taken when it is offered:
+ * servers may refuse one seen before, and send fresh ones on every
+ * connection. TLS 1.2 sessions stay until the server replaces them. Thread
+ * safe */
+class tls_session_cache {
+public:
+    explicit tls_session_cache(boost::asio::ssl::context& ctx, std::size_t capacity = 256);
+    ~tls_session_cache();
+
+    tls_session_cache(const tls_session_cache& other) = delete;
+    tls_session_cache& operator=(const tls_session_cache& other) = delete;
+
+    /* files the sessions ssl receives under key and offers the last one filed
+     * there. Returns how much early data it allows, 0 without a session */
+    std::size_t resume(SSL* ssl, const std::string& key);
+
+private:
+    struct session_deleter {
+        void operator()(SSL_SESSION* session) const { SSL_SESSION_free(session); }
+    };
+
+    static int on_new_session(SSL* ssl, SSL_SESSION* session);
+
+    SSL_CTX* ctx_;
+    std::size_t capacity_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<SSL_SESSION, session_deleter>> sessions_;
+};
+
+/* the ClientHello and data as TLS 1.3 early data, ready to go out before the
+ * handshake; nullopt if OpenSSL declined, with nothing written */
+std::optional<std::string> early_data_flight(SSL* ssl, std::string_view data);
+
+/* Sends req as early data (0-RTT) in the first flight of a handshake resuming
+ * a session that allows max_early_data bytes, and returns whether it did.
+ * asio's engine only writes out what its own operations produce, so the
+ * flight is written to the socket here. The server may still reject it:
+ * after the handshake, unless SSL_get_early_data_status() says accepted, the
+ * request has to be written again */
+template <typename Stream, typename Body, typename Fields>
+boost::asio::awaitable<bool> write_early_data(
+    Stream& stream,
+    const boost::beast::http::request<Body, Fields>& req,
+    std::size_t max_early_data
+)
+{
+    std::ostringstream serialized;
+    serialized << req;
+    const auto data = serialized.str();
+
+    if (data.size() > max_early_data) {
+        co_return false;
+    }
+
+    auto flight = early_data_flight(stream.native_handle(), data);
+    if (!flight) {
+        co_return false;
+    }
+
+    co_await boost::asio::async_write(boost::beast::get_lowest_layer(stream), boost::asio::buffer(*flight), boost::asio::use_awaitable);
+    co_return true;
+}
+
+} // ns zclient::detail
+
+#endif // TLS_SESSION_HPP
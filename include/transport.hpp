@@ -0,0 +1,23 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+namespace zclient {
+
+/* Transports for basic_http_client / basic_websocket_client. The scheme is
+ * fixed at compile time, so the client holds exactly one stream type and never
+ * branches on it */
+
+/* http:// and ws:// */
+struct plain_transport {};
+
+/* https:// and wss:// */
+struct tls_transport {};
+
+/* http+unix:// and ws+unix://, plain HTTP and websockets over an AF_UNIX
+ * stream socket for sidecars on the same host. The host is the socket's path
+ * and the port is ignored. POSIX only */
+struct unix_transport {};
+
+} // ns zclient
+
+#endif // TRANSPORT_HPP
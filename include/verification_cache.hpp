@@ -0,0 +1,65 @@
+#ifndef VERIFICATION_CACHE_HPP
+#define VERIFICATION_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <boost/asio/ssl/context.hpp>
+#include <openssl/x509.h>
+
+namespace zclient::detail {
+
+/* Server certificates that passed verification on connections made with one
+ * context, by the SHA-256 of the leaf and the SNI hostname, so a handshake
+ * presenting the same leaf for the same host skips building and checking the
+ * chain again. Connections without a hostname are always verified in full.
+ * An entry lasts until the first certificate of its verified chain expires,
+ * and at most max_age. Revocation is out of scope: the verification the cache
+ * stands in for does not check it either. Failed verifications are never
+ * kept, and drop the entry of their key. Thread safe */
+class verification_cache {
+public:
+    static constexpr std::size_t default_capacity = 1024;
+    static constexpr std::chrono::seconds default_max_age{600};
+
+    /* takes over ctx's certificate verification, set up beforehand with
+     * certify's enable_native_https_server_verification(), which still runs
+     * for certificates not in the cache. ctx owns the cache */
+    static verification_cache& enable(
+        boost::asio::ssl::context& ctx,
+        std::size_t capacity = default_capacity,
+        std::chrono::seconds max_age = default_max_age
+    );
+
+    verification_cache(const verification_cache& other) = delete;
+    verification_cache& operator=(const verification_cache& other) = delete;
+
+    /* handshakes that were let through on a cached result */
+    std::size_t hits() const { return hits_; }
+    std::size_t size() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    verification_cache(std::size_t capacity, std::chrono::seconds max_age);
+
+    static int verify(X509_STORE_CTX* store_ctx, void* arg);
+
+    bool lookup(const std::string& key);
+    void store(const std::string& key, clock::time_point expiry);
+    void erase(const std::string& key);
+
+    std::size_t capacity_;
+    std::chrono::seconds max_age_;
+    std::atomic<std::size_t> hits_{0};
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, clock::time_point> verified_;
+};
+
+} // ns zclient::detail
+
+#endif // VERIFICATION_CACHE_HPP
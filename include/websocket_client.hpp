@@ -1,12 +1,20 @@
 #ifndef WEBSOCKET_CLIENT_HPP
 #define WEBSOCKET_CLIENT_HPP
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <functional>
 #include <memory>
 #include <boost/asio/awaitable.hpp>
 #include <stdexcept>
 
+#include "dns_resolver.hpp"
+#include "socket_options.hpp"
+#include "transport.hpp"
+
 namespace zclient {
 
 class websocket_server_disconnected_exception : public std::exception {
@@ -21,6 +29,216 @@ private:
 };
 
 
+enum class ws_message_type {
+    text,
+    binary
+};
+
+/* a message returned by read_view() or read_into(). data points into the buffer
+ * the message was read into and is only valid until that buffer is read into again */
+struct ws_message {
+    std::string_view data;
+    ws_message_type type;
+
+    /* kernel receive time of the packet that completed the message, with
+     * socket_options::rx_timestamps set. Epoch otherwise */
+    std::chrono::system_clock::time_point rx_timestamp{};
+};
+
+/* part of a message returned by read_some(). message_done is set on the last part */
+struct ws_frame {
+    std::string_view data;
+    ws_message_type type;
+    bool message_done;
+};
+
+
+struct websocket_write_options {
+    /* write() suspends while more than this many bytes are queued and not yet sent */
+    std::size_t high_water_mark = 4 * 1024 * 1024;
+
+    /* queued messages up to this size are coalesced into one socket write,
+     * larger ones are written on their own. 0 disables coalescing */
+    std::size_t coalesce_limit = 16 * 1024;
+};
+
+
+/* permessage-deflate (RFC 7692), offered in the upgrade request when enabled.
+ * The server may decline, in which case messages go uncompressed */
+struct websocket_compression_options {
+    bool enabled = false;
+
+    /* LZ77 window sizes to negotiate, 9..15. Smaller windows hold less memory
+     * per connection at the cost of ratio */
+    int client_max_window_bits = 15;
+    int server_max_window_bits = 15;
+
+    /* reset the compressor after every message: worse ratio for repetitive feeds,
+     * but no window is held between messages */
+    bool client_no_context_takeover = false;
+    bool server_no_context_takeover = false;
+
+    /* zlib settings for outgoing messages: level 0..9, memory level 1..9 */
+    int compression_level = 8;
+    int memory_level = 4;
+
+    /* outgoing messages smaller than this are sent uncompressed. Ignored on
+     * Boost versions without permessage_deflate::msg_size_threshold */
+    std::size_t min_message_size = 0;
+};
+
+/* active latency measurement: a ping every interval, timed by its pong. Pongs
+ * are handled while a read is pending, so a connection that is not being read
+ * shows no round trips */
+struct websocket_ping_options {
+    /* 0 disables, leaving only the stream's own keep-alive pings on idle connections */
+    std::chrono::milliseconds interval{0};
+
+    /* the most recent round trips kept for rtt_p99 */
+    std::size_t window = 256;
+};
+
+/* counters for the current connection */
+struct websocket_stats {
+    std::uint64_t messages_read;
+    std::uint64_t messages_written;
+
+    /* message bytes as seen by read() and write() */
+    std::uint64_t payload_bytes_read;
+    std::uint64_t payload_bytes_written;
+
+    /* bytes below the websocket layer (frames and the upgrade handshake), after
+     * compression and before TLS */
+    std::uint64_t wire_bytes_read;
+    std::uint64_t wire_bytes_written;
+
+    /* payload / wire, above 1 when compression is saving bandwidth */
+    double read_compression_ratio() const {
+        return wire_bytes_read ? static_cast<double>(payload_bytes_read) / wire_bytes_read : 0.0;
+    }
+
+    double write_compression_ratio() const {
+        return wire_bytes_written ? static_cast<double>(payload_bytes_written) / wire_bytes_written : 0.0;
+    }
+
+    /* round trips of the pings sent per websocket_ping_options, zero until the
+     * first pong. rtt_min and rtt_avg cover the whole connection, rtt_p99 the window */
+    std::uint64_t pings_sent;
+    std::uint64_t pongs_received;
+    std::chrono::nanoseconds rtt_last;
+    std::chrono::nanoseconds rtt_min;
+    std::chrono::nanoseconds rtt_avg;
+    std::chrono::nanoseconds rtt_p99;
+
+    /* since the last complete message was read, or since connecting before the
+     * first. A feed that is normally busy going quiet is the earliest sign of trouble */
+    std::chrono::nanoseconds last_message_age;
+};
+
+
+/* Websocket client with the scheme fixed by Transport (plain_transport for ws://,
+ * tls_transport for wss://, unix_transport for ws+unix://), so every operation
+ * goes straight to the one stream type without a runtime branch */
+template <typename Transport>
+class basic_websocket_client {
+public:
+    basic_websocket_client();
+    ~basic_websocket_client();
+
+    basic_websocket_client(const basic_websocket_client& other) = delete;
+    basic_websocket_client& operator=(const basic_websocket_client& other) = delete;
+
+    basic_websocket_client(basic_websocket_client&& other);
+    basic_websocket_client& operator=(basic_websocket_client&& other);
+
+    /* host without the ws:// / wss:// prefix, for unix_transport the socket's path
+     * (the port is ignored). Returns true on successful connection */
+    boost::asio::awaitable<bool> connect(
+        const std::string& host,
+        const std::string& port,
+        const std::string& target
+    );
+
+    /* connects to address (e.g. one of several IPs behind host) instead of
+     * resolving host, which is still used for SNI and the Host header */
+    boost::asio::awaitable<bool> connect(
+        const std::string& host,
+        const std::string& port,
+        const std::string& target,
+        const std::string& address
+    );
+
+    bool is_connected() const;
+
+    /* applied to the socket on subsequent connects. Defaults to default_socket_options() */
+    void set_socket_options(const socket_options& options);
+
+    /* resolves the host on subsequent connects, nullptr (the default) for the
+     * system's getaddrinfo(). Unused by unix_transport */
+    void set_dns_resolver(std::shared_ptr<dns_resolver> resolver);
+
+    /* applied to subsequent writes */
+    void set_write_options(const websocket_write_options& options);
+
+    /* negotiated on subsequent connects. Throws std::invalid_argument on out of range settings */
+    void set_compression_options(const websocket_compression_options& options);
+
+    /* applied on subsequent connects */
+    void set_ping_options(const websocket_ping_options& options);
+
+    websocket_stats stats() const;
+
+    /* throws websocket_server_disconnected_exception if attempted while the 
+     * websocket client is not connected to any server. This can also happen
+     * if the server disconnects/ends the session. */
+    boost::asio::awaitable<std::string> read();
+
+    /* allocation-free reads. read_view() reads into a buffer owned by the client,
+     * reused across reads and sized to the messages seen so far; read_into()
+     * reads into the caller's buffer, clearing it first but keeping its capacity */
+    boost::asio::awaitable<ws_message> read_view();
+    boost::asio::awaitable<ws_message> read_into(std::string& buffer);
+
+    /* streams a message as it arrives instead of buffering it whole: reads what
+     * is available of the current message, at most max_bytes of it (0 lets the stream pick),
+     * into buffer, clearing it first. Call again until message_done is set */
+    boost::asio::awaitable<ws_frame> read_some(std::string& buffer, std::size_t max_bytes = 64 * 1024);
+
+    /* queues the message and returns once it is queued, not once it is sent.
+     * Messages are written in order by a single writer on the connection's strand,
+     * so write() can be called from any number of coroutines and threads. If a
+     * socket write fails, the queue is dropped and the error is thrown by every
+     * write() and read() after it */
+    boost::asio::awaitable<void> write(const std::string& message);
+
+    /* same as write(), sending the message as a text or binary frame */
+    boost::asio::awaitable<void> write(std::string_view message, ws_message_type type);
+
+    /* sends what is queued, then a close frame, and returns once the server has
+     * answered it, or after timeout, when the socket is dropped instead.
+     * is_connected() turns false at once */
+    boost::asio::awaitable<void> close(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    /* close() in the background, returning at once. Also done on destruction */
+    void disconnect(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+extern template class basic_websocket_client<plain_transport>;
+extern template class basic_websocket_client<tls_transport>;
+extern template class basic_websocket_client<unix_transport>;
+
+using plain_websocket_client = basic_websocket_client<plain_transport>;
+using tls_websocket_client = basic_websocket_client<tls_transport>;
+using unix_websocket_client = basic_websocket_client<unix_transport>;
+
+
+/* picks plain_websocket_client, tls_websocket_client or unix_websocket_client
+ * at connect() from the host's ws://, wss:// or ws+unix:// prefix (no prefix =
+ * ws://), and forwards to it */
 class websocket_client {
 public:
     websocket_client();
@@ -32,22 +250,42 @@ public:
     websocket_client(websocket_client&& other);
     websocket_client& operator=(websocket_client&& other);
 
-    /* returns true on successful connection */
+    /* prefix with ws:// for unsecured or wss:// for secured. Returns true on successful connection.
+     * ws+unix:///path/to.sock connects to a unix socket, ignoring the port */
     boost::asio::awaitable<bool> connect(
         const std::string& host,
         const std::string& port,
         const std::string& target
     );
 
+    boost::asio::awaitable<bool> connect(
+        const std::string& host,
+        const std::string& port,
+        const std::string& target,
+        const std::string& address
+    );
+
+    /* the rest behaves as in basic_websocket_client */
     bool is_connected() const;
 
-    /* throws websocket_server_disconnected_exception if attempted while the 
-     * websocket client is not connected to any server. This can also happen
-     * if the server disconnects/ends the session. */
+    void set_socket_options(const socket_options& options);
+    void set_dns_resolver(std::shared_ptr<dns_resolver> resolver);
+    void set_write_options(const websocket_write_options& options);
+    void set_compression_options(const websocket_compression_options& options);
+    void set_ping_options(const websocket_ping_options& options);
+
+    websocket_stats stats() const;
+
     boost::asio::awaitable<std::string> read();
+    boost::asio::awaitable<ws_message> read_view();
+    boost::asio::awaitable<ws_message> read_into(std::string& buffer);
+    boost::asio::awaitable<ws_frame> read_some(std::string& buffer, std::size_t max_bytes = 64 * 1024);
+
     boost::asio::awaitable<void> write(const std::string& message);
+    boost::asio::awaitable<void> write(std::string_view message, ws_message_type type);
 
-    void disconnect();
+    boost::asio::awaitable<void> close(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+    void disconnect(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
 
 private:
     struct impl;
@@ -0,0 +1,100 @@
+#ifndef WEBSOCKET_PUMP_HPP
+#define WEBSOCKET_PUMP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <boost/asio/awaitable.hpp>
+
+#include "spsc_ring.hpp"
+#include "websocket_client.hpp"
+
+namespace zclient {
+
+struct websocket_pump_options {
+    /* slots in the ring, rounded up to a power of two */
+    std::size_t capacity = 4096;
+
+    /* bytes reserved up front in every slot. A larger message grows its slot
+     * once, which then keeps the storage */
+    std::size_t slot_size = 4096;
+};
+
+/* a message in the pump's ring. Slots are cache line aligned so the producer
+ * filling one never shares a line with the consumer reading its neighbour */
+struct alignas(64) pumped_message {
+    std::string data;
+    ws_message_type type = ws_message_type::text;
+
+    /* when the read completed on the io thread */
+    std::chrono::steady_clock::time_point received;
+};
+
+struct websocket_pump_stats {
+    std::uint64_t messages;
+
+    /* times the reader found the ring full and had to wait for the consumer
+     * to catch up, once per wait however long it lasted */
+    std::uint64_t full_waits;
+};
+
+/* Hands the messages of a websocket connection to a thread that does not run
+ * the io_context, e.g. a pinned strategy thread. run() is the connection's
+ * reader and copies every message straight into a preallocated slot of a
+ * lock-free single producer, single consumer ring; the consumer thread polls
+ * the ring without locks or syscalls:
+ *
+ *     while (!pump.finished()) {
+ *         if (auto* msg = pump.poll()) {
+ *             handle(msg->data);
+ *             pump.release();
+ *         }
+ *     }
+ *
+ * When the ring is full the reader waits for the consumer, yielding the io
+ * thread and then polling on a short timer, leaving the backpressure to TCP
+ * rather than dropping messages */
+class websocket_pump {
+public:
+    explicit websocket_pump(const websocket_pump_options& options = {});
+
+    websocket_pump(const websocket_pump& other) = delete;
+    websocket_pump& operator=(const websocket_pump& other) = delete;
+
+    /* producer, on the client's io thread. Reads until the connection closes
+     * (disconnect the client to stop it); read errors are rethrown after the
+     * pump is marked done */
+    boost::asio::awaitable<void> run(websocket_client& client);
+
+    /* consumer, from a single thread: the oldest message not yet released,
+     * nullptr if there is none yet */
+    const pumped_message* poll() noexcept {
+        return ring_.front();
+    }
+
+    /* consumer: gives the slot returned by poll() back to the reader */
+    void release() noexcept {
+        ring_.pop();
+    }
+
+    /* consumer: run() has ended and every message has been released */
+    bool finished() const noexcept {
+        return done_.load(std::memory_order_acquire) && ring_.empty();
+    }
+
+    /* safe from any thread, the counts may lag slightly */
+    websocket_pump_stats stats() const;
+
+private:
+    spsc_ring<pumped_message> ring_;
+    std::atomic<bool> done_{false};
+
+    std::atomic<std::uint64_t> messages_{0};
+    std::atomic<std::uint64_t> full_waits_{0};
+};
+
+} // ns zclient
+
+#endif // WEBSOCKET_PUMP_HPP
@@ -0,0 +1,108 @@
+#ifndef WEBSOCKET_ROUTER_HPP
+#define WEBSOCKET_ROUTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <boost/asio/awaitable.hpp>
+
+#include "websocket_client.hpp"
+
+namespace zclient {
+
+/* what a subscription does with a message that arrives while its queue is full */
+enum class overflow_policy {
+    drop_oldest,    /* discard the oldest queued message to make room */
+    drop_newest,    /* discard the incoming message */
+    conflate        /* the incoming message replaces the newest queued one, for
+                     * feeds where only the latest state matters */
+};
+
+struct subscription_options {
+    /* messages queued for the consumer before the overflow policy applies */
+    std::size_t capacity = 1024;
+    overflow_policy policy = overflow_policy::drop_oldest;
+};
+
+struct subscription_stats {
+    std::uint64_t delivered;
+    std::uint64_t dropped;
+    std::uint64_t conflated;
+    std::size_t queued;
+};
+
+struct websocket_router_stats {
+    std::uint64_t messages;
+
+    /* no key could be extracted, or nobody subscribed to it */
+    std::uint64_t unrouted;
+};
+
+/* A consumer's end of a websocket_router: the messages for its key, queued up
+ * to subscription_options::capacity */
+class websocket_subscription {
+public:
+    struct impl;
+
+    websocket_subscription() = default;
+    explicit websocket_subscription(std::shared_ptr<impl> pimpl);
+
+    /* the next message for the key. Throws websocket_server_disconnected_exception
+     * once the queue is empty and the router has stopped or this was unsubscribed */
+    boost::asio::awaitable<std::string> read();
+
+    const std::string& key() const;
+    subscription_stats stats() const;
+
+private:
+    friend class websocket_router;
+    std::shared_ptr<impl> pimpl_;
+};
+
+/* Routes the messages of one websocket connection to subscriptions by key.
+ * run() is the connection's only reader; it copies each message into the
+ * queues subscribed to its key and never waits on a consumer, so a slow
+ * consumer only loses its own messages, per its overflow policy.
+ *
+ * Use from a single thread, or a single strand */
+class websocket_router {
+public:
+    /* the key of a message, a view into it, or nullopt to drop the message */
+    using key_extractor = std::function<std::optional<std::string_view>(std::string_view)>;
+
+    /* the client must outlive the router */
+    websocket_router(websocket_client& client, key_extractor extractor);
+    ~websocket_router();
+
+    websocket_router(const websocket_router& other) = delete;
+    websocket_router& operator=(const websocket_router& other) = delete;
+
+    /* several subscriptions may share a key, each gets its own copy */
+    websocket_subscription subscribe(const std::string& key, const subscription_options& options = {});
+    void unsubscribe(const websocket_subscription& subscription);
+
+    /* reads and routes until the connection closes (disconnect the client to
+     * stop it), then ends every subscription. Rethrows read errors after that */
+    boost::asio::awaitable<void> run();
+
+    websocket_router_stats stats() const;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+/* extracts the string value of the first occurrence of a field without parsing
+ * the message, e.g. json_field_extractor("s") for {"e":"trade","s":"BTCUSDT",...}.
+ * Occurrences of the name not followed by a colon, as values, are skipped.
+ * Only handles string values without escapes, which is what feeds use for
+ * symbols and channel names */
+websocket_router::key_extractor json_field_extractor(const std::string& field);
+
+} // ns zclient
+
+#endif // WEBSOCKET_ROUTER_HPP
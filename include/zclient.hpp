@@ -6,8 +6,19 @@
 #include <functional>
 
 #include "asio_context_provider.hpp"
+#include "async_fetch.hpp"
+#include "busy_poll.hpp"
+#include "compute_pool.hpp"
+#include "dns_resolver.hpp"
+#include "feed_arbitrator.hpp"
 #include "http_client.hpp"
+#include "resilient_websocket_client.hpp"
+#include "segmented_download.hpp"
+#include "sse_client.hpp"
+#include "thread_per_core_runtime.hpp"
 #include "websocket_client.hpp"
+#include "websocket_pump.hpp"
+#include "websocket_router.hpp"
 
 namespace zclient {
 
@@ -16,9 +27,11 @@ using zawaitable = boost::asio::awaitable<T>;
 
 using zasync = zawaitable<void>;
 
-/* execute an asynchronous function */
-void zasync_exec(std::function<zasync()> async_fcn) {
-    boost::asio::co_spawn(get_io_context(), async_fcn, [](const std::exception_ptr& e) {
+/* execute an asynchronous function. Taken as a template so lambdas are not
+ * wrapped in (and copied into) a std::function */
+template <typename F>
+void zasync_exec(F&& async_fcn) {
+    boost::asio::co_spawn(get_io_context(), std::forward<F>(async_fcn), [](const std::exception_ptr& e) {
         if (e != nullptr) {
             try {
                 std::rethrow_exception(e);
@@ -76,12 +89,39 @@ void fetch_then(
 }
 
 
+/* callback-style fetch with the callback executed on a compute_pool worker */
+void fetch_then(
+    const std::string& host,
+    const std::string& port,
+    const http_request& request,
+    compute_pool& pool,
+    std::function<void(http_response&&)> callback
+)
+{
+    http_client http_client_;
+    http_client_.fetch_then(
+        host,
+        port,
+        request,
+        pool,
+        callback
+    );
+}
+
+
 /* run all networking */
 void zrun() {
     get_io_context().run();
 }
 
 
+/* run all networking on the calling thread in low latency busy-poll mode.
+ * Should be the only thread running the global io_context */
+void zrun_busy_poll(const busy_poll_options& options = {}) {
+    run_busy_poll(get_io_context(), options);
+}
+
+
 /* stop all networking */
 void zstop() {
     get_io_context().stop();
@@ -0,0 +1,62 @@
+#include "busy_poll.hpp"
+#include "socket_options.hpp"
+#include "thread_per_core_runtime.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+namespace {
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // anonymous ns
+
+void run_busy_poll(boost::asio::io_context& ioc, const busy_poll_options& options) {
+    using clock = std::chrono::steady_clock;
+
+    if (options.cpu >= 0) {
+        pin_current_thread(options.cpu);
+    }
+
+    LOG_TRACE << "Entering busy poll loop";
+
+    const bool never_back_off = options.spin_duration == std::chrono::microseconds::max();
+    auto last_work = clock::now();
+
+    while (!ioc.stopped()) {
+        if (ioc.poll()) {
+            last_work = clock::now();
+            continue;
+        }
+
+        /* poll() stops the io_context once it has run out of work */
+        if (ioc.stopped()) break;
+
+        if (never_back_off || clock::now() - last_work < options.spin_duration) {
+            cpu_relax();
+            continue;
+        }
+
+        /* idle: back off into the reactor until something happens */
+        if (ioc.run_one_for(options.idle_wait)) {
+            last_work = clock::now();
+        }
+    }
+
+    LOG_TRACE << "Busy poll loop exited";
+}
+
+socket_options busy_poll_socket_options(const busy_poll_options& options, socket_options base) {
+    if (options.socket_busy_poll_usec > 0) {
+        base.busy_poll_usec = options.socket_busy_poll_usec;
+    }
+    return base;
+}
+
+} // ns zclient
@@ -0,0 +1,150 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "compute_pool.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+struct compute_pool::impl {
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<compute_task> tasks;
+    };
+
+    explicit impl(unsigned threads) {
+        unsigned n = threads ? threads : std::thread::hardware_concurrency();
+        if (n == 0) n = 1;
+
+        queues_.reserve(n);
+        for (unsigned i = 0; i < n; ++i) {
+            queues_.push_back(std::make_unique<worker_queue>());
+        }
+
+        workers_.reserve(n);
+        for (unsigned i = 0; i < n; ++i) {
+            workers_.emplace_back([this, i]() { work(i); });
+        }
+    }
+
+    ~impl() {
+        {
+            std::lock_guard lock{sleep_mutex_};
+            stopping_ = true;
+        }
+        wakeup_.notify_all();
+
+        for (auto& w : workers_) {
+            w.join();
+        }
+    }
+
+    void post(compute_task task) {
+        /* a worker posting follow-up work keeps it local, everyone else spreads it */
+        const std::size_t index = (current_pool_ == this)
+            ? current_index_
+            : next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+
+        {
+            /* counted under the queue lock, so no worker can pop the task and
+             * decrement before the increment */
+            std::lock_guard lock{queues_[index]->mutex};
+            queues_[index]->tasks.push_back(std::move(task));
+            pending_.fetch_add(1, std::memory_order_release);
+        }
+
+        {
+            /* taking the lock orders this notify after a sleeper's predicate check */
+            std::lock_guard lock{sleep_mutex_};
+        }
+        wakeup_.notify_one();
+    }
+
+    bool pop_local(std::size_t index, compute_task& task) {
+        auto& q = *queues_[index];
+        std::lock_guard lock{q.mutex};
+        if (q.tasks.empty()) return false;
+
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(std::size_t thief, compute_task& task) {
+        for (std::size_t k = 1; k < queues_.size(); ++k) {
+            auto& q = *queues_[(thief + k) % queues_.size()];
+
+            std::unique_lock lock{q.mutex, std::try_to_lock};
+            if (!lock.owns_lock() || q.tasks.empty()) continue;
+
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void work(std::size_t index) {
+        current_pool_ = this;
+        current_index_ = index;
+
+        while (true) {
+            compute_task task;
+            if (pop_local(index, task) || steal(index, task)) {
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+
+                try {
+                    task();
+                } catch (std::exception const& e) {
+                    LOG_ERROR << "compute_pool task failed with: " << e.what();
+                }
+                continue;
+            }
+
+            std::unique_lock lock{sleep_mutex_};
+            wakeup_.wait(lock, [this]() {
+                return stopping_ || pending_.load(std::memory_order_acquire) > 0;
+            });
+
+            if (stopping_ && pending_.load(std::memory_order_acquire) == 0) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<worker_queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> next_{0};
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_ = false;
+
+    static thread_local impl* current_pool_;
+    static thread_local std::size_t current_index_;
+};
+
+thread_local compute_pool::impl* compute_pool::impl::current_pool_ = nullptr;
+thread_local std::size_t compute_pool::impl::current_index_ = 0;
+
+compute_pool::compute_pool(unsigned threads)
+    :pimpl_{std::make_unique<impl>(threads)}
+{}
+
+compute_pool::~compute_pool() {
+    pimpl_.reset();
+}
+
+void compute_pool::post(compute_task task) {
+    pimpl_->post(std::move(task));
+}
+
+std::size_t compute_pool::size() const {
+    return pimpl_->workers_.size();
+}
+
+} // ns zclient
@@ -0,0 +1,539 @@
+#include <boost/asio/experimental/as_tuple.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+
+#include "dns_resolver.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+namespace {
+
+using boost::asio::ip::address;
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+constexpr std::uint16_t type_a = 1;
+constexpr std::uint16_t type_aaaa = 28;
+constexpr std::uint16_t class_in = 1;
+
+constexpr int rcode_servfail = 2;
+constexpr int rcode_nxdomain = 3;
+constexpr int rcode_refused = 5;
+
+/* largest answer read over UDP without EDNS */
+constexpr std::size_t udp_payload_size = 512;
+
+struct dns_reply {
+    int rcode = 0;
+    bool truncated = false;
+    std::vector<address> addresses;
+};
+
+/* the answers to one name, across its A and AAAA queries */
+struct name_result {
+    bool nxdomain = false;
+    std::vector<address> v4;
+    std::vector<address> v6;
+};
+
+std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+std::uint16_t next_query_id() {
+    thread_local std::mt19937 rng{std::random_device{}()};
+    return static_cast<std::uint16_t>(rng());
+}
+
+void put_u16(std::string& out, std::uint16_t v) {
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v & 0xff));
+}
+
+std::uint16_t get_u16(const unsigned char* p) {
+    return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+}
+
+/* a recursive query for name, throws std::invalid_argument on a malformed name */
+std::string encode_query(std::uint16_t id, const std::string& name, std::uint16_t type) {
+    std::string out;
+    out.reserve(18 + name.size());
+
+    put_u16(out, id);
+    put_u16(out, 0x0100); /* recursion desired */
+    put_u16(out, 1);      /* one question */
+    put_u16(out, 0);
+    put_u16(out, 0);
+    put_u16(out, 0);
+
+    std::size_t start = 0;
+    while (start < name.size()) {
+        auto end = name.find('.', start);
+        if (end == std::string::npos) end = name.size();
+
+        const auto length = end - start;
+        if (length == 0 || length > 63) {
+            throw std::invalid_argument("Invalid host name: " + name);
+        }
+
+        out.push_back(static_cast<char>(length));
+        out.append(name, start, length);
+        start = end + 1;
+    }
+    out.push_back('\0');
+
+    if (out.size() - 12 > 255) {
+        throw std::invalid_argument("Host name too long: " + name);
+    }
+
+    put_u16(out, type);
+    put_u16(out, class_in);
+
+    return out;
+}
+
+/* offset just past the (possibly compressed) name at pos, nullopt if it runs
+ * off the end */
+std::optional<std::size_t> skip_name(const unsigned char* data, std::size_t size, std::size_t pos) {
+    while (pos < size) {
+        const unsigned length = data[pos];
+        if ((length & 0xc0) == 0xc0) {
+            return pos + 2 <= size ? std::optional<std::size_t>{pos + 2} : std::nullopt;
+        }
+        if (length == 0) {
+            return pos + 1;
+        }
+        pos += length + 1;
+    }
+    return std::nullopt;
+}
+
+/* nullopt unless data is a well formed answer to query id. Address records
+ * are taken from the whole answer section, so a CNAME chain resolved by the
+ * server yields the final addresses */
+std::optional<dns_reply> parse_reply(const char* bytes, std::size_t size, std::uint16_t id) {
+    const auto* data = reinterpret_cast<const unsigned char*>(bytes);
+    if (size < 12 || get_u16(data) != id) {
+        return std::nullopt;
+    }
+
+    const auto flags = get_u16(data + 2);
+    if (!(flags & 0x8000)) {
+        return std::nullopt; /* not a response */
+    }
+
+    dns_reply reply;
+    reply.rcode = flags & 0x000f;
+    reply.truncated = flags & 0x0200;
+
+    const auto questions = get_u16(data + 4);
+    const auto answers = get_u16(data + 6);
+
+    std::size_t pos = 12;
+    for (unsigned i = 0; i < questions; ++i) {
+        auto next = skip_name(data, size, pos);
+        if (!next || *next + 4 > size) return std::nullopt;
+        pos = *next + 4;
+    }
+
+    for (unsigned i = 0; i < answers; ++i) {
+        auto next = skip_name(data, size, pos);
+        if (!next || *next + 10 > size) return std::nullopt;
+        pos = *next;
+
+        const auto type = get_u16(data + pos);
+        const auto cls = get_u16(data + pos + 2);
+        const auto length = get_u16(data + pos + 8);
+        pos += 10;
+
+        if (pos + length > size) return std::nullopt;
+
+        if (cls == class_in && type == type_a && length == 4) {
+            boost::asio::ip::address_v4::bytes_type b;
+            std::copy_n(data + pos, 4, b.begin());
+            reply.addresses.emplace_back(boost::asio::ip::address_v4{b});
+        } else if (cls == class_in && type == type_aaaa && length == 16) {
+            boost::asio::ip::address_v6::bytes_type b;
+            std::copy_n(data + pos, 16, b.begin());
+            reply.addresses.emplace_back(boost::asio::ip::address_v6{b});
+        }
+
+        pos += length;
+    }
+
+    return reply;
+}
+
+/* cancels the socket's pending operations once the timer fires, unless the
+ * returned flag has been cleared first */
+template <typename Socket>
+std::shared_ptr<bool> arm_timeout(boost::asio::steady_timer& timer, Socket& socket, std::chrono::milliseconds timeout) {
+    auto waiting = std::make_shared<bool>(true);
+    timer.expires_after(timeout);
+    timer.async_wait([&socket, waiting](boost::system::error_code ec) {
+        if (!ec && *waiting) {
+            boost::system::error_code ignored;
+            socket.cancel(ignored);
+        }
+    });
+    return waiting;
+}
+
+/* one query over TCP, for answers too large for UDP */
+boost::asio::awaitable<std::optional<dns_reply>>
+exchange_tcp(const udp::endpoint& server, const std::string& name, std::uint16_t type, std::chrono::milliseconds timeout) {
+    using boost::asio::use_awaitable;
+    using boost::asio::experimental::as_tuple;
+
+    auto ex = co_await boost::asio::this_coro::executor;
+    tcp::socket socket{ex};
+    boost::asio::steady_timer timer{ex};
+    auto waiting = arm_timeout(timer, socket, timeout);
+
+    const auto id = next_query_id();
+    const auto query = encode_query(id, name, type);
+
+    std::string message;
+    put_u16(message, static_cast<std::uint16_t>(query.size()));
+    message += query;
+
+    const tcp::endpoint endpoint{server.address(), server.port()};
+    auto [connect_ec] = co_await socket.async_connect(endpoint, as_tuple(use_awaitable));
+    if (connect_ec) {
+        *waiting = false;
+        co_return std::nullopt;
+    }
+
+    auto [write_ec, written] = co_await boost::asio::async_write(socket, boost::asio::buffer(message), as_tuple(use_awaitable));
+
+    std::array<unsigned char, 2> length_prefix;
+    boost::system::error_code read_ec = write_ec;
+    if (!read_ec) {
+        auto [ec, n] = co_await boost::asio::async_read(socket, boost::asio::buffer(length_prefix), as_tuple(use_awaitable));
+        read_ec = ec;
+    }
+
+    std::string answer;
+    if (!read_ec) {
+        answer.resize(get_u16(length_prefix.data()));
+        auto [ec, n] = co_await boost::asio::async_read(socket, boost::asio::buffer(answer), as_tuple(use_awaitable));
+        read_ec = ec;
+    }
+
+    *waiting = false;
+    timer.cancel();
+
+    if (read_ec) {
+        co_return std::nullopt;
+    }
+
+    co_return parse_reply(answer.data(), answer.size(), id);
+}
+
+/* asks one nameserver for every type of name at once. nullopt when it does
+ * not answer them all in time, or refuses */
+boost::asio::awaitable<std::optional<name_result>>
+exchange(const udp::endpoint& server, const std::string& name, bool ipv6, std::chrono::milliseconds timeout) {
+    using boost::asio::use_awaitable;
+    using boost::asio::experimental::as_tuple;
+
+    auto ex = co_await boost::asio::this_coro::executor;
+
+    /* connected, so only the server's datagrams arrive and an unreachable
+     * port fails the receive at once */
+    udp::socket socket{ex, udp::endpoint{server.protocol(), 0}};
+    boost::system::error_code ec;
+    socket.connect(server, ec);
+    if (ec) {
+        co_return std::nullopt;
+    }
+
+    struct pending_query {
+        std::uint16_t type;
+        std::uint16_t id;
+        std::optional<dns_reply> reply;
+    };
+
+    std::vector<pending_query> queries{{type_a, next_query_id(), std::nullopt}};
+    if (ipv6) {
+        queries.push_back({type_aaaa, next_query_id(), std::nullopt});
+    }
+
+    for (const auto& q : queries) {
+        const auto message = encode_query(q.id, name, q.type);
+        auto [send_ec, sent] = co_await socket.async_send(boost::asio::buffer(message), as_tuple(use_awaitable));
+        if (send_ec) {
+            co_return std::nullopt;
+        }
+    }
+
+    boost::asio::steady_timer timer{ex};
+    auto waiting = arm_timeout(timer, socket, timeout);
+
+    std::array<char, udp_payload_size> buffer;
+    std::size_t outstanding = queries.size();
+
+    while (outstanding) {
+        auto [receive_ec, n] = co_await socket.async_receive(boost::asio::buffer(buffer), as_tuple(use_awaitable));
+        if (receive_ec) {
+            break;
+        }
+
+        /* anything that is not an answer to one of ours is dropped */
+        for (auto& q : queries) {
+            if (q.reply) continue;
+            if (auto reply = parse_reply(buffer.data(), n, q.id)) {
+                q.reply = std::move(reply);
+                --outstanding;
+                break;
+            }
+        }
+    }
+
+    *waiting = false;
+    timer.cancel();
+
+    if (outstanding) {
+        LOG_TRACE << "No answer from nameserver " << server << " for " << name;
+        co_return std::nullopt;
+    }
+
+    name_result result;
+    for (auto& q : queries) {
+        auto& reply = *q.reply;
+
+        if (reply.rcode == rcode_servfail || reply.rcode == rcode_refused) {
+            co_return std::nullopt;
+        }
+
+        if (reply.truncated) {
+            auto full = co_await exchange_tcp(server, name, q.type, timeout);
+            if (!full) {
+                co_return std::nullopt;
+            }
+            reply = std::move(*full);
+        }
+
+        if (reply.rcode == rcode_nxdomain) {
+            result.nxdomain = true;
+        }
+
+        for (const auto& a : reply.addresses) {
+            (a.is_v4() ? result.v4 : result.v6).push_back(a);
+        }
+    }
+
+    co_return result;
+}
+
+/* the names to look up for host, in order, following resolv.conf's rules */
+std::vector<std::string> candidate_names(const std::string& host, const dns_resolver_options& options) {
+    if (!host.empty() && host.back() == '.') {
+        return {host.substr(0, host.size() - 1)};
+    }
+
+    std::vector<std::string> names;
+    const auto dots = std::count(host.begin(), host.end(), '.');
+    const bool as_given_first = dots >= options.ndots;
+
+    if (as_given_first) {
+        names.push_back(host);
+    }
+    for (const auto& domain : options.search) {
+        names.push_back(host + '.' + domain);
+    }
+    if (!as_given_first) {
+        names.push_back(host);
+    }
+
+    return names;
+}
+
+std::optional<unsigned short> parse_service(const std::string& service) {
+    if (service.empty() || service == "http" || service == "ws") return 80;
+    if (service == "https" || service == "wss") return 443;
+
+    unsigned port = 0;
+    auto [end, ec] = std::from_chars(service.data(), service.data() + service.size(), port);
+    if (ec != std::errc{} || end != service.data() + service.size() || port > 65535) {
+        return std::nullopt;
+    }
+    return static_cast<unsigned short>(port);
+}
+
+template <typename Addresses>
+tcp::resolver::results_type make_results(const Addresses& addresses, unsigned short port,
+                                         const std::string& host, const std::string& service) {
+    std::vector<tcp::endpoint> endpoints;
+    endpoints.reserve(addresses.size());
+    for (const auto& a : addresses) {
+        endpoints.emplace_back(a, port);
+    }
+    return tcp::resolver::results_type::create(endpoints.begin(), endpoints.end(), host, service);
+}
+
+} // anonymous ns
+
+dns_resolver_options dns_resolver_options::from_system(const std::string& resolv_conf) {
+    dns_resolver_options options;
+
+    std::ifstream file{resolv_conf};
+    std::vector<std::string> domain;
+    bool have_search = false;
+    std::string line;
+
+    const auto option_value = [](const std::string& opt, const std::string& key) -> std::optional<int> {
+        if (opt.rfind(key, 0) != 0) return std::nullopt;
+        int value = 0;
+        auto [end, ec] = std::from_chars(opt.data() + key.size(), opt.data() + opt.size(), value);
+        if (ec != std::errc{}) return std::nullopt;
+        return value;
+    };
+
+    while (std::getline(file, line)) {
+        std::istringstream words{line};
+        std::string keyword;
+        if (!(words >> keyword) || keyword[0] == '#' || keyword[0] == ';') {
+            continue;
+        }
+
+        if (keyword == "nameserver") {
+            std::string value;
+            words >> value;
+            boost::system::error_code ec;
+            auto a = boost::asio::ip::make_address(value, ec);
+            if (!ec) {
+                options.nameservers.emplace_back(a, 53);
+            }
+        } else if (keyword == "search") {
+            options.search.clear();
+            for (std::string d; words >> d;) options.search.push_back(d);
+            have_search = true;
+        } else if (keyword == "domain") {
+            domain.clear();
+            std::string d;
+            if (words >> d) domain.push_back(d);
+        } else if (keyword == "options") {
+            for (std::string opt; words >> opt;) {
+                if (auto v = option_value(opt, "ndots:")) options.ndots = std::min(*v, 15);
+                if (auto v = option_value(opt, "timeout:")) options.timeout = std::chrono::seconds(std::max(*v, 1));
+                if (auto v = option_value(opt, "attempts:")) options.attempts = std::clamp(*v, 1, 5);
+            }
+        }
+    }
+
+    if (!have_search) {
+        options.search = domain;
+    }
+
+    return options;
+}
+
+dns_resolver::dns_resolver()
+    :dns_resolver(dns_resolver_options::from_system())
+{}
+
+dns_resolver::dns_resolver(dns_resolver_options options)
+    :options_{std::move(options)}
+{
+    if (options_.nameservers.empty()) {
+        options_.nameservers.emplace_back(boost::asio::ip::address_v4::loopback(), 53);
+    }
+    options_.attempts = std::max(options_.attempts, 1);
+
+    if (options_.hosts_file.empty()) {
+        return;
+    }
+
+    std::ifstream file{options_.hosts_file};
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream words{line};
+        std::string ip;
+        if (!(words >> ip)) continue;
+
+        boost::system::error_code ec;
+        auto a = boost::asio::ip::make_address(ip, ec);
+        if (ec) continue;
+
+        for (std::string name; words >> name;) {
+            hosts_.emplace(to_lower(name), a);
+        }
+    }
+}
+
+boost::asio::awaitable<tcp::resolver::results_type>
+dns_resolver::resolve(const std::string& host, const std::string& service) {
+    const auto port = parse_service(service);
+    if (!port) {
+        throw boost::system::system_error(boost::asio::error::service_not_found, "resolve " + service);
+    }
+
+    boost::system::error_code ec;
+    const auto literal = boost::asio::ip::make_address(host, ec);
+    if (!ec) {
+        const std::array<address, 1> one{literal};
+        co_return make_results(one, *port, host, service);
+    }
+
+    const auto key = to_lower(host);
+    if (hosts_.count(key)) {
+        std::vector<address> v4, v6;
+        auto [first, last] = hosts_.equal_range(key);
+        for (auto it = first; it != last; ++it) {
+            (it->second.is_v4() ? v4 : v6).push_back(it->second);
+        }
+        if (options_.ipv6) v4.insert(v4.end(), v6.begin(), v6.end());
+        if (!v4.empty()) {
+            co_return make_results(v4, *port, host, service);
+        }
+    }
+
+    boost::system::error_code failure = boost::asio::error::host_not_found;
+
+    for (const auto& name : candidate_names(key, options_)) {
+        std::optional<name_result> result;
+
+        for (int attempt = 0; attempt < options_.attempts && !result; ++attempt) {
+            for (const auto& server : options_.nameservers) {
+                result = co_await exchange(server, name, options_.ipv6, options_.timeout);
+                if (result) break;
+            }
+        }
+
+        if (!result) {
+            LOG_WARN << "No nameserver answered for " << name;
+            failure = boost::asio::error::timed_out;
+            continue;
+        }
+
+        auto& addresses = result->v4;
+        addresses.insert(addresses.end(), result->v6.begin(), result->v6.end());
+
+        if (!addresses.empty()) {
+            LOG_TRACE << "Resolved " << host << " as " << name << " to " << addresses.size() << " addresses";
+            co_return make_results(addresses, *port, host, service);
+        }
+    }
+
+    throw boost::system::system_error(failure, "resolve " + host);
+}
+
+} // ns zclient
@@ -0,0 +1,304 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/experimental/as_tuple.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include "feed_arbitrator.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+struct feed_arbitrator::impl : std::enable_shared_from_this<impl> {
+    using clock = std::chrono::steady_clock;
+
+    /* first arrival of a sequence number */
+    struct arrival {
+        std::uint64_t sequence;
+        clock::time_point at;
+        std::size_t line;
+        bool valid;
+    };
+
+    impl(sequence_extractor extractor, const feed_arbitrator_options& options)
+        :extractor_{std::move(extractor)},
+        options_{options},
+        history_(std::max<std::size_t>(options.history, 1))
+    {}
+
+    boost::asio::awaitable<bool> connect(const std::vector<feed_line>& lines) {
+        auto ex = co_await boost::asio::this_coro::executor;
+        signal_.emplace(ex, clock::time_point::max());
+        closing_ = false;
+
+        lines_ = lines;
+        clients_.clear();
+        stats_ = {};
+        stats_.lines.resize(lines.size());
+
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            auto client = std::make_unique<resilient_websocket_client>(options_.line_options);
+            if (handshake_) {
+                client->set_handshake(handshake_);
+            }
+            clients_.push_back(std::move(client));
+        }
+
+        /* all at once, so a slow line does not hold up the others */
+        auto connecting = std::make_shared<connect_state>(ex, lines.size());
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            boost::asio::co_spawn(ex, connect_one(shared_from_this(), i, connecting), boost::asio::detached);
+        }
+
+        while (connecting->remaining) {
+            co_await connecting->done.async_wait(boost::asio::experimental::as_tuple(boost::asio::use_awaitable));
+        }
+
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            boost::asio::co_spawn(ex, read_line(shared_from_this(), i, connecting->connected[i]), boost::asio::detached);
+        }
+
+        co_return std::find(connecting->connected.begin(), connecting->connected.end(), true) != connecting->connected.end();
+    }
+
+    /* the lines' first connection attempts, cancels done when the last is over */
+    struct connect_state {
+        connect_state(const boost::asio::any_io_executor& ex, std::size_t lines)
+            :connected(lines, false),
+            remaining{lines},
+            done{ex, clock::time_point::max()}
+        {}
+
+        std::vector<bool> connected;
+        std::size_t remaining;
+        boost::asio::steady_timer done;
+    };
+
+    static boost::asio::awaitable<void> connect_one(std::shared_ptr<impl> self, std::size_t index, std::shared_ptr<connect_state> state) {
+        state->connected[index] = co_await self->connect_line(index);
+
+        if (--state->remaining == 0) {
+            state->done.cancel();
+        }
+    }
+
+    boost::asio::awaitable<bool> connect_line(std::size_t index) {
+        const auto& line = lines_[index];
+        try {
+            const bool connected = co_await clients_[index]->connect(line.host, line.port, line.target);
+            co_return connected;
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Feed line " << index << " failed to connect: " << e.what();
+            co_return false;
+        }
+    }
+
+    /* one per line, feeds its messages to the arbitration until disconnect() */
+    static boost::asio::awaitable<void> read_line(std::shared_ptr<impl> self, std::size_t index, bool connected) {
+        using boost::asio::experimental::as_tuple;
+
+        auto delay = self->options_.line_options.reconnect_delay;
+        boost::asio::steady_timer backoff{co_await boost::asio::this_coro::executor};
+
+        /* a line that never came up; once it has, its client reconnects by itself */
+        while (!connected && !self->closing_) {
+            backoff.expires_after(delay);
+            co_await backoff.async_wait(as_tuple(boost::asio::use_awaitable));
+            delay = std::min(delay * 2, self->options_.line_options.max_reconnect_delay);
+
+            if (!self->closing_) {
+                connected = co_await self->connect_line(index);
+            }
+        }
+
+        auto& client = *self->clients_[index];
+
+        while (!self->closing_) {
+            try {
+                const auto message = co_await client.read_view();
+                self->on_message(index, message.data, clock::now());
+            } catch (const websocket_server_disconnected_exception& e) {
+                LOG_TRACE << "Feed line " << index << " closed: " << e.what();
+                break;
+            }
+        }
+    }
+
+    /* the view is only valid until the line's next read, the message is copied
+     * only when this line is the first to have it */
+    void on_message(std::size_t index, std::string_view data, clock::time_point now) {
+        const auto sequence = extractor_(data);
+        if (!sequence) {
+            ++stats_.unsequenced;
+            return;
+        }
+
+        auto& line = stats_.lines[index];
+        ++line.messages;
+
+        auto& first = history_[*sequence % history_.size()];
+        if (first.valid && first.sequence == *sequence) {
+            const auto lag = std::chrono::duration_cast<std::chrono::nanoseconds>(now - first.at);
+            ++line.duplicates;
+            line.total_lag += lag;
+            line.max_lag = std::max(line.max_lag, lag);
+            stats_.lines[first.line].total_lead += lag;
+            return;
+        }
+
+        /* delivered too long ago to still be in the history, or skipped */
+        if (next_ && *sequence < *next_) {
+            ++line.duplicates;
+            return;
+        }
+
+        first = arrival{*sequence, now, index, true};
+        ++line.first;
+
+        if (!next_) {
+            next_ = *sequence;
+        }
+
+        if (*sequence == *next_) {
+            ready_.push_back(arbitrated_message{std::string{data}, *sequence, index});
+            ++*next_;
+            flush(now);
+        } else {
+            if (pending_.empty()) {
+                gap_deadline_ = now + options_.gap_timeout;
+            }
+            pending_.emplace(*sequence, arbitrated_message{std::string{data}, *sequence, index});
+
+            if (pending_.size() > options_.max_pending || options_.gap_timeout.count() == 0) {
+                skip_gap(now);
+            }
+        }
+
+        signal_->cancel();
+    }
+
+    /* moves the messages that became consecutive to the ready queue */
+    void flush(clock::time_point now) {
+        const bool had_gap = !pending_.empty();
+
+        while (!pending_.empty() && pending_.begin()->first == *next_) {
+            ready_.push_back(std::move(pending_.begin()->second));
+            pending_.erase(pending_.begin());
+            ++*next_;
+        }
+
+        /* the next gap gets its own full timeout */
+        if (had_gap && !pending_.empty()) {
+            gap_deadline_ = now + options_.gap_timeout;
+        }
+    }
+
+    /* gives up on the sequence numbers missing before the oldest pending message */
+    void skip_gap(clock::time_point now) {
+        const auto resume = pending_.begin()->first;
+        LOG_TRACE << "Skipping sequence numbers " << *next_ << " to " << resume - 1;
+
+        stats_.missed += resume - *next_;
+        next_ = resume;
+        flush(now);
+    }
+
+    boost::asio::awaitable<arbitrated_message> read() {
+        using boost::asio::experimental::as_tuple;
+
+        while (true) {
+            if (!ready_.empty()) {
+                auto message = std::move(ready_.front());
+                ready_.pop_front();
+                ++stats_.delivered;
+                co_return message;
+            }
+
+            if (closing_ || !signal_) {
+                throw websocket_server_disconnected_exception("Connection is not open");
+            }
+
+            if (!pending_.empty()) {
+                const auto now = clock::now();
+                if (now >= gap_deadline_) {
+                    skip_gap(now);
+                    continue;
+                }
+                signal_->expires_at(gap_deadline_);
+            } else {
+                signal_->expires_at(clock::time_point::max());
+            }
+
+            co_await signal_->async_wait(as_tuple(boost::asio::use_awaitable));
+        }
+    }
+
+    void disconnect() {
+        closing_ = true;
+
+        for (auto& client : clients_) {
+            client->disconnect();
+        }
+
+        if (signal_) {
+            signal_->cancel();
+        }
+    }
+
+    sequence_extractor extractor_;
+    feed_arbitrator_options options_;
+    resilient_websocket_client::handshake_function handshake_;
+    feed_arbitrator_stats stats_{};
+
+private:
+    std::vector<feed_line> lines_;
+    std::vector<std::unique_ptr<resilient_websocket_client>> clients_;
+    bool closing_ = false;
+
+    /* the next sequence number to deliver, set by the first message */
+    std::optional<std::uint64_t> next_;
+
+    /* received ahead of a gap, by sequence number */
+    std::map<std::uint64_t, arbitrated_message> pending_;
+    clock::time_point gap_deadline_;
+
+    std::deque<arbitrated_message> ready_;
+    std::vector<arrival> history_;
+
+    /* wakes read() when a message is ready or the gap timeout is up */
+    std::optional<boost::asio::steady_timer> signal_;
+};
+
+feed_arbitrator::feed_arbitrator(sequence_extractor extractor, const feed_arbitrator_options& options)
+    :pimpl_{std::make_shared<impl>(std::move(extractor), options)}
+{}
+
+feed_arbitrator::~feed_arbitrator() {
+    pimpl_->disconnect();
+}
+
+void feed_arbitrator::set_handshake(resilient_websocket_client::handshake_function handshake) {
+    pimpl_->handshake_ = std::move(handshake);
+}
+
+boost::asio::awaitable<bool> feed_arbitrator::connect(const std::vector<feed_line>& lines) {
+    auto resp = co_await pimpl_->connect(lines);
+    co_return resp;
+}
+
+boost::asio::awaitable<arbitrated_message> feed_arbitrator::read() {
+    return pimpl_->read();
+}
+
+void feed_arbitrator::disconnect() {
+    pimpl_->disconnect();
+}
+
+feed_arbitrator_stats feed_arbitrator::stats() const {
+    return pimpl_->stats_;
+}
+
+} // ns zclient
@@ -6,27 +6,186 @@
 #include <boost/asio/awaitable.hpp>
 #include <boost/asio/co_spawn.hpp>
 #include <boost/asio/detached.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/use_awaitable.hpp>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <type_traits>
 #include "boost/certify/https_verification.hpp"
 
 #include "asio_context_provider.hpp"
+#include "async_fetch.hpp"
+#include "compute_pool.hpp"
 #include "http_client.hpp"
+#include "tls_session.hpp"
+#include "verification_cache.hpp"
 #include "zlogger.hpp"
 
 namespace zclient {
 
-struct http_client::impl {
+namespace detail {
+
+static void init_client_ssl_context(boost::asio::ssl::context& ctx) {
+    ctx.set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
+    ctx.set_default_verify_paths();
+
+    boost::certify::enable_native_https_server_verification(ctx);
+
+    /* known-good certificates skip chain building on later handshakes */
+    verification_cache::enable(ctx);
+}
+
+boost::asio::ssl::context& shared_ssl_context() {
+    static boost::asio::ssl::context ctx = []() {
+        boost::asio::ssl::context c{boost::asio::ssl::context::sslv23_client};
+        init_client_ssl_context(c);
+        return c;
+    }();
+    return ctx;
+}
+
+fetch_target parse_fetch_host(const std::string& host) {
+    /* parse host for http prefix to decide which protocol to use
+     * (http or https) */
+    bool use_ssl = false;
+    bool use_unix = false;
+    std::string token{"://"};
+
+    std::size_t idx = host.find(token);
+    if (idx != std::string::npos) {
+        auto prefix = host.substr(0, idx);
+        if (prefix == "https") {
+            use_ssl = true;
+        } else if (prefix == "http") {
+            use_ssl = false;
+        } else if (prefix == "http+unix") {
+            use_unix = true;
+        } else {
+            throw std::invalid_argument("Unrecognized prefix: " + prefix);
+        }
+    }
+
+    return fetch_target{
+        .host = (idx != std::string::npos) ? host.substr(idx + token.length()) : host,
+        .use_ssl = use_ssl,
+        .use_unix = use_unix
+    };
+}
+
+boost::beast::http::request<boost::beast::http::string_body>
+translate_http_request(
+    const std::string& host,
+    const http_request& request
+)
+{
+    // Set up an HTTP request message
+    boost::beast::http::request<boost::beast::http::string_body> req;
+
+    req.version(HTTP_VERSION);
+
+    switch (request.method) {
+    case http_method::get:
+        req.method(boost::beast::http::verb::get);
+        break;
+    case http_method::post:
+        req.method(boost::beast::http::verb::post);
+        break;
+    case http_method::delete_:
+        req.method(boost::beast::http::verb::delete_);
+        break;
+    case http_method::put:
+        req.method(boost::beast::http::verb::put);
+        break;
+    default: abort();
+    }
+
+    req.target(request.path);
+    req.set(boost::beast::http::field::host, host);
+    req.set(boost::beast::http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+
+    for (const auto& header_field : request.header_data) {
+        req.set(header_field.first, header_field.second);
+    }
+
+    req.body() = request.body;
+    req.prepare_payload();
+
+    return req;
+}
+
+http_response
+translate_http_response(boost::beast::http::response<boost::beast::http::string_body>&& res)
+{
+    std::vector<std::pair<std::string,std::string>> header_data;
+
+    const auto& header_base = res.base();
+    for (const auto& header_field : header_base) {
+        header_data.emplace_back(header_field.name_string(), header_field.value());
+    }
+
+    /* compose the response, the body is moved rather than copied */
+    return http_response{
+        .return_code = res.result_int(),
+        .body = std::move(res.body()),
+        .header_data = std::move(header_data)
+    };
+}
+
+/* waits for the first response bytes and returns their kernel receive time
+ * without consuming them, so the read that follows still sees them */
+template <typename Socket>
+boost::asio::awaitable<rx_time_point> await_response_timestamp(Socket& socket)
+{
+    boost::asio::steady_timer timer{socket.get_executor()};
+    auto waiting = arm_wait_timeout(timer, socket);
+
+    auto [ec] = co_await socket.async_wait(boost::asio::socket_base::wait_read, boost::asio::as_tuple(boost::asio::use_awaitable));
+    *waiting = false;
+    timer.cancel();
+
+    if (ec) {
+        throw boost::system::system_error(ec == boost::asio::error::operation_aborted ? boost::beast::error::timeout : ec, "read");
+    }
+
+    co_return peek_rx_timestamp(socket.native_handle());
+}
+
+/* close_notify exchange on a stream whose response has already been handed
+ * back. Errors are only logged, there is nobody left to report them to */
+template <typename Stream>
+boost::asio::awaitable<void> shutdown_in_background(Stream stream, std::string host)
+{
+    boost::beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(TLS_SHUTDOWN_TIMEOUT_SECONDS));
+
+    auto [ec] = co_await stream.async_shutdown(boost::asio::as_tuple(boost::asio::use_awaitable));
+    if (ec && ec != boost::asio::error::eof && ec != boost::asio::ssl::error::stream_truncated) {
+        LOG_TRACE << "Background TLS shutdown for " << host << " ended with: " << ec.message();
+        co_return;
+    }
+
+    LOG_TRACE << "HTTPS connection closed for " << host;
+}
+
+} // ns detail
+
+template <typename Transport>
+struct basic_http_client<Transport>::impl {
+    static constexpr bool use_ssl = std::is_same_v<Transport, tls_transport>;
+    static constexpr bool use_unix = std::is_same_v<Transport, unix_transport>;
+
     impl()
-        :ssl_ctx_{boost::asio::ssl::context::sslv23_client}
+        :socket_options_{default_socket_options()}
+        ,tls_shutdown_{default_tls_shutdown_policy()}
+        ,ssl_ctx_{boost::asio::ssl::context::sslv23_client}
     {
-        ssl_ctx_.set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
-        ssl_ctx_.set_default_verify_paths();
-
-        boost::certify::enable_native_https_server_verification(ssl_ctx_);
+        if constexpr (use_ssl) {
+            detail::init_client_ssl_context(ssl_ctx_);
+            sessions_.emplace(ssl_ctx_);
+        }
     }
 
     ~impl()
@@ -35,15 +194,19 @@ struct http_client::impl {
     using executor_with_default = boost::asio::use_awaitable_t<>::executor_with_default<boost::asio::any_io_executor>;
     using tcp_stream = typename boost::beast::tcp_stream::rebind_executor<executor_with_default>::other;
 
+    /* the stream of a fetch without TLS */
+    using plain_stream_type = std::conditional_t<use_unix,
+        boost::beast::basic_stream<boost::asio::local::stream_protocol>,
+        boost::beast::tcp_stream>;
+
     boost::asio::awaitable<http_response>
     fetch(
         const std::string& host,
         const std::string& port,
-        const http_request& request,
-        bool use_ssl
+        const http_request& request
     )
     {
-        if (use_ssl) {
+        if constexpr (use_ssl) {
             LOG_TRACE << "fetch_http_ssl for: " << host << ":" << port;
             auto resp = co_await fetch_http_ssl(host, port, request);
             co_return resp;
@@ -54,49 +217,28 @@ struct http_client::impl {
         }
     }
 
+    socket_options socket_options_;
+    std::shared_ptr<dns_resolver> dns_resolver_;
+    tls_shutdown_policy tls_shutdown_;
+
 private:
     boost::asio::ssl::context ssl_ctx_;
 
-    inline
-    boost::beast::http::request<boost::beast::http::string_body>
-    translate_http_request(
-        const std::string& host,
-        const http_request& request
-    )
-    {
-        // Set up an HTTP request message
-        boost::beast::http::request<boost::beast::http::string_body> req;
-
-        req.version(HTTP_VERSION);
-
-        switch (request.method) {
-        case http_method::get:
-            req.method(boost::beast::http::verb::get);
-            break;
-        case http_method::post:
-            req.method(boost::beast::http::verb::post);
-            break;
-        case http_method::delete_:
-            req.method(boost::beast::http::verb::delete_);
-            break;
-        case http_method::put:
-            req.method(boost::beast::http::verb::put);
-            break;
-        default: abort();
-        }
-
-        req.target(request.path);
-        req.set(boost::beast::http::field::host, host);
-        req.set(boost::beast::http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    /* sessions of the hosts fetched from before, tls_transport only */
+    std::optional<detail::tls_session_cache> sessions_;
 
-        for (const auto& header_field : request.header_data) {
-            req.set(header_field.first, header_field.second);
+    /* through the selected dns_resolver, the system's getaddrinfo() without one */
+    boost::asio::awaitable<boost::asio::ip::tcp::resolver::results_type>
+    resolve(const std::string& host, const std::string& port)
+    {
+        if (dns_resolver_) {
+            auto results = co_await dns_resolver_->resolve(host, port);
+            co_return results;
         }
 
-        req.body() = request.body;
-        req.prepare_payload();
-
-        return req;
+        auto resolver = boost::asio::use_awaitable.as_default_on(boost::asio::ip::tcp::resolver(co_await boost::asio::this_coro::executor));
+        auto results = co_await resolver.async_resolve(host, port);
+        co_return results;
     }
 
     boost::asio::awaitable<http_response>
@@ -111,8 +253,7 @@ private:
         // This makes our code easy, but will use exceptions as the default error handling,
         // i.e. if the connection drops, we might see an exception.
         // See async_shutdown for error handling with an error_code.
-        auto resolver = boost::asio::use_awaitable.as_default_on(boost::asio::ip::tcp::resolver(co_await boost::asio::this_coro::executor));
-        boost::beast::ssl_stream<tcp_stream> stream{
+        boost::beast::ssl_stream<rx_timestamp_stream<tcp_stream>> stream{
                 boost::asio::use_awaitable.as_default_on(boost::beast::tcp_stream(co_await boost::asio::this_coro::executor)),
                 ssl_ctx_};
 
@@ -124,11 +265,14 @@ private:
 
         LOG_TRACE << "SNI hostname set";
 
+        /* resume the session of the last connection to this server, if any */
+        const std::size_t max_early_data = sessions_->resume(stream.native_handle(), host + ":" + port);
+
         // Look up the domain name
         boost::asio::ip::basic_resolver_results<boost::asio::ip::tcp> results;
 
         try {
-            results = co_await resolver.async_resolve(host, port);
+            results = co_await resolve(host, port);
         } catch (std::exception& e) {
             LOG_ERROR << "Domain name resolution failed with error: " << e.what();
             throw e;
@@ -148,6 +292,17 @@ private:
 
         LOG_TRACE << "Host connected for " << host << ":" << port;
 
+        apply_socket_options(boost::beast::get_lowest_layer(stream).socket(), socket_options_);
+
+        auto req = detail::translate_http_request(host, request);
+
+        /* a replay-safe GET can go out with the ClientHello instead of after the handshake */
+        bool early_data_sent = false;
+        if (request.replay_safe && request.method == http_method::get && max_early_data) {
+            boost::beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            early_data_sent = co_await detail::write_early_data(stream, req, max_early_data);
+        }
+
         // Set the timeout.
         boost::beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
 
@@ -163,15 +318,36 @@ private:
 
         LOG_TRACE << "SSL handshake complete for " << host << ":" << port;
 
-        auto req = translate_http_request(host, request);
+        const bool early_data_accepted = early_data_sent
+            && SSL_get_early_data_status(stream.native_handle()) == SSL_EARLY_DATA_ACCEPTED;
 
-        // Set the timeout.
-        boost::beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+        if (early_data_accepted) {
+            LOG_TRACE << "Request sent as early data to " << host << ":" << port;
+        } else {
+            if (early_data_sent) {
+                LOG_TRACE << "Early data rejected by " << host << ":" << port << ", sending the request again";
+            }
 
-        // Send the HTTP request to the remote host
-        co_await boost::beast::http::async_write(stream, req);
+            // Set the timeout.
+            boost::beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
 
-        LOG_TRACE << "Request written for " << host << ":" << port;
+            // Send the HTTP request to the remote host
+            co_await boost::beast::http::async_write(stream, req);
+
+            LOG_TRACE << "Request written for " << host << ":" << port;
+        }
+
+        /* Stamp the first record of the response. The first bytes can be a
+         * session ticket (TLS 1.3), so the stamp is taken below TLS while the
+         * response is read, and the read is timed here rather than by the stream */
+        std::optional<detail::tls_rx_stamp> rx_stamp;
+        boost::asio::steady_timer rx_timer{stream.get_executor()};
+        std::shared_ptr<bool> rx_waiting;
+        if (socket_options_.rx_timestamps) {
+            stream.next_layer().enable();
+            rx_stamp.emplace(stream.native_handle(), stream.next_layer());
+            rx_waiting = detail::arm_wait_timeout(rx_timer, boost::beast::get_lowest_layer(stream).socket());
+        }
 
         // This buffer is used for reading and must be persisted
         boost::beast::flat_buffer b;
@@ -180,26 +356,56 @@ private:
         boost::beast::http::response<boost::beast::http::string_body> res;
 
         // Receive the HTTP response
-        co_await boost::beast::http::async_read(stream, b, res);
+        auto [read_ec, read_size] = co_await boost::beast::http::async_read(stream, b, res, boost::asio::as_tuple(boost::asio::use_awaitable));
 
-        LOG_TRACE << "Response received from " << host << ":" << port;
+        rx_time_point rx_timestamp{};
+        if (rx_stamp) {
+            *rx_waiting = false;
+            rx_timer.cancel();
+            rx_timestamp = rx_stamp->timestamp();
+            rx_stamp.reset();
+
+            /* the shutdown is timed by the stream again */
+            stream.next_layer().disable();
 
-        std::vector<std::pair<std::string,std::string>> header_data;
+            if (read_ec == boost::asio::error::operation_aborted) {
+                read_ec = boost::beast::error::timeout;
+            }
+        }
 
-        const auto& header_base = res.base();
-        for (const auto& header_field : header_base) {
-            header_data.emplace_back(header_field.name_string(), header_field.value());
+        if (read_ec) {
+            throw boost::system::system_error(read_ec);
         }
 
-        /* compose the response */
-        http_response resp = {
-            .return_code = static_cast<unsigned>(res.result()),
-            .body = res.body(),
-            .header_data = std::move(header_data)
-        };
-        
+        LOG_TRACE << "Response received from " << host << ":" << port;
+
+        auto resp = detail::translate_http_response(std::move(res));
+        resp.rx_timestamp = rx_timestamp;
+
         LOG_TRACE << "Response composed";
 
+        /* 425 Too Early: the server wants the request after the handshake (RFC 8470) */
+        if (early_data_accepted && resp.return_code == 425) {
+            LOG_TRACE << host << ":" << port << " answered the early data with 425, retrying without";
+
+            auto retry = request;
+            retry.replay_safe = false;
+            auto retried = co_await fetch_http_ssl(host, port, retry);
+            co_return retried;
+        }
+
+        if (tls_shutdown_ == tls_shutdown_policy::background) {
+            /* the response is complete, so the caller need not wait for the close_notify round trip */
+            /* before the move: argument evaluation order is unspecified */
+            auto ex = stream.get_executor();
+            boost::asio::co_spawn(ex, detail::shutdown_in_background(std::move(stream), host), boost::asio::detached);
+            co_return resp;
+        }
+
+        if (tls_shutdown_ == tls_shutdown_policy::skip) {
+            co_return resp;
+        }
+
         // Gracefully close the stream - do not threat every error as an exception!
         auto [ec] = co_await stream.async_shutdown(boost::asio::as_tuple(boost::asio::use_awaitable));
         if (ec == boost::asio::error::eof || ec == boost::asio::ssl::error::stream_truncated)
@@ -228,36 +434,55 @@ private:
         // They use an executor with a default completion token of use_awaitable
         // This makes our code easy, but will use exceptions as the default error handling,
         // i.e. if the connection drops, we might see an exception.
-        auto resolver = boost::asio::use_awaitable.as_default_on(boost::asio::ip::tcp::resolver(co_await boost::asio::this_coro::executor));
-        auto stream = boost::asio::use_awaitable.as_default_on(boost::beast::tcp_stream(co_await boost::asio::this_coro::executor));
+        auto stream = boost::asio::use_awaitable.as_default_on(plain_stream_type(co_await boost::asio::this_coro::executor));
 
-        LOG_TRACE << "Looking up domain name for: " << host << ":" << port;
+        if constexpr (use_unix) {
+            LOG_TRACE << "Connecting to unix socket: " << host;
 
-        // Look up the domain name
-        boost::asio::ip::basic_resolver_results<boost::asio::ip::tcp> results;
-        try {
-            results = co_await resolver.async_resolve(host, port);
-        } catch (std::exception& e) {
-            LOG_ERROR << "Domain name resolution failed with error: " << e.what();
-            throw e;
-        }
+            // Set the timeout.
+            stream.expires_after(std::chrono::seconds(30));
 
-        LOG_TRACE << "Resolved for: " << host << ":" << port;
+            // The host is the socket's path, there is nothing to look up
+            try {
+                co_await stream.async_connect(boost::asio::local::stream_protocol::endpoint{host});
+            } catch (std::exception& e) {
+                LOG_ERROR << "Connection failed with error: " << e.what();
+                throw e;
+            }
 
-        // Set the timeout.
-        stream.expires_after(std::chrono::seconds(30));
+            LOG_TRACE << "Connected to: " << host;
+        } else {
+            LOG_TRACE << "Looking up domain name for: " << host << ":" << port;
 
-        // Make the connection on the IP address we get from a lookup
-        try {
-            co_await stream.async_connect(results);
-        } catch (std::exception& e) {
-            LOG_ERROR << "Connection failed with error: " << e.what();
-            throw e;
-        }
+            // Look up the domain name
+            boost::asio::ip::basic_resolver_results<boost::asio::ip::tcp> results;
+            try {
+                results = co_await resolve(host, port);
+            } catch (std::exception& e) {
+                LOG_ERROR << "Domain name resolution failed with error: " << e.what();
+                throw e;
+            }
+
+            LOG_TRACE << "Resolved for: " << host << ":" << port;
+
+            // Set the timeout.
+            stream.expires_after(std::chrono::seconds(30));
 
-        LOG_TRACE << "Connected to: " << host << ":" << port;
+            // Make the connection on the IP address we get from a lookup
+            try {
+                co_await stream.async_connect(results);
+            } catch (std::exception& e) {
+                LOG_ERROR << "Connection failed with error: " << e.what();
+                throw e;
+            }
+
+            LOG_TRACE << "Connected to: " << host << ":" << port;
+
+            apply_socket_options(stream.socket(), socket_options_);
+        }
 
-        auto req = translate_http_request(host, request);
+        /* a unix socket's path makes no sense as the Host header */
+        auto req = detail::translate_http_request(use_unix ? "localhost" : host, request);
 
         // Set the timeout.
         stream.expires_after(std::chrono::seconds(30));
@@ -267,6 +492,12 @@ private:
 
         LOG_TRACE << "Request written for " << host << ":" << port;
 
+        // Stamp the first response bytes
+        rx_time_point rx_timestamp{};
+        if (socket_options_.rx_timestamps && !use_unix) {
+            rx_timestamp = co_await detail::await_response_timestamp(stream.socket());
+        }
+
         // This buffer is used for reading and must be persisted
         boost::beast::flat_buffer b;
 
@@ -278,20 +509,9 @@ private:
 
         LOG_TRACE << "Response received from " << host << ":" << port;
 
-        std::vector<std::pair<std::string,std::string>> header_data;
-
-        const auto& header_base = res.base();
-        for (const auto& header_field : header_base) {
-            header_data.emplace_back(header_field.name_string(), header_field.value());
-        }
+        auto resp = detail::translate_http_response(std::move(res));
+        resp.rx_timestamp = rx_timestamp;
 
-        /* compose the response */
-        http_response resp = {
-            .return_code = static_cast<unsigned>(res.result()),
-            .body = res.body(),
-            .header_data = std::move(header_data)
-        };
-        
         LOG_TRACE << "Response composed for " << host << ":" << port;
 
         // Gracefully close the socket
@@ -311,6 +531,71 @@ private:
     }
 };
 
+template <typename Transport>
+basic_http_client<Transport>::basic_http_client()
+    :pimpl_{std::make_unique<impl>()}
+{}
+
+template <typename Transport>
+basic_http_client<Transport>::~basic_http_client() {
+    pimpl_.reset();
+}
+
+template <typename Transport>
+basic_http_client<Transport>::basic_http_client(basic_http_client&& other)
+    :pimpl_{std::move(other.pimpl_)}
+{}
+
+template <typename Transport>
+basic_http_client<Transport>& basic_http_client<Transport>::operator=(basic_http_client&& other) {
+    pimpl_ = std::move(other.pimpl_);
+    return *this;
+}
+
+template <typename Transport>
+boost::asio::awaitable<http_response>
+basic_http_client<Transport>::fetch(
+    const std::string& host,
+    const std::string& port,
+    const http_request& request
+)
+{
+    /* handed back rather than co_awaited, saving a coroutine frame per fetch */
+    return pimpl_->fetch(host, port, request);
+}
+
+template <typename Transport>
+void
+basic_http_client<Transport>::set_socket_options(const socket_options& options) {
+    pimpl_->socket_options_ = options;
+}
+
+template <typename Transport>
+void
+basic_http_client<Transport>::set_dns_resolver(std::shared_ptr<dns_resolver> resolver) {
+    pimpl_->dns_resolver_ = std::move(resolver);
+}
+
+template <typename Transport>
+void
+basic_http_client<Transport>::set_tls_shutdown_policy(tls_shutdown_policy policy) {
+    pimpl_->tls_shutdown_ = policy;
+}
+
+template class basic_http_client<plain_transport>;
+template class basic_http_client<tls_transport>;
+template class basic_http_client<unix_transport>;
+
+
+struct http_client::impl {
+    plain_http_client plain;
+    tls_http_client tls;
+    unix_http_client local;
+
+    /* the same settings again, for fetch_then */
+    detail::fetch_settings settings;
+};
+
 http_client::http_client()
     :pimpl_{std::make_unique<impl>()}
 {}
@@ -326,34 +611,56 @@ http_client::fetch(
     const http_request& request
 )
 {
-    /* parse host for http prefix to decide which protocol to use
-     * (http or https) */
-    bool use_ssl = false;
-    std::string token{"://"};
+    auto target = detail::parse_fetch_host(host);
+    LOG_TRACE << "Commencing fetching from host: " <<  target.host;
 
-    std::size_t idx = host.find(token);
-    if (idx != std::string::npos) {
-        auto prefix = host.substr(0, idx);
-        if (prefix == "https") {
-            use_ssl = true;
-        } else if (prefix == "http") {
-            use_ssl = false;
-        } else {
-            throw std::invalid_argument("Unrecognized prefix: " + prefix);
-        }
+    if (target.use_unix) {
+        auto resp = co_await pimpl_->local.fetch(target.host, port, request);
+        co_return resp;
+    } else if (target.use_ssl) {
+        auto resp = co_await pimpl_->tls.fetch(target.host, port, request);
+        co_return resp;
+    } else {
+        auto resp = co_await pimpl_->plain.fetch(target.host, port, request);
+        co_return resp;
     }
+}
 
-    const std::string host_to_use = (idx != std::string::npos) ? host.substr(idx + token.length()) : host;
-    LOG_TRACE << "Commencing fetching from host: " <<  host_to_use;
+void
+http_client::set_socket_options(const socket_options& options) {
+    pimpl_->plain.set_socket_options(options);
+    pimpl_->tls.set_socket_options(options);
+    pimpl_->local.set_socket_options(options);
+    pimpl_->settings.options = options;
+}
+
+void
+http_client::set_dns_resolver(std::shared_ptr<dns_resolver> resolver) {
+    pimpl_->plain.set_dns_resolver(resolver);
+    pimpl_->tls.set_dns_resolver(resolver);
+    pimpl_->settings.resolver = std::move(resolver);
+}
 
-    auto resp = co_await pimpl_->fetch(
-        host_to_use,
-        port,
-        request,
-        use_ssl
-    );
+void
+http_client::set_tls_shutdown_policy(tls_shutdown_policy policy) {
+    pimpl_->tls.set_tls_shutdown_policy(policy);
+    pimpl_->settings.tls_shutdown = policy;
+}
 
-    co_return resp;
+void 
+http_client::fetch_then(
+    const std::string& host,
+    const std::string& port,
+    const http_request& request,
+    std::function<void(http_response&&)> callback
+)
+{
+    detail::start_fetch_for_host(
+        [callback = std::move(callback)](boost::system::error_code ec, http_response resp) {
+            /* errors are logged by async_fetch, the callback only sees responses */
+            if (!ec) callback(std::move(resp));
+        },
+        host, port, request, pimpl_->settings);
 }
 
 void 
@@ -361,21 +668,20 @@ http_client::fetch_then(
     const std::string& host,
     const std::string& port,
     const http_request& request,
+    compute_pool& pool,
     std::function<void(http_response&&)> callback
 )
 {
-    boost::asio::co_spawn(
-        get_io_context(), 
-        [host = std::move(host),
-         port = std::move(port),
-         request = std::move(request),
-         callback = std::move(callback)
-        ]() -> boost::asio::awaitable<void> {
-            http_client temp_client;
-            
-            auto resp = co_await temp_client.fetch(host, port, request);
-            callback(std::move(resp));
-    }, boost::asio::detached);
+    detail::start_fetch_for_host(
+        [&pool, callback = std::move(callback)](boost::system::error_code ec, http_response resp) mutable {
+            if (ec) return;
+
+            /* the io thread goes straight back to I/O, the handler runs on the pool */
+            pool.post([callback = std::move(callback), resp = std::move(resp)]() mutable {
+                callback(std::move(resp));
+            });
+        },
+        host, port, request, pimpl_->settings);
 }
 
 http_client::http_client(http_client&& other)
@@ -0,0 +1,455 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/experimental/as_tuple.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/system/system_error.hpp>
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "resilient_websocket_client.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+struct resilient_websocket_client::impl : std::enable_shared_from_this<impl> {
+    using clock = std::chrono::steady_clock;
+
+    explicit impl(const resilient_websocket_options& options)
+        :options_{options}
+    {}
+
+    boost::asio::awaitable<bool> connect(
+        const std::string& host,
+        const std::string& port,
+        const std::string& target
+    )
+    {
+        /* websocket_client takes the prefixed host, the resolver the bare one */
+        const std::string token{"://"};
+        const std::size_t idx = host.find(token);
+        if (idx != std::string::npos) {
+            const auto prefix = host.substr(0, idx);
+            if (prefix != "ws" && prefix != "wss") {
+                throw std::invalid_argument("Unrecognized prefix: " + prefix);
+            }
+        }
+
+        host_ = host;
+        bare_host_ = (idx != std::string::npos) ? host.substr(idx + token.length()) : host;
+        port_ = port;
+        target_ = target;
+
+        auto ex = co_await boost::asio::this_coro::executor;
+        failed_over_.emplace(ex, clock::time_point::max());
+        standby_timer_.emplace(ex, clock::time_point::max());
+        closing_ = false;
+
+        const bool resolved = co_await resolve();
+        if (!resolved) {
+            co_return false;
+        }
+
+        active_address_ = 0;
+        auto client = co_await open(active_address_);
+        if (!client) {
+            co_return false;
+        }
+
+        const bool ready = co_await activate(*client);
+        if (!ready) {
+            close(client);
+            co_return false;
+        }
+
+        active_ = std::move(client);
+        ++generation_;
+
+        if (options_.warm_standby) {
+            boost::asio::co_spawn(ex, keep_standby(shared_from_this()), boost::asio::detached);
+        }
+
+        co_return true;
+    }
+
+    /* runs op on the active connection, failing over and retrying until it
+     * succeeds or the client is disconnected */
+    template <typename T, typename Op>
+    boost::asio::awaitable<T> with_failover(Op op) {
+        while (true) {
+            if (closing_ || !active_) {
+                throw websocket_server_disconnected_exception("Connection is not open");
+            }
+
+            const auto generation = generation_;
+
+            /* keeps the client alive until op completes, even once a failover
+             * has retired it */
+            auto client = active_;
+
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await op(*client);
+                    co_return;
+                } else {
+                    auto result = co_await op(*client);
+
+                    /* a dropped connection reads as an empty message at eof */
+                    if (client->is_connected()) {
+                        co_return result;
+                    }
+                }
+            } catch (const websocket_server_disconnected_exception& e) {
+                LOG_TRACE << "Active connection lost: " << e.what();
+            } catch (const boost::system::system_error& e) {
+                LOG_TRACE << "Active connection failed: " << e.what();
+            }
+
+            if (closing_) {
+                throw websocket_server_disconnected_exception("Connection is not open");
+            }
+
+            co_await fail_over(generation);
+        }
+    }
+
+    /* replaces the active connection, unless someone already did since generation */
+    boost::asio::awaitable<void> fail_over(std::uint64_t generation) {
+        if (generation != generation_) {
+            co_return;
+        }
+
+        if (failing_over_) {
+            co_await failed_over_->async_wait(boost::asio::experimental::as_tuple(boost::asio::use_awaitable));
+            co_return;
+        }
+
+        failing_over_ = true;
+        const auto detected = clock::now();
+
+        retire(active_);
+
+        if (standby_ && standby_->is_connected()) {
+            auto client = std::move(standby_);
+            const auto address = standby_address_;
+
+            const bool ready = co_await activate(*client);
+            if (ready && !closing_) {
+                active_ = std::move(client);
+                active_address_ = address;
+                ++stats_.failovers;
+
+                LOG_TRACE << "Failed over to standby connection";
+            } else {
+                close(client);
+            }
+        }
+
+        auto delay = options_.reconnect_delay;
+        boost::asio::steady_timer backoff{co_await boost::asio::this_coro::executor};
+
+        while (!active_ && !closing_) {
+            active_address_ = (active_address_ + 1) % addresses_.size();
+
+            auto client = co_await open(active_address_);
+            if (client) {
+                const bool ready = co_await activate(*client);
+                if (ready && !closing_) {
+                    active_ = std::move(client);
+                    ++stats_.cold_reconnects;
+
+                    LOG_TRACE << "Reconnected without a standby";
+                    break;
+                }
+
+                close(client);
+            }
+
+            backoff.expires_after(delay);
+            co_await backoff.async_wait(boost::asio::experimental::as_tuple(boost::asio::use_awaitable));
+            delay = std::min(delay * 2, options_.max_reconnect_delay);
+
+            /* the addresses may have moved */
+            co_await resolve();
+        }
+
+        if (active_) {
+            const auto gap = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - detected);
+            stats_.last_gap = gap;
+            stats_.max_gap = std::max(stats_.max_gap, gap);
+            stats_.total_gap += gap;
+        }
+
+        /* off the switch's path, as destroying a client is not free. Operations
+         * still pending on one hold it until they complete */
+        retired_.clear();
+
+        ++generation_;
+        failing_over_ = false;
+        failed_over_->cancel();
+
+        /* only now, so that opening it does not compete with the switch: the
+         * keeper opens the next standby straight away */
+        if (!standby_) {
+            standby_timer_->cancel();
+        }
+    }
+
+    /* the only writer of standby_: opens one, replaces it when it gets old, and
+     * opens the next one when a failover has taken it */
+    static boost::asio::awaitable<void> keep_standby(std::shared_ptr<impl> self) {
+        auto delay = self->options_.reconnect_delay;
+
+        while (!self->closing_) {
+            const auto address = self->standby_address_index();
+            auto client = co_await self->open(address);
+
+            if (self->closing_) {
+                close(client);
+                break;
+            }
+
+            if (client) {
+                close(self->standby_);
+                self->standby_ = std::move(client);
+                self->standby_address_ = address;
+                ++self->stats_.standby_connects;
+
+                delay = self->options_.reconnect_delay;
+                self->standby_timer_->expires_after(self->options_.standby_max_age);
+            } else {
+                self->standby_timer_->expires_after(delay);
+                delay = std::min(delay * 2, self->options_.max_reconnect_delay);
+            }
+
+            co_await self->standby_timer_->async_wait(boost::asio::experimental::as_tuple(boost::asio::use_awaitable));
+        }
+    }
+
+    std::size_t standby_address_index() const {
+        if (options_.standby_on_different_address && addresses_.size() > 1) {
+            return (active_address_ + 1) % addresses_.size();
+        }
+        return active_address_;
+    }
+
+    /* returns false, keeping the previous addresses, if resolution fails */
+    boost::asio::awaitable<bool> resolve() {
+        using boost::asio::experimental::as_tuple;
+
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::resolver::results_type results;
+
+        if (options_.resolver) {
+            try {
+                results = co_await options_.resolver->resolve(bare_host_, port_);
+            } catch (const boost::system::system_error& e) {
+                ec = e.code();
+            }
+        } else {
+            boost::asio::ip::tcp::resolver resolver{co_await boost::asio::this_coro::executor};
+            auto [resolve_ec, resolved] = co_await resolver.async_resolve(bare_host_, port_, as_tuple(boost::asio::use_awaitable));
+            ec = resolve_ec;
+            results = std::move(resolved);
+        }
+
+        if (ec) {
+            LOG_ERROR << "Domain name resolution failed for " << bare_host_ << ":" << port_ << " with error: " << ec.message();
+            co_return false;
+        }
+
+        std::vector<std::string> addresses;
+        for (const auto& entry : results) {
+            auto address = entry.endpoint().address().to_string();
+            if (std::find(addresses.begin(), addresses.end(), address) == addresses.end()) {
+                addresses.push_back(std::move(address));
+            }
+        }
+
+        if (!addresses.empty()) {
+            addresses_ = std::move(addresses);
+        }
+
+        co_return !addresses_.empty();
+    }
+
+    /* nullptr if the connection could not be made */
+    boost::asio::awaitable<std::shared_ptr<websocket_client>> open(std::size_t address_index) {
+        auto client = std::make_shared<websocket_client>();
+        client->set_socket_options(options_.socket);
+        client->set_write_options(options_.write);
+        client->set_compression_options(options_.compression);
+        client->set_ping_options(options_.ping);
+
+        const auto& address = addresses_[address_index % addresses_.size()];
+        bool connected = false;
+
+        try {
+            connected = co_await client->connect(host_, port_, target_, address);
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Connection to " << address << " failed: " << e.what();
+        }
+
+        if (!connected) {
+            client.reset();
+        }
+
+        co_return client;
+    }
+
+    boost::asio::awaitable<bool> activate(websocket_client& client) {
+        if (!handshake_) {
+            co_return true;
+        }
+
+        try {
+            co_await handshake_(client);
+            co_return true;
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Handshake failed: " << e.what();
+            co_return false;
+        }
+    }
+
+    /* for connections nothing is pending on: the standby, or one never handed out */
+    static void close(std::shared_ptr<websocket_client>& client) {
+        if (!client) {
+            return;
+        }
+
+        try {
+            client->disconnect();
+        } catch (const std::exception& e) {
+            LOG_TRACE << "Closing a failed connection: " << e.what();
+        }
+
+        client.reset();
+    }
+
+    /* for the active connection: closes it, and keeps it until the failover
+     * is done. with_failover() holds its own reference for a read or write
+     * still pending on it, which has to complete (with an error) first */
+    void retire(std::shared_ptr<websocket_client>& client) {
+        if (!client) {
+            return;
+        }
+
+        auto retiring = std::move(client);
+        try {
+            retiring->disconnect();
+        } catch (const std::exception& e) {
+            LOG_TRACE << "Closing a failed connection: " << e.what();
+        }
+
+        retired_.push_back(std::move(retiring));
+    }
+
+    void disconnect() {
+        closing_ = true;
+
+        if (standby_timer_) {
+            standby_timer_->cancel();
+        }
+
+        close(standby_);
+        retire(active_);
+    }
+
+    bool is_connected() const {
+        return !closing_ && active_ && active_->is_connected();
+    }
+
+    resilient_websocket_options options_;
+    handshake_function handshake_;
+    resilient_websocket_stats stats_{};
+
+private:
+    std::string host_;
+    std::string bare_host_;
+    std::string port_;
+    std::string target_;
+    std::vector<std::string> addresses_;
+
+    std::shared_ptr<websocket_client> active_;
+    std::size_t active_address_ = 0;
+
+    std::shared_ptr<websocket_client> standby_;
+    std::size_t standby_address_ = 0;
+
+    std::vector<std::shared_ptr<websocket_client>> retired_;
+
+    /* bumped whenever active_ is replaced */
+    std::uint64_t generation_ = 0;
+    bool failing_over_ = false;
+    bool closing_ = false;
+
+    /* cancelled when a failover completes, for operations that failed meanwhile */
+    std::optional<boost::asio::steady_timer> failed_over_;
+
+    /* wakes the standby keeper */
+    std::optional<boost::asio::steady_timer> standby_timer_;
+};
+
+resilient_websocket_client::resilient_websocket_client(const resilient_websocket_options& options)
+    :pimpl_{std::make_shared<impl>(options)}
+{}
+
+resilient_websocket_client::~resilient_websocket_client() {
+    pimpl_->disconnect();
+}
+
+void resilient_websocket_client::set_handshake(handshake_function handshake) {
+    pimpl_->handshake_ = std::move(handshake);
+}
+
+boost::asio::awaitable<bool> resilient_websocket_client::connect(
+    const std::string& host,
+    const std::string& port,
+    const std::string& target
+)
+{
+    auto resp = co_await pimpl_->connect(host, port, target);
+    co_return resp;
+}
+
+bool resilient_websocket_client::is_connected() const {
+    return pimpl_->is_connected();
+}
+
+boost::asio::awaitable<std::string> resilient_websocket_client::read() {
+    return pimpl_->with_failover<std::string>([](websocket_client& client) {
+        return client.read();
+    });
+}
+
+boost::asio::awaitable<ws_message> resilient_websocket_client::read_view() {
+    return pimpl_->with_failover<ws_message>([](websocket_client& client) {
+        return client.read_view();
+    });
+}
+
+boost::asio::awaitable<void> resilient_websocket_client::write(const std::string& message) {
+    return pimpl_->with_failover<void>([message = std::string_view{message}](websocket_client& client) {
+        return client.write(message, ws_message_type::text);
+    });
+}
+
+boost::asio::awaitable<void> resilient_websocket_client::write(std::string_view message, ws_message_type type) {
+    return pimpl_->with_failover<void>([message, type](websocket_client& client) {
+        return client.write(message, type);
+    });
+}
+
+void resilient_websocket_client::disconnect() {
+    pimpl_->disconnect();
+}
+
+resilient_websocket_stats resilient_websocket_client::stats() const {
+    return pimpl_->stats_;
+}
+
+} // ns zclient
@@ -0,0 +1,649 @@
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/experimental/as_tuple.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "async_fetch.hpp"
+#include "segmented_download.hpp"
+#include "transport.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+namespace {
+
+namespace http = boost::beast::http;
+using boost::asio::ip::tcp;
+
+/* body bytes read per segment before they are written out */
+constexpr std::size_t read_chunk_size = 256 * 1024;
+
+constexpr char control_magic[8] = {'Z', 'D', 'L', 'C', 'T', 'L', '1', '\0'};
+
+/* bytes [start, end) of the file, of which the first done are on disk */
+struct segment {
+    std::uint64_t start;
+    std::uint64_t end;
+    std::uint64_t done;
+
+    std::uint64_t remaining() const { return end - start - done; }
+};
+
+[[noreturn]] void throw_errno(const std::string& what) {
+    throw boost::system::system_error(errno, boost::system::system_category(), what);
+}
+
+/* a file descriptor written at explicit offsets, so segments need no shared
+ * file position */
+class posix_file {
+public:
+    posix_file(const std::string& path, int flags)
+        :fd_{::open(path.c_str(), flags | O_CLOEXEC, 0644)}
+    {
+        if (fd_ < 0) {
+            throw_errno("open " + path);
+        }
+    }
+
+    ~posix_file() {
+        ::close(fd_);
+    }
+
+    posix_file(const posix_file&) = delete;
+    posix_file& operator=(const posix_file&) = delete;
+
+    void write_at(const void* data, std::size_t size, std::uint64_t offset) {
+        const auto* p = static_cast<const char*>(data);
+        while (size) {
+            const auto n = ::pwrite(fd_, p, size, static_cast<off_t>(offset));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw_errno("pwrite");
+            }
+            p += n;
+            size -= n;
+            offset += n;
+        }
+    }
+
+    void resize(std::uint64_t size) {
+        if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            throw_errno("ftruncate");
+        }
+    }
+
+    /* reserves the blocks up front, so a full disk fails the download now
+     * rather than midway and out of order writes do not fragment the file */
+    void allocate(std::uint64_t size) {
+#ifdef __linux__
+        if (size == 0 || ::fallocate(fd_, 0, 0, static_cast<off_t>(size)) == 0) {
+            resize(size);
+            return;
+        }
+        /* filesystems without fallocate() get a sparse file */
+#endif
+        resize(size);
+    }
+
+    std::uint64_t size() const {
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) {
+            throw_errno("fstat");
+        }
+        return static_cast<std::uint64_t>(st.st_size);
+    }
+
+private:
+    int fd_;
+};
+
+/* Progress of a download, kept next to it until it completes: magic, size,
+ * validator, then start/end/done of every segment. done is rewritten in place
+ * after each write to the download, never ahead of it. Host byte order, the
+ * file is only ever read back on the machine that wrote it */
+class control_file {
+public:
+    struct contents {
+        std::uint64_t size;
+        std::string validator;
+        std::vector<segment> segments;
+    };
+
+    /* nullopt if there is no control file or it does not make sense */
+    static std::optional<contents> load(const std::string& path) {
+        std::ifstream in{path, std::ios::binary};
+        if (!in) {
+            return std::nullopt;
+        }
+        const std::string data{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+
+        std::size_t pos = sizeof(control_magic);
+        const auto read_u64 = [&data, &pos](std::uint64_t& out) {
+            if (pos + sizeof(out) > data.size()) return false;
+            std::memcpy(&out, data.data() + pos, sizeof(out));
+            pos += sizeof(out);
+            return true;
+        };
+
+        if (data.compare(0, sizeof(control_magic), control_magic, sizeof(control_magic)) != 0) {
+            return std::nullopt;
+        }
+
+        contents c;
+        std::uint64_t validator_size = 0;
+        std::uint64_t count = 0;
+        if (!read_u64(c.size) || !read_u64(validator_size) || validator_size > data.size() - pos) {
+            return std::nullopt;
+        }
+        c.validator = data.substr(pos, validator_size);
+        pos += validator_size;
+
+        if (!read_u64(count) || count > data.size() / (3 * sizeof(std::uint64_t))) {
+            return std::nullopt;
+        }
+
+        for (std::uint64_t i = 0; i < count; ++i) {
+            segment s;
+            if (!read_u64(s.start) || !read_u64(s.end) || !read_u64(s.done)
+                || s.start > s.end || s.end > c.size || s.done > s.end - s.start) {
+                return std::nullopt;
+            }
+            c.segments.push_back(s);
+        }
+
+        return c;
+    }
+
+    control_file(std::string path, const contents& c)
+        :path_{std::move(path)}
+        ,file_{path_, O_RDWR | O_CREAT | O_TRUNC}
+    {
+        std::string header{control_magic, sizeof(control_magic)};
+        append_u64(header, c.size);
+        append_u64(header, c.validator.size());
+        header += c.validator;
+        append_u64(header, c.segments.size());
+
+        records_offset_ = header.size();
+        for (const auto& s : c.segments) {
+            append_u64(header, s.start);
+            append_u64(header, s.end);
+            append_u64(header, s.done);
+        }
+
+        file_.write_at(header.data(), header.size(), 0);
+    }
+
+    void record(std::size_t index, std::uint64_t done) {
+        file_.write_at(&done, sizeof(done), records_offset_ + (index * 3 + 2) * sizeof(std::uint64_t));
+    }
+
+    void remove() {
+        ::unlink(path_.c_str());
+    }
+
+private:
+    static void append_u64(std::string& out, std::uint64_t v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    std::string path_;
+    posix_file file_;
+    std::size_t records_offset_ = 0;
+};
+
+struct content_range {
+    std::uint64_t first;
+    std::uint64_t last;
+    std::uint64_t total;
+};
+
+/* "bytes first-last/total", or "bytes * /total" for an unsatisfiable range
+ * (with first and last left 0) */
+std::optional<content_range> parse_content_range(boost::beast::string_view header) {
+    std::string_view v{header.data(), header.size()};
+    if (v.substr(0, 6) != "bytes ") {
+        return std::nullopt;
+    }
+    v.remove_prefix(6);
+
+    const auto number = [&v](std::uint64_t& out) {
+        auto [end, ec] = std::from_chars(v.data(), v.data() + v.size(), out);
+        if (ec != std::errc{}) return false;
+        v.remove_prefix(end - v.data());
+        return true;
+    };
+    const auto separator = [&v](char c) {
+        if (v.empty() || v.front() != c) return false;
+        v.remove_prefix(1);
+        return true;
+    };
+
+    content_range r{0, 0, 0};
+    if (separator('*')) {
+        if (!separator('/') || !number(r.total) || !v.empty()) return std::nullopt;
+        return r;
+    }
+
+    if (!number(r.first) || !separator('-') || !number(r.last) || !separator('/') || !number(r.total)
+        || !v.empty() || r.last < r.first || r.last >= r.total) {
+        return std::nullopt;
+    }
+    return r;
+}
+
+/* what identifies this version of the file: the ETag, or Last-Modified without one */
+std::string validator_of(const http::response_header<>& res) {
+    auto validator = res[http::field::etag];
+    if (validator.empty()) {
+        validator = res[http::field::last_modified];
+    }
+    return std::string(validator);
+}
+
+template <typename Transport>
+class segmented_download {
+public:
+    static constexpr bool use_ssl = std::is_same_v<Transport, tls_transport>;
+
+    using stream_type = std::conditional_t<use_ssl,
+        boost::beast::ssl_stream<boost::beast::tcp_stream>,
+        boost::beast::tcp_stream>;
+
+    using parser_type = http::response_parser<http::buffer_body>;
+
+    segmented_download(std::string host, std::string port, std::string target, std::string path, const download_options& options)
+        :host_{std::move(host)}
+        ,port_{std::move(port)}
+        ,target_{std::move(target)}
+        ,path_{std::move(path)}
+        ,options_{options}
+    {}
+
+    /* on a strand, which every segment shares */
+    boost::asio::awaitable<download_result> run() {
+        const bool ranges = co_await probe();
+        if (ranges) {
+            prepare();
+            co_await run_segments();
+
+            if (file_->size() != size_) {
+                throw download_mismatch_exception(path_ + " ended up " + std::to_string(file_->size()) + " bytes instead of " + std::to_string(size_));
+            }
+            control_->remove();
+        }
+
+        LOG_TRACE << "Downloaded " << host_ << target_ << " to " << path_ << ", " << bytes_transferred_ << " of " << size_ << " bytes transferred";
+
+        co_return download_result{
+            .size = size_,
+            .validator = validator_,
+            .segments = segments_.size(),
+            .bytes_transferred = bytes_transferred_,
+            .resumed = resumed_
+        };
+    }
+
+private:
+    std::string host_;
+    std::string port_;
+    std::string target_;
+    std::string path_;
+    download_options options_;
+
+    std::uint64_t size_ = 0;
+    std::string validator_;
+    std::vector<segment> segments_;
+    std::optional<posix_file> file_;
+    std::optional<control_file> control_;
+    std::uint64_t bytes_transferred_ = 0;
+    bool resumed_ = false;
+
+    boost::asio::awaitable<stream_type> connect() {
+        using boost::asio::use_awaitable;
+
+        auto ex = co_await boost::asio::this_coro::executor;
+
+        tcp::resolver::results_type results;
+        if (options_.resolver) {
+            results = co_await options_.resolver->resolve(host_, port_);
+        } else {
+            tcp::resolver resolver{ex};
+            results = co_await resolver.async_resolve(host_, port_, use_awaitable);
+        }
+
+        auto stream = make_stream(ex);
+        auto& lowest = boost::beast::get_lowest_layer(stream);
+
+        lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+        co_await lowest.async_connect(results, use_awaitable);
+        apply_socket_options(lowest.socket(), options_.socket);
+
+        if constexpr (use_ssl) {
+            // Set SNI Hostname (many hosts need this to handshake successfully)
+            if (!SSL_set_tlsext_host_name(stream.native_handle(), host_.c_str())) {
+                throw boost::system::system_error(static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category());
+            }
+
+            lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            co_await stream.async_handshake(boost::asio::ssl::stream_base::client, use_awaitable);
+        }
+
+        co_return stream;
+    }
+
+    template <typename Executor>
+    static stream_type make_stream(const Executor& ex) {
+        if constexpr (use_ssl) {
+            return stream_type{boost::beast::tcp_stream{ex}, detail::shared_ssl_context()};
+        } else {
+            return stream_type{ex};
+        }
+    }
+
+    /* sends a GET for range and reads the response's header into parser */
+    boost::asio::awaitable<void> request_range(stream_type& stream, boost::beast::flat_buffer& buffer,
+                                               parser_type& parser, const std::string& range, bool if_range)
+    {
+        using boost::asio::use_awaitable;
+
+        http_request request{.method = http_method::get, .path = target_};
+        request.header_data.emplace_back("Range", range);
+
+        /* a changed file is then answered with 200 and the whole body, never
+         * with a range of the new version. Weak ETags are not allowed there */
+        if (if_range && !validator_.empty() && validator_.rfind("W/", 0) != 0) {
+            request.header_data.emplace_back("If-Range", validator_);
+        }
+
+        auto req = detail::translate_http_request(host_, request);
+        auto& lowest = boost::beast::get_lowest_layer(stream);
+
+        lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+        co_await http::async_write(stream, req, use_awaitable);
+
+        parser.body_limit(std::numeric_limits<std::uint64_t>::max());
+        lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+        co_await http::async_read_header(stream, buffer, parser, use_awaitable);
+    }
+
+    /* writes the body parser is reading to the file where segment index
+     * stands, recording the progress as it lands */
+    boost::asio::awaitable<void> read_body(stream_type& stream, boost::beast::flat_buffer& buffer,
+                                           parser_type& parser, std::size_t index)
+    {
+        using boost::asio::use_awaitable;
+        using boost::asio::experimental::as_tuple;
+
+        auto& seg = segments_[index];
+        auto& lowest = boost::beast::get_lowest_layer(stream);
+        std::vector<char> chunk(read_chunk_size);
+
+        while (!parser.is_done()) {
+            auto& body = parser.get().body();
+            body.data = chunk.data();
+            body.size = chunk.size();
+
+            lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            auto [ec, n] = co_await http::async_read(stream, buffer, parser, as_tuple(use_awaitable));
+
+            const std::size_t received = chunk.size() - parser.get().body().size;
+            if (received > seg.remaining()) {
+                throw download_mismatch_exception(host_ + target_ + " sent more than the requested range");
+            }
+
+            if (received) {
+                file_->write_at(chunk.data(), received, seg.start + seg.done);
+                seg.done += received;
+                bytes_transferred_ += received;
+                if (control_) {
+                    control_->record(index, seg.done);
+                }
+            }
+
+            if (ec && ec != http::error::need_buffer) {
+                throw boost::system::system_error(ec, "read");
+            }
+        }
+    }
+
+    /* asks for the first byte to learn the size and validator. A server
+     * without Range support answers with the whole body instead, which is
+     * streamed to the file there and then: returns false in that case */
+    boost::asio::awaitable<bool> probe() {
+        auto stream = co_await connect();
+        boost::beast::flat_buffer buffer;
+        parser_type parser;
+
+        const std::string first_byte{"bytes=0-0"};
+        co_await request_range(stream, buffer, parser, first_byte, false);
+
+        const auto& res = parser.get();
+        validator_ = validator_of(res);
+
+        if (res.result() == http::status::partial_content || res.result() == http::status::range_not_satisfiable) {
+            const auto range = parse_content_range(res[http::field::content_range]);
+            /* only an empty file has no byte 0 */
+            if (!range || (res.result() == http::status::range_not_satisfiable && range->total != 0)) {
+                throw download_mismatch_exception("Invalid Content-Range from " + host_ + target_ + ": " + std::string(res[http::field::content_range]));
+            }
+            size_ = range->total;
+            co_return true;
+        }
+
+        if (res.result() != http::status::ok) {
+            throw std::runtime_error("Download of " + host_ + target_ + " failed with HTTP status " + std::to_string(res.result_int()));
+        }
+
+        LOG_WARN << host_ << " ignored the Range request, downloading " << target_ << " over a single connection";
+
+        const auto length = parser.content_length();
+        segments_ = {segment{0, length ? *length : std::numeric_limits<std::uint64_t>::max(), 0}};
+
+        file_.emplace(path_, O_RDWR | O_CREAT | O_TRUNC);
+        if (length) {
+            file_->allocate(*length);
+        }
+        ::unlink((path_ + ".zdl").c_str());
+
+        co_await read_body(stream, buffer, parser, 0);
+
+        size_ = segments_[0].done;
+        file_->resize(size_);
+        co_return false;
+    }
+
+    std::vector<segment> split() const {
+        if (size_ == 0) {
+            return {};
+        }
+
+        const std::uint64_t by_size = std::max<std::uint64_t>(1, size_ / std::max<std::size_t>(options_.min_segment_size, 1));
+        const std::uint64_t count = std::clamp<std::uint64_t>(options_.segments, 1, by_size);
+
+        std::vector<segment> segments;
+        const auto base = size_ / count;
+        const auto extra = size_ % count;
+        std::uint64_t start = 0;
+        for (std::uint64_t i = 0; i < count; ++i) {
+            const auto length = base + (i < extra ? 1 : 0);
+            segments.push_back(segment{start, start + length, 0});
+            start += length;
+        }
+        return segments;
+    }
+
+    /* picks up the control file's segments if they belong to this version of
+     * the file, plans new ones otherwise */
+    void prepare() {
+        const auto control_path = path_ + ".zdl";
+
+        std::optional<control_file::contents> saved;
+        if (options_.resume) {
+            saved = control_file::load(control_path);
+        }
+
+        file_.emplace(path_, O_RDWR | O_CREAT);
+
+        if (saved && saved->size == size_ && saved->validator == validator_ && file_->size() == size_) {
+            segments_ = std::move(saved->segments);
+            resumed_ = true;
+            LOG_TRACE << "Resuming " << path_ << " in " << segments_.size() << " segments";
+        } else {
+            if (saved) {
+                LOG_WARN << host_ << target_ << " no longer matches the partial download in " << path_ << ", starting over";
+            }
+            segments_ = split();
+            file_->resize(0);
+            file_->allocate(size_);
+        }
+
+        control_.emplace(control_path, control_file::contents{size_, validator_, segments_});
+    }
+
+    /* runs the unfinished segments concurrently and rethrows the first failure
+     * once they have all stopped */
+    boost::asio::awaitable<void> run_segments() {
+        using boost::asio::use_awaitable;
+        using boost::asio::experimental::as_tuple;
+
+        auto ex = co_await boost::asio::this_coro::executor;
+        boost::asio::steady_timer finished{ex, std::chrono::steady_clock::time_point::max()};
+        std::size_t running = 0;
+        std::exception_ptr failure;
+
+        for (std::size_t i = 0; i < segments_.size(); ++i) {
+            if (segments_[i].remaining() == 0) {
+                continue;
+            }
+
+            ++running;
+            boost::asio::co_spawn(ex, run_segment(i), boost::asio::bind_executor(ex, [&](std::exception_ptr e) {
+                if (e && !failure) {
+                    failure = e;
+                }
+                if (--running == 0) {
+                    finished.cancel();
+                }
+            }));
+        }
+
+        if (running) {
+            co_await finished.async_wait(as_tuple(use_awaitable));
+        }
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    boost::asio::awaitable<void> run_segment(std::size_t index) {
+        auto& seg = segments_[index];
+
+        for (int attempt = 0;; ++attempt) {
+            std::string error;
+            try {
+                co_await fetch_segment(index);
+                co_return;
+            } catch (const download_mismatch_exception&) {
+                throw;
+            } catch (const std::exception& e) {
+                if (attempt >= options_.retries) {
+                    throw;
+                }
+                error = e.what();
+            }
+
+            LOG_WARN << "Segment " << index << " of " << host_ << target_ << " failed at byte " << seg.start + seg.done << ", retrying: " << error;
+
+            boost::asio::steady_timer backoff{co_await boost::asio::this_coro::executor};
+            backoff.expires_after(std::chrono::milliseconds(100) * (attempt + 1));
+            co_await backoff.async_wait(boost::asio::use_awaitable);
+        }
+    }
+
+    boost::asio::awaitable<void> fetch_segment(std::size_t index) {
+        const auto& seg = segments_[index];
+        const auto first = seg.start + seg.done;
+        const auto last = seg.end - 1;
+
+        auto stream = co_await connect();
+        boost::beast::flat_buffer buffer;
+        parser_type parser;
+
+        const auto range = "bytes=" + std::to_string(first) + "-" + std::to_string(last);
+        co_await request_range(stream, buffer, parser, range, true);
+
+        const auto& res = parser.get();
+        if (res.result() != http::status::partial_content) {
+            throw download_mismatch_exception(host_ + target_ + " answered a Range request with HTTP status "
+                + std::to_string(res.result_int()) + ", the file may have changed");
+        }
+
+        const auto received = parse_content_range(res[http::field::content_range]);
+        if (!received || received->first != first || received->last != last || received->total != size_
+            || parser.content_length() != last - first + 1) {
+            throw download_mismatch_exception(host_ + target_ + " sent " + std::string(res[http::field::content_range])
+                + " for " + range + " of " + std::to_string(size_) + " bytes");
+        }
+
+        if (!validator_.empty() && validator_of(res) != validator_) {
+            throw download_mismatch_exception(host_ + target_ + " changed on the server during the download");
+        }
+
+        co_await read_body(stream, buffer, parser, index);
+    }
+};
+
+} // anonymous ns
+
+boost::asio::awaitable<download_result> download_to_file(
+    const std::string& host,
+    const std::string& port,
+    const std::string& target,
+    const std::string& path,
+    const download_options& options
+)
+{
+    auto parsed = detail::parse_fetch_host(host);
+    if (parsed.use_unix) {
+        throw std::invalid_argument("download_to_file does not support http+unix://");
+    }
+
+    /* the segments' bookkeeping needs no locks on a strand, even with zrun() on several threads */
+    auto strand = boost::asio::make_strand(co_await boost::asio::this_coro::executor);
+
+    if (parsed.use_ssl) {
+        segmented_download<tls_transport> download{parsed.host, port, target, path, options};
+        auto job = download.run();
+        auto result = co_await boost::asio::co_spawn(strand, std::move(job), boost::asio::use_awaitable);
+        co_return result;
+    } else {
+        segmented_download<plain_transport> download{parsed.host, port, target, path, options};
+        auto job = download.run();
+        auto result = co_await boost::asio::co_spawn(strand, std::move(job), boost::asio::use_awaitable);
+        co_return result;
+    }
+}
+
+} // ns zclient
@@ -0,0 +1,566 @@
+#include <boost/asio/experimental/as_tuple.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include "async_fetch.hpp"
+#include "sse_client.hpp"
+#include "transport.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+/* sse_parser */
+
+sse_parser::sse_parser(std::size_t max_event_size)
+    :max_event_size_{max_event_size}
+{}
+
+void sse_parser::feed(std::string_view data) {
+    std::size_t pos = 0;
+
+    while (pos < data.size()) {
+        /* a CR ending the previous piece may be the first half of a CRLF */
+        if (skip_lf_) {
+            skip_lf_ = false;
+            if (data[pos] == '\n') {
+                ++pos;
+                continue;
+            }
+        }
+
+        const auto eol = data.find_first_of("\r\n", pos);
+        if (eol == std::string_view::npos) {
+            line_.append(data.substr(pos));
+            if (line_.size() + data_.size() > max_event_size_) {
+                throw std::length_error("SSE event exceeds max_event_size");
+            }
+            break;
+        }
+
+        const auto piece = data.substr(pos, eol - pos);
+        if (line_.empty()) {
+            parse_line(piece);
+        } else {
+            line_.append(piece);
+            parse_line(line_);
+            line_.clear();
+        }
+
+        skip_lf_ = data[eol] == '\r';
+        pos = eol + 1;
+    }
+}
+
+std::optional<sse_event> sse_parser::next() {
+    if (ready_pos_ == ready_.size()) {
+        ready_.clear();
+        ready_pos_ = 0;
+        return std::nullopt;
+    }
+    return std::move(ready_[ready_pos_++]);
+}
+
+void sse_parser::reset() {
+    line_.clear();
+    skip_lf_ = false;
+    at_start_ = true;
+    type_.clear();
+    data_.clear();
+    id_buffer_ = last_event_id_;
+}
+
+void sse_parser::parse_line(std::string_view line) {
+    if (at_start_) {
+        at_start_ = false;
+        if (line.substr(0, 3) == "\xEF\xBB\xBF") {
+            line.remove_prefix(3);
+        }
+    }
+
+    if (line.empty()) {
+        dispatch();
+        return;
+    }
+
+    /* a comment, which servers send as a heartbeat */
+    if (line.front() == ':') {
+        return;
+    }
+
+    const auto colon = line.find(':');
+    const auto field = line.substr(0, colon);
+    auto value = colon == std::string_view::npos ? std::string_view{} : line.substr(colon + 1);
+    if (!value.empty() && value.front() == ' ') {
+        value.remove_prefix(1);
+    }
+
+    if (field == "data") {
+        if (data_.size() + value.size() + 1 > max_event_size_) {
+            throw std::length_error("SSE event exceeds max_event_size");
+        }
+        data_.append(value);
+        data_.push_back('\n');
+    } else if (field == "event") {
+        type_.assign(value);
+    } else if (field == "id") {
+        if (value.find('\0') == std::string_view::npos) {
+            id_buffer_.assign(value);
+        }
+    } else if (field == "retry") {
+        std::uint64_t ms = 0;
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), ms);
+        if (ec == std::errc{} && end == value.data() + value.size()) {
+            retry_ = std::chrono::milliseconds(ms);
+        }
+    }
+    /* other fields are ignored */
+}
+
+void sse_parser::dispatch() {
+    /* the id counts as received with the event, not before */
+    last_event_id_ = id_buffer_;
+
+    if (data_.empty()) {
+        type_.clear();
+        return;
+    }
+
+    data_.pop_back();
+    ready_.push_back(sse_event{
+        .type = type_.empty() ? "message" : std::move(type_),
+        .data = std::move(data_),
+        .id = last_event_id_
+    });
+
+    type_.clear();
+    data_.clear();
+}
+
+/* sse_client */
+
+namespace {
+
+namespace http = boost::beast::http;
+
+/* body bytes read per read_some() */
+constexpr std::size_t read_chunk_size = 64 * 1024;
+
+template <typename Transport>
+struct sse_connection {
+    static constexpr bool use_ssl = std::is_same_v<Transport, tls_transport>;
+    static constexpr bool use_unix = std::is_same_v<Transport, unix_transport>;
+
+    using stream_type = std::conditional_t<use_ssl,
+        boost::beast::ssl_stream<boost::beast::tcp_stream>,
+        std::conditional_t<use_unix,
+            boost::beast::basic_stream<boost::asio::local::stream_protocol>,
+            boost::beast::tcp_stream>>;
+
+    using parser_type = http::response_parser<http::buffer_body>;
+
+    template <typename Executor>
+    explicit sse_connection(const Executor& ex)
+        :stream{make_stream(ex)}
+    {}
+
+    template <typename Executor>
+    static stream_type make_stream(const Executor& ex) {
+        if constexpr (use_ssl) {
+            return stream_type{boost::beast::tcp_stream{ex}, detail::shared_ssl_context()};
+        } else {
+            return stream_type{ex};
+        }
+    }
+
+    stream_type stream;
+    boost::beast::flat_buffer buffer;
+
+    /* one per response, the connection carries the next request once the
+     * server has ended a response with keep-alive */
+    std::optional<parser_type> parser;
+    bool reusable = false;
+};
+
+} // anonymous ns
+
+struct sse_client::impl {
+    explicit impl(const sse_options& options)
+        :options_{options}
+        ,parser_{options.max_event_size}
+        ,chunk_(read_chunk_size)
+    {
+        parser_.set_last_event_id(options_.last_event_id);
+    }
+
+    boost::asio::awaitable<bool> connect(
+        const std::string& host,
+        const std::string& port,
+        const std::string& target
+    )
+    {
+        target_ = detail::parse_fetch_host(host);
+        port_ = port;
+        path_ = target;
+        closed_ = false;
+        failures_ = 0;
+        delay_timer_.emplace(co_await boost::asio::this_coro::executor);
+
+        try {
+            co_await open();
+        } catch (const sse_stream_closed_exception& e) {
+            LOG_ERROR << e.what();
+            close(e.what());
+        } catch (const std::exception& e) {
+            LOG_ERROR << "SSE connection to " << target_.host << path_ << " failed: " << e.what();
+            ++failures_;
+        }
+
+        co_return connected_;
+    }
+
+    bool is_connected() const {
+        return connected_ && !closed_;
+    }
+
+    boost::asio::awaitable<sse_event> read() {
+        for (;;) {
+            auto event = parser_.next();
+            if (event) {
+                co_return std::move(*event);
+            }
+
+            const auto data = co_await next_data();
+            parser_.feed(data);
+        }
+    }
+
+    boost::asio::awaitable<std::string> read_data() {
+        const auto data = co_await next_data();
+        co_return std::string{data};
+    }
+
+    const std::string& last_event_id() const {
+        return parser_.last_event_id();
+    }
+
+    void close(const std::string& reason) {
+        closed_ = true;
+        closed_reason_ = reason;
+        connected_ = false;
+
+        if (delay_timer_) {
+            delay_timer_->cancel();
+        }
+
+        /* fails any read in progress, which then sees closed_ */
+        boost::system::error_code ec;
+        if (plain_) boost::beast::get_lowest_layer(plain_->stream).socket().close(ec);
+        if (tls_) boost::beast::get_lowest_layer(tls_->stream).socket().close(ec);
+        if (local_) boost::beast::get_lowest_layer(local_->stream).socket().close(ec);
+    }
+
+private:
+    sse_options options_;
+    detail::fetch_target target_;
+    std::string port_;
+    std::string path_;
+
+    std::unique_ptr<sse_connection<plain_transport>> plain_;
+    std::unique_ptr<sse_connection<tls_transport>> tls_;
+    std::unique_ptr<sse_connection<unix_transport>> local_;
+
+    sse_parser parser_;
+    std::vector<char> chunk_;
+
+    bool connected_ = false;
+    bool closed_ = false;
+    std::string closed_reason_;
+
+    /* consecutive failed attempts, doubling the reconnect delay */
+    int failures_ = 0;
+    std::optional<boost::asio::steady_timer> delay_timer_;
+
+    boost::asio::awaitable<void> open() {
+        if (target_.use_unix) {
+            co_await open(local_);
+        } else if (target_.use_ssl) {
+            co_await open(tls_);
+        } else {
+            co_await open(plain_);
+        }
+    }
+
+    /* sends the request on the connection the last response left reusable, or
+     * on a new one, and reads the response's header */
+    template <typename Transport>
+    boost::asio::awaitable<void> open(std::unique_ptr<sse_connection<Transport>>& conn) {
+        using connection_type = sse_connection<Transport>;
+
+        if (conn && conn->reusable) {
+            conn->reusable = false;
+            try {
+                co_await request(*conn);
+                co_return;
+            } catch (const sse_stream_closed_exception&) {
+                throw;
+            } catch (const std::exception& e) {
+                /* the server may have closed it meanwhile */
+                LOG_TRACE << "Reused SSE connection to " << target_.host << " failed: " << e.what();
+            }
+            if (closed_) {
+                throw sse_stream_closed_exception(closed_reason_);
+            }
+        }
+
+        conn = std::make_unique<connection_type>(co_await boost::asio::this_coro::executor);
+        co_await connect(*conn);
+        if (closed_) {
+            throw sse_stream_closed_exception(closed_reason_);
+        }
+        co_await request(*conn);
+    }
+
+    template <typename Transport>
+    boost::asio::awaitable<void> connect(sse_connection<Transport>& conn) {
+        using boost::asio::use_awaitable;
+        using connection_type = sse_connection<Transport>;
+
+        auto& lowest = boost::beast::get_lowest_layer(conn.stream);
+
+        if constexpr (connection_type::use_unix) {
+            const boost::asio::local::stream_protocol::endpoint endpoint{target_.host};
+            lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            co_await lowest.async_connect(endpoint, use_awaitable);
+        } else {
+            boost::asio::ip::tcp::resolver::results_type results;
+            if (options_.resolver) {
+                results = co_await options_.resolver->resolve(target_.host, port_);
+            } else {
+                boost::asio::ip::tcp::resolver resolver{co_await boost::asio::this_coro::executor};
+                results = co_await resolver.async_resolve(target_.host, port_, use_awaitable);
+            }
+
+            lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            co_await lowest.async_connect(results, use_awaitable);
+            apply_socket_options(lowest.socket(), options_.socket);
+        }
+
+        if constexpr (connection_type::use_ssl) {
+            // Set SNI Hostname (many hosts need this to handshake successfully)
+            if (!SSL_set_tlsext_host_name(conn.stream.native_handle(), target_.host.c_str())) {
+                throw boost::system::system_error(static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category());
+            }
+
+            lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+            co_await conn.stream.async_handshake(boost::asio::ssl::stream_base::client, use_awaitable);
+        }
+    }
+
+    template <typename Transport>
+    boost::asio::awaitable<void> request(sse_connection<Transport>& conn) {
+        using boost::asio::use_awaitable;
+        using connection_type = sse_connection<Transport>;
+
+        http_request request{.method = http_method::get, .path = path_, .header_data = options_.header_data};
+        request.header_data.emplace_back("Accept", "text/event-stream");
+        request.header_data.emplace_back("Cache-Control", "no-cache");
+        if (!parser_.last_event_id().empty()) {
+            request.header_data.emplace_back("Last-Event-ID", parser_.last_event_id());
+        }
+
+        /* a unix socket's path makes no sense as the Host header */
+        auto req = detail::translate_http_request(connection_type::use_unix ? "localhost" : target_.host, request);
+        auto& lowest = boost::beast::get_lowest_layer(conn.stream);
+
+        lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+        co_await http::async_write(conn.stream, req, use_awaitable);
+
+        conn.parser.emplace();
+        conn.parser->body_limit(std::numeric_limits<std::uint64_t>::max());
+        lowest.expires_after(std::chrono::seconds(HTTP_TIMEOUT_SECONDS));
+        co_await http::async_read_header(conn.stream, conn.buffer, *conn.parser, use_awaitable);
+
+        const auto status = conn.parser->get().result_int();
+        if (status == 204) {
+            throw sse_stream_closed_exception(target_.host + path_ + " ended the event stream with HTTP status 204");
+        }
+        if (status >= 500) {
+            /* overloaded or restarting, worth another try */
+            throw std::runtime_error("HTTP status " + std::to_string(status));
+        }
+        if (status != 200) {
+            throw sse_stream_closed_exception(target_.host + path_ + " refused the event stream with HTTP status " + std::to_string(status));
+        }
+
+        LOG_TRACE << "SSE stream open from " << target_.host << path_ << ", Last-Event-ID: " << parser_.last_event_id();
+
+        parser_.reset();
+        connected_ = true;
+        failures_ = 0;
+    }
+
+    /* the next body bytes of the current response in chunk_, 0 once the
+     * server has ended it */
+    template <typename Transport>
+    boost::asio::awaitable<std::size_t> read_some(sse_connection<Transport>& conn) {
+        using boost::asio::use_awaitable;
+        using boost::asio::experimental::as_tuple;
+
+        auto& parser = *conn.parser;
+        auto& lowest = boost::beast::get_lowest_layer(conn.stream);
+
+        while (!parser.is_done()) {
+            auto& body = parser.get().body();
+            body.data = chunk_.data();
+            body.size = chunk_.size();
+
+            if (options_.idle_timeout.count()) {
+                lowest.expires_after(options_.idle_timeout);
+            } else {
+                lowest.expires_never();
+            }
+
+            /* read_some rather than read, which would wait for the whole chunk_ */
+            auto [ec, n] = co_await http::async_read_some(conn.stream, conn.buffer, parser, as_tuple(use_awaitable));
+
+            const std::size_t received = chunk_.size() - parser.get().body().size;
+            if (received) {
+                co_return received;
+            }
+            if (ec && ec != http::error::need_buffer) {
+                throw boost::system::system_error(ec, "SSE read");
+            }
+        }
+
+        conn.reusable = parser.keep_alive();
+        co_return 0;
+    }
+
+    boost::asio::awaitable<std::size_t> read_some() {
+        if (target_.use_unix) {
+            co_return co_await read_some(*local_);
+        } else if (target_.use_ssl) {
+            co_return co_await read_some(*tls_);
+        } else {
+            co_return co_await read_some(*plain_);
+        }
+    }
+
+    /* the next body bytes of the stream, reconnecting whenever it ends or fails */
+    boost::asio::awaitable<std::string_view> next_data() {
+        if (!delay_timer_) {
+            throw std::logic_error("sse_client read before connect()");
+        }
+
+        for (;;) {
+            if (closed_) {
+                throw sse_stream_closed_exception(closed_reason_);
+            }
+
+            if (!connected_) {
+                co_await reconnect();
+                continue;
+            }
+
+            try {
+                const auto n = co_await read_some();
+                if (n) {
+                    co_return std::string_view{chunk_.data(), n};
+                }
+                LOG_TRACE << target_.host << path_ << " ended the event stream";
+            } catch (const std::exception& e) {
+                if (!closed_) {
+                    LOG_WARN << "SSE stream from " << target_.host << path_ << " failed: " << e.what();
+                }
+            }
+
+            connected_ = false;
+            parser_.reset();
+        }
+    }
+
+    boost::asio::awaitable<void> reconnect() {
+        using boost::asio::use_awaitable;
+        using boost::asio::experimental::as_tuple;
+
+        const auto base = parser_.retry().value_or(options_.reconnect_delay);
+        auto delay = base;
+        for (int i = 0; i < failures_ && delay < options_.max_reconnect_delay; ++i) {
+            delay *= 2;
+        }
+        delay = std::min(delay, std::max(base, options_.max_reconnect_delay));
+
+        delay_timer_->expires_after(delay);
+        co_await delay_timer_->async_wait(as_tuple(use_awaitable));
+
+        if (closed_) {
+            throw sse_stream_closed_exception(closed_reason_);
+        }
+
+        try {
+            co_await open();
+        } catch (const sse_stream_closed_exception& e) {
+            if (!closed_) {
+                close(e.what());
+            }
+        } catch (const std::exception& e) {
+            if (!closed_) {
+                LOG_WARN << "SSE reconnection to " << target_.host << path_ << " failed: " << e.what();
+                ++failures_;
+            }
+        }
+    }
+};
+
+sse_client::sse_client(const sse_options& options)
+    :pimpl_{std::make_shared<impl>(options)}
+{}
+
+sse_client::~sse_client() {
+    pimpl_->close("sse_client destroyed");
+}
+
+boost::asio::awaitable<bool> sse_client::connect(
+    const std::string& host,
+    const std::string& port,
+    const std::string& target
+)
+{
+    auto self = pimpl_;
+    co_return co_await self->connect(host, port, target);
+}
+
+bool sse_client::is_connected() const {
+    return pimpl_->is_connected();
+}
+
+boost::asio::awaitable<sse_event> sse_client::read() {
+    auto self = pimpl_;
+    co_return co_await self->read();
+}
+
+boost::asio::awaitable<std::string> sse_client::read_data() {
+    auto self = pimpl_;
+    co_return co_await self->read_data();
+}
+
+const std::string& sse_client::last_event_id() const {
+    return pimpl_->last_event_id();
+}
+
+void sse_client::disconnect() {
+    pimpl_->close("SSE stream disconnected");
+}
+
+} // ns zclient
@@ -0,0 +1,190 @@
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "thread_per_core_runtime.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+void pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+
+    if (int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset); rc != 0) {
+        LOG_ERROR << "Could not pin thread to cpu " << cpu << ", error: " << rc;
+    }
+#else
+    (void)cpu;
+    LOG_WARN << "Thread pinning is not supported on this platform";
+#endif
+}
+
+struct thread_per_core_runtime::impl {
+    struct shard {
+        /* a concurrency hint of 1 lets asio drop the scheduler locking, which is
+         * safe because only this shard's thread ever runs the io_context */
+        shard() : ioc{1} {}
+
+        boost::asio::io_context ioc;
+        std::optional<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work;
+        std::thread thread;
+        std::atomic<std::size_t> load{0};
+    };
+
+    explicit impl(runtime_options options)
+        :options_{std::move(options)}
+    {
+        unsigned n = options_.threads ? options_.threads : std::thread::hardware_concurrency();
+        if (n == 0) n = 1;
+
+        shards_.reserve(n);
+        for (unsigned i = 0; i < n; ++i) {
+            shards_.push_back(std::make_unique<shard>());
+        }
+    }
+
+    ~impl() {
+        stop();
+    }
+
+    void start() {
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            auto& s = *shards_[i];
+            if (s.thread.joinable()) continue;
+
+            s.ioc.restart();
+            s.work.emplace(s.ioc.get_executor());
+
+            int cpu = -1;
+            if (options_.pin_threads) {
+                cpu = i < options_.cpus.size() ? options_.cpus[i] : static_cast<int>(i);
+            }
+
+            s.thread = std::thread{[&s, cpu, busy_poll = options_.busy_poll]() {
+                if (cpu >= 0) pin_current_thread(cpu);
+
+                if (busy_poll) {
+                    auto poll_options = *busy_poll;
+                    poll_options.cpu = -1; /* pinning is the runtime's call */
+                    run_busy_poll(s.ioc, poll_options);
+                } else {
+                    s.ioc.run();
+                }
+            }};
+        }
+    }
+
+    void stop() {
+        for (auto& s : shards_) {
+            s->work.reset();
+            s->ioc.stop();
+        }
+
+        for (auto& s : shards_) {
+            if (s->thread.joinable()) s->thread.join();
+        }
+    }
+
+    std::size_t least_loaded_shard() const {
+        /* rotate the starting point so ties are spread instead of always landing on shard 0 */
+        const std::size_t start = next_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+
+        std::size_t best = start;
+        std::size_t best_load = std::numeric_limits<std::size_t>::max();
+
+        for (std::size_t k = 0; k < shards_.size(); ++k) {
+            const std::size_t i = (start + k) % shards_.size();
+            const std::size_t l = shards_[i]->load.load(std::memory_order_relaxed);
+            if (l < best_load) {
+                best = i;
+                best_load = l;
+            }
+        }
+
+        return best;
+    }
+
+    void spawn_on(std::size_t index, std::function<boost::asio::awaitable<void>()> async_fcn) {
+        if (index >= shards_.size()) {
+            throw std::out_of_range("No such shard: " + std::to_string(index));
+        }
+
+        auto& s = *shards_[index];
+        s.load.fetch_add(1, std::memory_order_relaxed);
+
+        boost::asio::co_spawn(s.ioc, std::move(async_fcn), [&s](const std::exception_ptr& e) {
+            s.load.fetch_sub(1, std::memory_order_relaxed);
+
+            if (e != nullptr) {
+                try {
+                    std::rethrow_exception(e);
+                }
+                catch (std::exception const& ex) {
+                    std::cerr << "Asynchronous execution failed with: " << ex.what() << std::endl;
+                    throw ex;
+                }
+            }
+        });
+    }
+
+    runtime_options options_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    mutable std::atomic<std::size_t> next_{0};
+};
+
+thread_per_core_runtime::thread_per_core_runtime(runtime_options options)
+    :pimpl_{std::make_unique<impl>(std::move(options))}
+{}
+
+thread_per_core_runtime::~thread_per_core_runtime() {
+    pimpl_.reset();
+}
+
+void thread_per_core_runtime::start() {
+    pimpl_->start();
+}
+
+void thread_per_core_runtime::stop() {
+    pimpl_->stop();
+}
+
+std::size_t thread_per_core_runtime::size() const {
+    return pimpl_->shards_.size();
+}
+
+boost::asio::io_context& thread_per_core_runtime::shard(std::size_t index) {
+    return pimpl_->shards_.at(index)->ioc;
+}
+
+std::size_t thread_per_core_runtime::load(std::size_t index) const {
+    return pimpl_->shards_.at(index)->load.load(std::memory_order_relaxed);
+}
+
+std::size_t thread_per_core_runtime::least_loaded_shard() const {
+    return pimpl_->least_loaded_shard();
+}
+
+void thread_per_core_runtime::spawn_on(std::size_t index, std::function<boost::asio::awaitable<void>()> async_fcn) {
+    pimpl_->spawn_on(index, std::move(async_fcn));
+}
+
+std::size_t thread_per_core_runtime::spawn(std::function<boost::asio::awaitable<void>()> async_fcn) {
+    const std::size_t index = pimpl_->least_loaded_shard();
+    pimpl_->spawn_on(index, std::move(async_fcn));
+    return index;
+}
+
+} // ns zclient
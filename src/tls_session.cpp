@@ -0,0 +1,144 @@
+#include <boost/asio/ssl/error.hpp>
+#include <boost/system/system_error.hpp>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+
+#include "tls_session.hpp"
+#include "zlogger.hpp"
+
+namespace zclient::detail {
+
+namespace {
+
+/* the cache on the SSL_CTX, and the key the sessions of an SSL go under */
+int ctx_index() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+int ssl_index() {
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+        [](void*, void* key, CRYPTO_EX_DATA*, int, long, void*) {
+            delete static_cast<std::string*>(key);
+        });
+    return index;
+}
+
+} // anonymous ns
+
+tls_session_cache::tls_session_cache(boost::asio::ssl::context& ctx, std::size_t capacity)
+    :ctx_{ctx.native_handle()}
+    ,capacity_{capacity}
+{
+    /* OpenSSL only hands client sessions to the callback, the lookup is ours */
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_set_ex_data(ctx_, ctx_index(), this);
+    SSL_CTX_sess_set_new_cb(ctx_, &tls_session_cache::on_new_session);
+}
+
+tls_session_cache::~tls_session_cache() {
+    /* a background shutdown can still receive a ticket after the cache is gone */
+    SSL_CTX_set_ex_data(ctx_, ctx_index(), nullptr);
+}
+
+std::size_t tls_session_cache::resume(SSL* ssl, const std::string& key) {
+    SSL_set_ex_data(ssl, ssl_index(), new std::string{key});
+
+    std::unique_ptr<SSL_SESSION, session_deleter> session;
+    {
+        std::lock_guard lock{mutex_};
+        auto it = sessions_.find(key);
+        if (it == sessions_.end()) {
+            return 0;
+        }
+
+        /* a TLS 1.2 session resumes any number of times, a TLS 1.3 ticket
+         * is meant for one connection */
+        if (SSL_SESSION_get_protocol_version(it->second.get()) < TLS1_3_VERSION) {
+            SSL_SESSION_up_ref(it->second.get());
+            session.reset(it->second.get());
+        } else {
+            session = std::move(it->second);
+            sessions_.erase(it);
+        }
+    }
+
+    if (!SSL_set_session(ssl, session.get())) {
+        ERR_clear_error();
+        return 0;
+    }
+
+    LOG_TRACE << "Offering a TLS session for " << key;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    return SSL_SESSION_get_max_early_data(session.get());
+#else
+    return 0;
+#endif
+}
+
+int tls_session_cache::on_new_session(SSL* ssl, SSL_SESSION* session) {
+    auto* cache = static_cast<tls_session_cache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctx_index()));
+    const auto* key = static_cast<const std::string*>(SSL_get_ex_data(ssl, ssl_index()));
+    if (!cache || !key) {
+        return 0;
+    }
+
+    std::lock_guard lock{cache->mutex_};
+    if (cache->sessions_.size() >= cache->capacity_ && !cache->sessions_.count(*key)) {
+        cache->sessions_.erase(cache->sessions_.begin());
+    }
+
+    /* a copy: OpenSSL marks the session it passed in not resumable if this
+     * connection ends without a close_notify, as skipped shutdowns do */
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+    if (copy) {
+        cache->sessions_[*key].reset(copy);
+    }
+    return 0;
+}
+
+std::optional<std::string> early_data_flight(SSL* ssl, std::string_view data) {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    /* catch the records in a memory BIO in place of asio's, which would hold
+     * them until the handshake produced output of its own */
+    BIO* out = BIO_new(BIO_s_mem());
+    if (!out) {
+        return std::nullopt;
+    }
+
+    BIO* engine_bio = SSL_get_wbio(ssl);
+    BIO_up_ref(engine_bio);
+    SSL_set0_wbio(ssl, out);
+
+    std::size_t written = 0;
+    const int rc = SSL_write_early_data(ssl, data.data(), data.size(), &written);
+
+    char* pending = nullptr;
+    const long pending_size = BIO_get_mem_data(out, &pending);
+    std::string flight{pending, static_cast<std::size_t>(pending_size)};
+
+    /* frees out */
+    SSL_set0_wbio(ssl, engine_bio);
+
+    if (rc == 1 && written == data.size()) {
+        return flight;
+    }
+
+    const auto error = ERR_get_error();
+    ERR_clear_error();
+
+    if (flight.empty()) {
+        return std::nullopt;
+    }
+
+    /* part of the handshake is out of the engine's hands, it cannot go on */
+    throw boost::system::system_error(static_cast<int>(error), boost::asio::error::get_ssl_category(), "early data");
+#else
+    (void)ssl;
+    (void)data;
+    return std::nullopt;
+#endif
+}
+
+} // ns zclient::detail
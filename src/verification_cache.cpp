@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include "boost/certify/https_verification.hpp"
+
+#include "verification_cache.hpp"
+
+namespace zclient::detail {
+
+namespace {
+
+/* the cache on the SSL_CTX, freed along with it */
+int ctx_index() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr,
+        [](void*, void* cache, CRYPTO_EX_DATA*, int, long, void*) {
+            delete static_cast<verification_cache*>(cache);
+        });
+    return index;
+}
+
+/* empty without an SNI hostname (IP literal hosts): the leaf alone does not
+ * say which name it was verified for */
+std::string cache_key(X509* leaf, SSL* ssl) {
+    const char* hostname = ssl ? SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name) : nullptr;
+    if (!hostname) {
+        return {};
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    if (!X509_digest(leaf, EVP_sha256(), digest, &digest_size)) {
+        return {};
+    }
+
+    std::string key{reinterpret_cast<const char*>(digest), digest_size};
+    key += hostname;
+    return key;
+}
+
+/* time left until cert's notAfter, negative once it has passed */
+std::chrono::seconds time_to_expiry(X509* cert) {
+    int days = 0;
+    int seconds = 0;
+    if (!ASN1_TIME_diff(&days, &seconds, nullptr, X509_get0_notAfter(cert))) {
+        return std::chrono::seconds{-1};
+    }
+    return std::chrono::hours(24) * days + std::chrono::seconds(seconds);
+}
+
+} // anonymous ns
+
+verification_cache::verification_cache(std::size_t capacity, std::chrono::seconds max_age)
+    :capacity_{capacity}
+    ,max_age_{max_age}
+{}
+
+verification_cache& verification_cache::enable(boost::asio::ssl::context& ctx, std::size_t capacity, std::chrono::seconds max_age) {
+    auto* cache = new verification_cache{capacity, max_age};
+    SSL_CTX_set_ex_data(ctx.native_handle(), ctx_index(), cache);
+    SSL_CTX_set_cert_verify_callback(ctx.native_handle(), &verification_cache::verify, cache);
+    return *cache;
+}
+
+std::size_t verification_cache::size() const {
+    std::lock_guard lock{mutex_};
+    return verified_.size();
+}
+
+int verification_cache::verify(X509_STORE_CTX* store_ctx, void* arg) {
+    auto* cache = static_cast<verification_cache*>(arg);
+    auto* ssl = static_cast<SSL*>(X509_STORE_CTX_get_ex_data(store_ctx, SSL_get_ex_data_X509_STORE_CTX_idx()));
+
+    X509* leaf = X509_STORE_CTX_get0_cert(store_ctx);
+    const auto key = leaf ? cache_key(leaf, ssl) : std::string{};
+
+    if (!key.empty() && cache->lookup(key)) {
+        ++cache->hits_;
+        X509_STORE_CTX_set_error(store_ctx, X509_V_OK);
+        return 1;
+    }
+
+    const int result = boost::certify::detail::verify_server_certificates(store_ctx, nullptr);
+    if (key.empty()) {
+        return result;
+    }
+
+    if (result != 1) {
+        cache->erase(key);
+        return result;
+    }
+
+    /* the whole chain has to stay valid, not just the leaf */
+    auto expires_in = std::min(cache->max_age_, time_to_expiry(leaf));
+    if (STACK_OF(X509)* chain = X509_STORE_CTX_get0_chain(store_ctx)) {
+        for (int i = 0; i < sk_X509_num(chain); ++i) {
+            expires_in = std::min(expires_in, time_to_expiry(sk_X509_value(chain, i)));
+        }
+    }
+
+    if (expires_in.count() > 0) {
+        cache->store(key, clock::now() + expires_in);
+    }
+
+    return result;
+}
+
+bool verification_cache::lookup(const std::string& key) {
+    std::lock_guard lock{mutex_};
+    auto it = verified_.find(key);
+    if (it == verified_.end()) {
+        return false;
+    }
+
+    if (it->second <= clock::now()) {
+        verified_.erase(it);
+        return false;
+    }
+    return true;
+}
+
+void verification_cache::store(const std::string& key, clock::time_point expiry) {
+    if (capacity_ == 0) {
+        return;
+    }
+
+    std::lock_guard lock{mutex_};
+    if (verified_.size() >= capacity_ && !verified_.count(key)) {
+        const auto now = clock::now();
+        std::erase_if(verified_, [now](const auto& entry) { return entry.second <= now; });
+
+        if (verified_.size() >= capacity_) {
+            verified_.erase(verified_.begin());
+        }
+    }
+
+    verified_[key] = expiry;
+}
+
+void verification_cache::erase(const std::string& key) {
+    std::lock_guard lock{mutex_};
+    verified_.erase(key);
+}
+
+} // ns zclient::detail
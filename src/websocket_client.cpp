@@ -1,5 +1,10 @@
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/co_spawn.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/experimental/as_tuple.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
 #include <boost/asio/use_awaitable.hpp>
 #include <boost/asio/use_future.hpp>
 #include <boost/asio/detached.hpp>
@@ -8,72 +13,495 @@
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/websocket/ssl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <cstdlib>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 #include "boost/certify/https_verification.hpp"
 
 #include "asio_context_provider.hpp"
+#include "coalescing_stream.hpp"
+#include "rx_timestamp.hpp"
+#include "transport.hpp"
+#include "verification_cache.hpp"
 #include "websocket_client.hpp"
 #include "zlogger.hpp"
 
 namespace zclient {
 
-struct websocket_client::impl {
+namespace {
+
+/* the context of every TLS websocket client, so certificates verified for
+ * one (see verification_cache) are known to the next, as to the clients the
+ * resilient client makes for each reconnection */
+boost::asio::ssl::context& websocket_ssl_context() {
+    static boost::asio::ssl::context ctx = []() {
+        boost::asio::ssl::context c{boost::asio::ssl::context::tlsv12_client};
+        c.set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
+        c.set_default_verify_paths();
+
+        boost::certify::enable_native_https_server_verification(c);
+        detail::verification_cache::enable(c);
+        return c;
+    }();
+    return ctx;
+}
 
-    impl()
-        :ssl_ctx_{boost::asio::ssl::context::tlsv12_client}
-        ,p_ws_stream_var_{}
+/* older Boost (1.74 among them) has no permessage_deflate::msg_size_threshold
+ * and compresses every message */
+template <typename Options>
+void set_min_compressed_size(Options& pmd, std::size_t size) {
+    if constexpr (requires { pmd.msg_size_threshold; }) {
+        pmd.msg_size_threshold = size;
+    }
+}
+
+/* flat_buffer reused across reads. Its capacity follows the largest recent
+ * message: reserved up front so a message is read without reallocating, and
+ * handed back when a one-off large message leaves it far bigger than typical */
+struct adaptive_read_buffer {
+    static constexpr std::size_t min_capacity = 4 * 1024;
+    static constexpr std::size_t shrink_threshold = 1024 * 1024;
+
+    boost::beast::flat_buffer buffer;
+    std::size_t expected = min_capacity;
+
+    void prepare() {
+        buffer.clear();
+
+        if (buffer.capacity() > shrink_threshold && buffer.capacity() > 8 * expected) {
+            buffer.shrink_to_fit();
+        }
+
+        if (buffer.capacity() < expected) {
+            buffer.reserve(expected);
+        }
+    }
+
+    void observe() {
+        /* grow to a larger message straight away, decay slowly towards smaller ones */
+        expected = std::max({buffer.size(), expected - expected / 16, min_capacity});
+    }
+
+    std::string_view view() const {
+        const auto data = buffer.data();
+        return std::string_view{static_cast<const char*>(data.data()), data.size()};
+    }
+};
+
+struct queued_message {
+    std::string data;
+    ws_message_type type;
+};
+
+/* Outbound messages waiting for the connection's single writer */
+struct write_queue {
+    explicit write_queue(const boost::asio::any_io_executor& strand, const websocket_write_options& options_)
+        :options{options_}
+        ,drained{strand}
     {
-        ssl_ctx_.set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
-        ssl_ctx_.set_default_verify_paths();
+        drained.expires_at(std::chrono::steady_clock::time_point::max());
+    }
+
+    const websocket_write_options options;
+
+    std::mutex mutex;
+    std::deque<queued_message> messages;
+    std::size_t bytes = 0; /* queued or in flight */
+    bool writing = false;
+
+    /* the first failed write, rethrown by every later write() and read() */
+    boost::system::error_code error;
+
+    std::atomic<std::uint64_t> messages_written{0};
+    std::atomic<std::uint64_t> payload_bytes_written{0};
+
+    /* cancelled on the strand whenever the writer has sent a batch, or a
+     * ping has completed */
+    boost::asio::steady_timer drained;
+
+    bool over_high_water_mark(std::size_t extra) const {
+        /* a message larger than the high-water mark still goes through on an empty queue */
+        return bytes && bytes + extra > options.high_water_mark;
+    }
+};
+
+/* Round trips of the connection's own pings. The pong handler runs on the
+ * strand, stats() on any thread */
+struct rtt_tracker {
+    using clock = std::chrono::steady_clock;
+
+    /* the payload carries the send time, so a pong needs no lookup. Beast's own
+     * keep-alive pings have an empty payload and are ignored */
+    static constexpr std::string_view prefix = "zc";
+
+    static boost::beast::websocket::ping_data make_ping(clock::time_point now) {
+        char digits[24];
+        const auto res = std::to_chars(std::begin(digits), std::end(digits), now.time_since_epoch().count());
+
+        boost::beast::websocket::ping_data payload{prefix.data(), prefix.size()};
+        payload.append(digits, res.ptr - digits);
+        return payload;
+    }
+
+    void on_pong(std::string_view payload, clock::time_point now) {
+        if (payload.substr(0, prefix.size()) != prefix) {
+            return;
+        }
+
+        clock::rep sent = 0;
+        const auto digits = payload.substr(prefix.size());
+        if (std::from_chars(digits.data(), digits.data() + digits.size(), sent).ec != std::errc{}) {
+            return;
+        }
+
+        const auto rtt = std::chrono::duration_cast<std::chrono::nanoseconds>(now - clock::time_point{clock::duration{sent}});
+
+        std::lock_guard lock{mutex};
+        ++pongs_received;
+        last = rtt;
+        min = pongs_received == 1 ? rtt : std::min(min, rtt);
+        total += rtt;
+
+        if (window.size() < window_size) {
+            window.push_back(rtt);
+        } else if (window_size) {
+            window[next] = rtt;
+            next = (next + 1) % window_size;
+        }
+    }
+
+    void fill(websocket_stats& st) {
+        std::vector<std::chrono::nanoseconds> sorted;
+        {
+            std::lock_guard lock{mutex};
+            st.pings_sent = pings_sent;
+            st.pongs_received = pongs_received;
+            st.rtt_last = last;
+            st.rtt_min = min;
+            st.rtt_avg = pongs_received ? total / static_cast<std::int64_t>(pongs_received) : std::chrono::nanoseconds{0};
+            sorted = window;
+        }
+
+        if (!sorted.empty()) {
+            const auto idx = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+            std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+            st.rtt_p99 = sorted[idx];
+        }
+    }
+
+    std::mutex mutex;
+    std::size_t window_size = 0;
+    std::vector<std::chrono::nanoseconds> window;
+    std::size_t next = 0;
+
+    std::uint64_t pings_sent = 0;
+    std::uint64_t pongs_received = 0;
+    std::chrono::nanoseconds last{0};
+    std::chrono::nanoseconds min{0};
+    std::chrono::nanoseconds total{0};
+};
+
+/* Everything that lives as long as one connection: the stream, held by value,
+ * and its write queue. Shared with the writer coroutine so that it can outlive
+ * the client */
+template <typename Transport>
+struct ws_connection {
+    static constexpr bool use_ssl = std::is_same_v<Transport, tls_transport>;
+    static constexpr bool use_unix = std::is_same_v<Transport, unix_transport>;
+
+    using socket_stream_type = std::conditional_t<use_unix,
+        boost::beast::basic_stream<boost::asio::local::stream_protocol>,
+        boost::beast::tcp_stream>;
+
+    using stream_type = std::conditional_t<use_ssl,
+        boost::beast::websocket::stream<coalescing_stream<boost::beast::ssl_stream<rx_timestamp_stream<socket_stream_type>>>>,
+        boost::beast::websocket::stream<coalescing_stream<rx_timestamp_stream<socket_stream_type>>>>;
+
+    template <typename... StreamArgs>
+    ws_connection(const boost::asio::any_io_executor& strand, const websocket_write_options& options, StreamArgs&... args)
+        :stream{strand, args...}
+        ,queue{strand, options}
+    {}
+
+    auto& rx_layer() {
+        if constexpr (use_ssl) {
+            return stream.next_layer().next_layer().next_layer();
+        } else {
+            return stream.next_layer().next_layer();
+        }
+    }
+
+    stream_type stream;
+    write_queue queue;
+    rtt_tracker rtt;
+
+    /* set once a close has been started, so only one is ever in flight.
+     * Set under the queue's mutex, so nothing is queued after it */
+    std::atomic<bool> closing{false};
+
+    /* a ping of ping_loop is in flight, only touched on the strand. beast
+     * allows one ping or close at a time, so the close waits for it */
+    bool pinging = false;
+};
+
+/* sends a ping every interval on the connection's strand until it closes */
+template <typename Connection>
+boost::asio::awaitable<void> ping_loop(std::shared_ptr<Connection> conn, std::chrono::milliseconds interval) {
+    using boost::asio::use_awaitable;
+    using boost::asio::experimental::as_tuple;
+
+    boost::asio::steady_timer timer{conn->stream.get_executor()};
+
+    while (true) {
+        timer.expires_after(interval);
+        co_await timer.async_wait(as_tuple(use_awaitable));
+
+        if (!conn->stream.is_open() || conn->closing.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        const auto payload = rtt_tracker::make_ping(rtt_tracker::clock::now());
+        conn->pinging = true;
+        auto [ec] = co_await conn->stream.async_ping(payload, as_tuple(use_awaitable));
+        conn->pinging = false;
+        conn->queue.drained.cancel();
+
+        if (ec) {
+            LOG_TRACE << "Ping failed: " << ec.message();
+            break;
+        }
+
+        std::lock_guard lock{conn->rtt.mutex};
+        ++conn->rtt.pings_sent;
+    }
+}
+
+/* sends the queued messages, then a close frame, and waits for the server's,
+ * dropping the socket if all that takes longer than timeout. Runs on the
+ * connection's strand */
+template <typename Connection>
+boost::asio::awaitable<void> close_connection(std::shared_ptr<Connection> conn, std::chrono::milliseconds timeout) {
+    using boost::asio::use_awaitable;
+    using boost::asio::experimental::as_tuple;
+
+    auto waiting = std::make_shared<bool>(true);
+    boost::asio::steady_timer timer{conn->stream.get_executor()};
+    timer.expires_after(timeout);
+    timer.async_wait([conn, waiting](boost::system::error_code ec) {
+        if (!ec && *waiting) {
+            LOG_WARN << "Websocket close handshake timed out, dropping the connection";
+            boost::beast::get_lowest_layer(conn->stream).close();
+        }
+    });
+
+    /* nothing is queued once closing is set, so this ends. A write failing
+     * on the dropped socket ends it too */
+    const auto busy = [&conn]() {
+        std::lock_guard lock{conn->queue.mutex};
+        return conn->queue.writing || conn->pinging;
+    };
+    while (busy()) {
+        co_await conn->queue.drained.async_wait(as_tuple(use_awaitable));
+    }
+
+    /* after a failed write there is no close handshake to be had */
+    const bool failed = [&conn]() {
+        std::lock_guard lock{conn->queue.mutex};
+        return bool(conn->queue.error);
+    }();
+    if (failed) {
+        *waiting = false;
+        timer.cancel();
+
+        boost::system::error_code ignored;
+        boost::beast::get_lowest_layer(conn->stream).socket().close(ignored);
+        co_return;
+    }
+
+    auto [ec] = co_await conn->stream.async_close(boost::beast::websocket::close_code::normal, as_tuple(use_awaitable));
+    *waiting = false;
+    timer.cancel();
+
+    if (ec && ec != boost::asio::ssl::error::stream_truncated) {
+        LOG_TRACE << "Websocket close ended with: " << ec.message();
+        co_return;
+    }
 
-        boost::certify::enable_native_https_server_verification(ssl_ctx_);
+    LOG_TRACE << "Successfully disconnected";
+}
+
+template <typename Stream>
+boost::asio::awaitable<boost::system::error_code>
+write_batch(Stream& stream, const std::deque<queued_message>& batch, std::size_t limit, std::size_t& bytes_written) {
+    using boost::asio::use_awaitable;
+    using boost::asio::experimental::as_tuple;
+
+    auto& layer = stream.next_layer();
+
+    for (const auto& message : batch) {
+        const bool coalesce = limit && message.data.size() <= limit;
+
+        if (coalesce) {
+            layer.cork();
+        } else if (layer.corked()) {
+            /* keep the order, send what was coalesced before the large message */
+            auto [ec] = co_await layer.async_flush(as_tuple(use_awaitable));
+            if (ec) co_return ec;
+        }
+
+        /* frame type of the next message, only the writer touches it */
+        stream.binary(message.type == ws_message_type::binary);
+
+        auto [ec, n] = co_await stream.async_write(boost::asio::buffer(message.data), as_tuple(use_awaitable));
+        if (ec) co_return ec;
+
+        bytes_written += message.data.size();
+
+        if (layer.corked() && layer.pending() >= limit) {
+            auto [ec] = co_await layer.async_flush(as_tuple(use_awaitable));
+            if (ec) co_return ec;
+        }
+    }
+
+    if (layer.corked()) {
+        auto [ec] = co_await layer.async_flush(as_tuple(use_awaitable));
+        co_return ec;
+    }
+
+    co_return boost::system::error_code{};
+}
+
+/* the connection's only writer, runs on its strand until the queue is empty */
+template <typename Connection>
+boost::asio::awaitable<void>
+drain_write_queue(std::shared_ptr<Connection> conn) {
+    auto& queue = conn->queue;
+    std::deque<queued_message> batch;
+
+    while (true) {
+        {
+            std::lock_guard lock{queue.mutex};
+            if (queue.messages.empty()) {
+                queue.writing = false;
+                break;
+            }
+
+            batch.swap(queue.messages);
+        }
+
+        std::size_t bytes_written = 0;
+        auto ec = co_await write_batch(conn->stream, batch, queue.options.coalesce_limit, bytes_written);
+
+        {
+            std::lock_guard lock{queue.mutex};
+
+            if (ec) {
+                LOG_ERROR << "Websocket write failed: " << ec.message() << ", dropping queued messages";
+                if (!queue.error) {
+                    queue.error = ec;
+                }
+                queue.messages.clear();
+                queue.bytes = 0;
+                queue.writing = false;
+            } else {
+                LOG_TRACE << "Wrote batch of " << batch.size() << " messages, " << bytes_written << " bytes to server";
+                queue.bytes -= bytes_written;
+                queue.messages_written.fetch_add(batch.size(), std::memory_order_relaxed);
+                queue.payload_bytes_written.fetch_add(bytes_written, std::memory_order_relaxed);
+            }
+        }
+
+        batch.clear();
+        queue.drained.cancel();
+
+        if (ec) break;
     }
+}
+
+} // ns
+
+template <typename Transport>
+struct basic_websocket_client<Transport>::impl {
+    static constexpr bool use_ssl = std::is_same_v<Transport, tls_transport>;
+    static constexpr bool use_unix = std::is_same_v<Transport, unix_transport>;
+
+    using connection = ws_connection<Transport>;
+
+    impl()
+        :socket_options_{default_socket_options()}
+    {}
 
     ~impl() {
-        disconnect();
+        disconnect(std::chrono::milliseconds(1000));
     }
 
-    template <typename WsStreamPtr>
     boost::asio::awaitable<bool> connect_imp(
         const std::string& host,
         const std::string& port,
         const std::string& target,
-        WsStreamPtr p_ws_stream,
+        const std::string& address,
+        std::shared_ptr<connection> conn,
         boost::asio::any_io_executor& ex
     )
     {
         using boost::asio::use_awaitable;
         using boost::asio::experimental::as_tuple;
-        
+
+        auto& ws_stream = conn->stream;
+
         try
         {
-            // These objects perform our I/O
-            boost::asio::ip::tcp::resolver resolver(ex);
+            if constexpr (use_unix) {
+                // Set a timeout on the operation
+                boost::beast::get_lowest_layer(ws_stream).expires_after(
+                    std::chrono::seconds(30));
 
-            // Look up the domain name
-            auto const results = co_await resolver.async_resolve(
-                host, port, use_awaitable);
+                // The host is the socket's path, there is nothing to look up
+                co_await boost::beast::get_lowest_layer(ws_stream).async_connect(
+                    boost::asio::local::stream_protocol::endpoint{address.empty() ? host : address}, use_awaitable);
 
-            LOG_TRACE << "Domain resolved";
+                LOG_TRACE << "Connected to unix socket";
+            } else {
+                // Look up the domain name
+                const auto& name = address.empty() ? host : address;
+                boost::asio::ip::tcp::resolver::results_type results;
+                if (dns_resolver_) {
+                    results = co_await dns_resolver_->resolve(name, port);
+                } else {
+                    boost::asio::ip::tcp::resolver resolver(ex);
+                    results = co_await resolver.async_resolve(name, port, use_awaitable);
+                }
 
-            // Set a timeout on the operation
-            boost::beast::get_lowest_layer(*p_ws_stream).expires_after(
-                std::chrono::seconds(30));
+                LOG_TRACE << "Domain resolved";
+
+                // Set a timeout on the operation
+                boost::beast::get_lowest_layer(ws_stream).expires_after(
+                    std::chrono::seconds(30));
 
-            // Make the connection on the IP address we get from a lookup
-            auto ep = co_await boost::beast::get_lowest_layer(*p_ws_stream).async_connect(
-                results, use_awaitable);
+                // Make the connection on the IP address we get from a lookup
+                auto ep = co_await boost::beast::get_lowest_layer(ws_stream).async_connect(
+                    results, use_awaitable);
 
-            LOG_TRACE << "Connected to server";
+                LOG_TRACE << "Connected to server";
 
-            if constexpr (std::is_same_v<WsStreamPtr, secured_ws_stream_ptr>) {
+                apply_socket_options(boost::beast::get_lowest_layer(ws_stream).socket(), socket_options_);
+            }
+
+            if constexpr (use_ssl) {
                 // Set SNI Hostname (many hosts need this to handshake
                 // successfully)
                 if(! SSL_set_tlsext_host_name(
-                    p_ws_stream->next_layer().native_handle(), host.c_str()))
+                    ws_stream.next_layer().next_layer().native_handle(), host.c_str()))
                 {
                     throw boost::beast::system_error(
                         static_cast<int>(::ERR_get_error()),
@@ -82,11 +510,11 @@ struct websocket_client::impl {
             }
 
             // Set a timeout on the operation
-            boost::beast::get_lowest_layer(*p_ws_stream).expires_after(
+            boost::beast::get_lowest_layer(ws_stream).expires_after(
                 std::chrono::seconds(30));
 
             // Set a decorator to change the User-Agent of the handshake
-            p_ws_stream->set_option(boost::beast::websocket::stream_base::decorator(
+            ws_stream.set_option(boost::beast::websocket::stream_base::decorator(
                 [](boost::beast::websocket::request_type& req)
                 {
                     req.set(
@@ -95,9 +523,9 @@ struct websocket_client::impl {
                             " websocket-client-coro");
                 }));
 
-            if constexpr (std::is_same_v<WsStreamPtr, secured_ws_stream_ptr>) {
+            if constexpr (use_ssl) {
                 // Perform the SSL handshake
-                co_await p_ws_stream->next_layer().async_handshake(
+                co_await ws_stream.next_layer().next_layer().async_handshake(
                     boost::asio::ssl::stream_base::client, use_awaitable);
             }
 
@@ -105,19 +533,54 @@ struct websocket_client::impl {
 
             // Turn off the timeout on the tcp_stream, because
             // the websocket stream has its own timeout system.
-            boost::beast::get_lowest_layer(*p_ws_stream).expires_never();
+            boost::beast::get_lowest_layer(ws_stream).expires_never();
+
+            /* only now, as the timestamping reads bypass the tcp_stream's timeouts */
+            if (socket_options_.rx_timestamps && !use_unix) {
+                conn->rx_layer().enable();
+            }
+
+            if (compression_options_.enabled) {
+                boost::beast::websocket::permessage_deflate pmd;
+                pmd.client_enable = true;
+                pmd.client_max_window_bits = compression_options_.client_max_window_bits;
+                pmd.server_max_window_bits = compression_options_.server_max_window_bits;
+                pmd.client_no_context_takeover = compression_options_.client_no_context_takeover;
+                pmd.server_no_context_takeover = compression_options_.server_no_context_takeover;
+                pmd.compLevel = compression_options_.compression_level;
+                pmd.memLevel = compression_options_.memory_level;
+                set_min_compressed_size(pmd, compression_options_.min_message_size);
+                ws_stream.set_option(pmd);
+            }
 
             // Set suggested timeout settings for the websocket
-            p_ws_stream->set_option(boost::beast::websocket::stream_base::timeout::suggested(
+            ws_stream.set_option(boost::beast::websocket::stream_base::timeout::suggested(
                 boost::beast::role_type::client));
 
+            /* the stream owns the callback, so the tracker outlives it */
+            auto* rtt = &conn->rtt;
+            rtt->window_size = ping_options_.window;
+            ws_stream.control_callback([rtt](boost::beast::websocket::frame_type kind, boost::beast::string_view payload) {
+                if (kind == boost::beast::websocket::frame_type::pong) {
+                    rtt->on_pong(std::string_view{payload.data(), payload.size()}, rtt_tracker::clock::now());
+                }
+            });
+
             // Perform the websocket handshake
-            co_await p_ws_stream->async_handshake(host + ':' + port, target, use_awaitable);
+            /* a unix socket's path makes no sense as the Host header */
+            const std::string host_header = use_unix ? std::string{"localhost"} : host + ':' + port;
+            co_await ws_stream.async_handshake(host_header, target, use_awaitable);
 
             LOG_TRACE << "Websocket handshake success";
 
+            touch_last_message();
+
+            if (ping_options_.interval.count() > 0) {
+                boost::asio::co_spawn(ws_stream.get_executor(), ping_loop(conn, ping_options_.interval), boost::asio::detached);
+            }
+
             co_return true;
-            
+
         } catch (boost::beast::system_error const& se) {
             std::cerr << "Connection failed due to: " << se.what() << std::endl;
             co_return false;
@@ -128,59 +591,91 @@ struct websocket_client::impl {
         const std::string& host,
         const std::string& port,
         const std::string& target,
-        bool use_ssl
+        const std::string& address
     )
     {
         auto ex = co_await boost::asio::this_coro::executor;
 
-        if (use_ssl) {
-            p_ws_stream_var_ = std::make_shared<secured_ws_stream>(ex, ssl_ctx_);
-
-            auto res = co_await connect_imp(
-                host,
-                port,
-                target,
-                std::get<secured_ws_stream_ptr>(p_ws_stream_var_),
-                ex
-            );
+        /* every operation on the stream runs on this strand, so the client
+         * stays safe when the io_context is run from several threads */
+        boost::asio::any_io_executor strand = boost::asio::make_strand(ex);
 
-            co_return res;
+        if constexpr (use_ssl) {
+            conn_ = std::make_shared<connection>(strand, write_options_, websocket_ssl_context());
         } else {
-            p_ws_stream_var_ = std::make_shared<unsecured_ws_stream>(ex);
+            conn_ = std::make_shared<connection>(strand, write_options_);
+        }
 
-            auto res = co_await connect_imp(
-                host,
-                port,
-                target,
-                std::get<unsecured_ws_stream_ptr>(p_ws_stream_var_),
-                ex
-            );
+        messages_read_ = 0;
+        payload_bytes_read_ = 0;
+        last_message_at_ = 0;
 
-            co_return res;
-        }
+        auto res = co_await connect_imp(host, port, target, address, conn_, ex);
+        co_return res;
     }
 
-    template <typename WsStreamPtr>
-    boost::asio::awaitable<std::string> read_imp(WsStreamPtr p_ws_stream) {
+    /* Start a read on the stream's strand and complete through it, so it is
+     * serialized with the writer. Done with plain handlers rather than by
+     * co_spawning onto the strand, which would cost two coroutine frames per message.
+     * initiate(handler) starts the stream operation */
+    template <typename Initiate>
+    static auto async_read_on_strand(typename connection::stream_type& ws_stream, Initiate initiate) {
+        auto token = boost::asio::experimental::as_tuple(boost::asio::use_awaitable);
+
+        return boost::asio::async_initiate<decltype(token), void(boost::system::error_code, std::size_t)>(
+            [&ws_stream, initiate](auto handler) {
+                auto strand = ws_stream.get_executor();
+
+                boost::asio::dispatch(strand, [initiate, strand, handler = std::move(handler)]() mutable {
+                    initiate(boost::asio::bind_executor(strand, std::move(handler)));
+                });
+            },
+            token);
+    }
+
+    struct read_result {
+        ws_message_type type;
+        bool message_done;
+        std::chrono::system_clock::time_point rx_timestamp;
+    };
+
+    /* reads a whole message, or with a frame_limit only what has arrived of the
+     * current one (at most frame_limit bytes, 0 lets beast pick) */
+    template <typename DynamicBuffer>
+    boost::asio::awaitable<read_result> read_imp(DynamicBuffer& buffer, std::optional<std::size_t> frame_limit = {}) {
+
+        throw_write_error();
 
         if (!is_connected()) {
             throw websocket_server_disconnected_exception("Connection is not open");
         }
 
-        using boost::asio::use_awaitable;
-        using boost::asio::experimental::as_tuple;
+        /* keeps the stream alive until the read completes */
+        auto conn = conn_;
+        auto& ws_stream = conn->stream;
 
-        // This buffer will hold the incoming message
-        boost::beast::flat_buffer buffer;
+        /* named rather than a temporary in the co_await expression, gcc 12 destroys
+         * such temporaries twice */
+        auto initiate = [&ws_stream, &buffer, frame_limit](auto handler) {
+            if (frame_limit) {
+                ws_stream.async_read_some(buffer, *frame_limit, std::move(handler));
+            } else {
+                ws_stream.async_read(buffer, std::move(handler));
+            }
+        };
 
-        // Read a message into our buffer
-        auto [ec, bytes] =
-            co_await p_ws_stream->async_read(buffer, as_tuple(use_awaitable));
+        // Read a message (or part of one) into the buffer
+        auto [ec, bytes] = co_await async_read_on_strand(ws_stream, initiate);
 
-        std::string ret = std::string(boost::beast::buffers_to_string(buffer.data()));
-        buffer.consume(buffer.size());
+        LOG_TRACE << "Read " << bytes << " characters from server";
 
-        LOG_TRACE << "Read " << ret.length() << " characters from server";
+        const bool message_done = ws_stream.is_message_done();
+
+        if (message_done) {
+            messages_read_.fetch_add(1, std::memory_order_relaxed);
+            touch_last_message();
+        }
+        payload_bytes_read_.fetch_add(bytes, std::memory_order_relaxed);
 
         if(ec)
         {
@@ -188,90 +683,389 @@ struct websocket_client::impl {
             if(ec != boost::asio::error::eof)
                 throw boost::beast::system_error(ec);
         }
+        else if (socket_options_.quick_ack)
+        {
+            rearm_quick_ack(boost::beast::get_lowest_layer(ws_stream).socket());
+        }
+
+        co_return read_result{
+            ws_stream.got_binary() ? ws_message_type::binary : ws_message_type::text,
+            message_done,
+            conn->rx_layer().last_rx_timestamp()
+        };
+    }
+
+    boost::asio::awaitable<ws_message> read_view() {
+        read_buffer_.prepare();
+        auto res = co_await read_imp(read_buffer_.buffer);
+        read_buffer_.observe();
+
+        co_return ws_message{read_buffer_.view(), res.type, res.rx_timestamp};
+    }
+
+    boost::asio::awaitable<ws_message> read_into(std::string& buffer) {
+        buffer.clear();
+        auto dynamic_buffer = boost::asio::dynamic_buffer(buffer);
+        auto res = co_await read_imp(dynamic_buffer);
+
+        co_return ws_message{std::string_view{buffer}, res.type, res.rx_timestamp};
+    }
 
-        co_return ret;
+    boost::asio::awaitable<ws_frame> read_some(std::string& buffer, std::size_t max_bytes) {
+        buffer.clear();
+        auto dynamic_buffer = boost::asio::dynamic_buffer(buffer);
+        auto res = co_await read_imp(dynamic_buffer, max_bytes);
+
+        co_return ws_frame{std::string_view{buffer}, res.type, res.message_done};
     }
 
     boost::asio::awaitable<std::string> read() {
-        if (std::holds_alternative<secured_ws_stream_ptr>(p_ws_stream_var_)) {
-            auto res = co_await read_imp(std::get<secured_ws_stream_ptr>(p_ws_stream_var_));
-            co_return res;
-        } else {
-            auto res = co_await read_imp(std::get<unsecured_ws_stream_ptr>(p_ws_stream_var_));
-            co_return res;   
-        }
+        /* the one copy out of the reused buffer is the string the caller owns */
+        auto message = co_await read_view();
+        co_return std::string{message.data};
     }
 
-    template <typename WsStreamPtr>
-    boost::asio::awaitable<void> write_imp(WsStreamPtr p_ws_stream, const std::string& message) {
+    /* A write completes once the message is queued, so the error of a
+     * failed socket write surfaces on the calls after it */
+    boost::asio::awaitable<void> write(std::string_view message, ws_message_type type) {
+
+        throw_write_error();
 
         if (!is_connected()) {
             throw websocket_server_disconnected_exception("Connection is not open");
         }
 
-        using boost::asio::use_awaitable;
-        using boost::asio::experimental::as_tuple;
+        auto conn = conn_;
+
+        while (!try_enqueue(conn, message, type)) {
+            /* backpressure, wait for the writer to drain below the high-water mark */
+            co_await boost::asio::co_spawn(
+                conn->stream.get_executor(), wait_for_drain(conn, message.size()), boost::asio::use_awaitable);
+
+            throw_write_error();
+
+            if (!is_connected()) {
+                throw websocket_server_disconnected_exception("Connection is not open");
+            }
+        }
 
-        co_await p_ws_stream->async_write(boost::asio::buffer(message), as_tuple(use_awaitable));
-        LOG_TRACE << "Wrote " << message.length() << " characters to server";
+        LOG_TRACE << "Queued " << message.length() << " characters for server";
     }
 
-    boost::asio::awaitable<void> write(const std::string& message) {
-        if (std::holds_alternative<secured_ws_stream_ptr>(p_ws_stream_var_)) {
-            co_await write_imp(std::get<secured_ws_stream_ptr>(p_ws_stream_var_), message);
-        } else {
-            co_await write_imp(std::get<unsecured_ws_stream_ptr>(p_ws_stream_var_), message);
+    void throw_write_error() const {
+        if (!conn_) {
+            return;
+        }
+
+        std::lock_guard lock{conn_->queue.mutex};
+        if (conn_->queue.error) {
+            throw boost::beast::system_error(conn_->queue.error);
         }
     }
 
-    bool is_connected() const {
-        if (std::holds_alternative<secured_ws_stream_ptr>(p_ws_stream_var_)) {
-            return std::get<secured_ws_stream_ptr>(p_ws_stream_var_)->is_open();
-        } else {
-            return std::get<unsecured_ws_stream_ptr>(p_ws_stream_var_)->is_open();
+    static bool try_enqueue(const std::shared_ptr<connection>& conn, std::string_view message, ws_message_type type) {
+        auto& queue = conn->queue;
+        std::lock_guard lock{queue.mutex};
+
+        if (queue.error) {
+            throw boost::beast::system_error(queue.error);
+        }
+        if (conn->closing.load(std::memory_order_relaxed)) {
+            throw websocket_server_disconnected_exception("Connection is closing");
+        }
+
+        if (queue.over_high_water_mark(message.size())) {
+            return false;
         }
+
+        queue.messages.push_back(queued_message{std::string{message}, type});
+        queue.bytes += message.size();
+
+        if (!queue.writing) {
+            queue.writing = true;
+            boost::asio::co_spawn(conn->stream.get_executor(), drain_write_queue(conn), boost::asio::detached);
+        }
+
+        return true;
     }
 
-    template <typename WsStreamPtr>
-    void disconnect_imp(WsStreamPtr p_ws_stream) {
-        if (p_ws_stream) {
-            try {
-                p_ws_stream->close(boost::beast::websocket::close_code::normal);
-            } catch (boost::wrapexcept<boost::system::system_error> const& se) {
-                const auto& e_code = se.code();
-                if (e_code != boost::asio::ssl::error::stream_truncated) {
-                    throw se;
-                }
+    /* must run on the strand: the writer cancels the timer there, so no wakeup
+     * can slip in between the check and the wait */
+    static boost::asio::awaitable<void> wait_for_drain(std::shared_ptr<connection> conn, std::size_t extra) {
+        {
+            std::lock_guard lock{conn->queue.mutex};
+            if (!conn->queue.over_high_water_mark(extra)) {
+                co_return;
             }
-        
+        }
+
+        co_await conn->queue.drained.async_wait(boost::asio::experimental::as_tuple(boost::asio::use_awaitable));
+    }
+
+    bool is_connected() const {
+        return conn_ && !conn_->closing.load(std::memory_order_relaxed) && conn_->stream.is_open();
+    }
 
-            LOG_TRACE << "Successfully disconnected";
+    boost::asio::awaitable<void> close(std::chrono::milliseconds timeout) {
+        if (!begin_close()) {
+            co_return;
         }
+
+        auto conn = conn_;
+        auto ex = conn->stream.get_executor();
+        co_await boost::asio::co_spawn(ex, close_connection(std::move(conn), timeout), boost::asio::use_awaitable);
     }
 
-    void disconnect() {
-        if (is_connected()) {
-            if (std::holds_alternative<secured_ws_stream_ptr>(p_ws_stream_var_)) {
-                disconnect_imp(std::get<secured_ws_stream_ptr>(p_ws_stream_var_));
-            } else {
-                disconnect_imp(std::get<unsecured_ws_stream_ptr>(p_ws_stream_var_));
+    void disconnect(std::chrono::milliseconds timeout) {
+        if (begin_close()) {
+            boost::asio::co_spawn(conn_->stream.get_executor(), close_connection(conn_, timeout), boost::asio::detached);
+        }
+    }
+
+    websocket_stats stats() const {
+        websocket_stats st{
+            .messages_read = messages_read_.load(std::memory_order_relaxed),
+            .messages_written = 0,
+            .payload_bytes_read = payload_bytes_read_.load(std::memory_order_relaxed),
+            .payload_bytes_written = 0,
+            .wire_bytes_read = 0,
+            .wire_bytes_written = 0,
+            .pings_sent = 0,
+            .pongs_received = 0,
+            .rtt_last = std::chrono::nanoseconds{0},
+            .rtt_min = std::chrono::nanoseconds{0},
+            .rtt_avg = std::chrono::nanoseconds{0},
+            .rtt_p99 = std::chrono::nanoseconds{0},
+            .last_message_age = std::chrono::nanoseconds{0}
+        };
+
+        if (conn_) {
+            st.messages_written = conn_->queue.messages_written.load(std::memory_order_relaxed);
+            st.payload_bytes_written = conn_->queue.payload_bytes_written.load(std::memory_order_relaxed);
+            st.wire_bytes_read = conn_->stream.next_layer().bytes_read();
+            st.wire_bytes_written = conn_->stream.next_layer().bytes_written();
+            conn_->rtt.fill(st);
+
+            const auto last = last_message_at_.load(std::memory_order_relaxed);
+            if (last) {
+                st.last_message_age = std::chrono::steady_clock::now().time_since_epoch() - std::chrono::steady_clock::duration{last};
             }
         }
-    }    
 
+        return st;
+    }
+
+    void touch_last_message() {
+        last_message_at_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    socket_options socket_options_;
+    std::shared_ptr<dns_resolver> dns_resolver_;
+    websocket_write_options write_options_;
+    websocket_compression_options compression_options_;
+    websocket_ping_options ping_options_;
 
 private:
-    boost::asio::ssl::context ssl_ctx_;
+    std::shared_ptr<connection> conn_;
+
+    /* false if there is no open connection or it is already being closed */
+    bool begin_close() {
+        if (!is_connected()) {
+            return false;
+        }
+
+        std::lock_guard lock{conn_->queue.mutex};
+        return !conn_->closing.exchange(true);
+    }
+
+    std::atomic<std::uint64_t> messages_read_{0};
+    std::atomic<std::uint64_t> payload_bytes_read_{0};
+
+    /* steady_clock ticks, 0 before the first connect */
+    std::atomic<std::chrono::steady_clock::rep> last_message_at_{0};
+
+    adaptive_read_buffer read_buffer_;
+};
+
+template <typename Transport>
+basic_websocket_client<Transport>::basic_websocket_client()
+    :pimpl_{std::make_unique<impl>()}
+{}
+
+template <typename Transport>
+basic_websocket_client<Transport>::~basic_websocket_client() {
+    pimpl_.reset();
+}
+
+template <typename Transport>
+basic_websocket_client<Transport>::basic_websocket_client(basic_websocket_client&& other)
+    :pimpl_{std::move(other.pimpl_)}
+{}
+
+template <typename Transport>
+basic_websocket_client<Transport>& basic_websocket_client<Transport>::operator=(basic_websocket_client&& other) {
+    pimpl_ = std::move(other.pimpl_);
+    return *this;
+}
+
+template <typename Transport>
+boost::asio::awaitable<bool> basic_websocket_client<Transport>::connect(
+    const std::string& host,
+    const std::string& port,
+    const std::string& target
+)
+{
+    const std::string resolve_host;
+    auto resp = co_await pimpl_->connect(host, port, target, resolve_host);
+    co_return resp;
+}
+
+template <typename Transport>
+boost::asio::awaitable<bool> basic_websocket_client<Transport>::connect(
+    const std::string& host,
+    const std::string& port,
+    const std::string& target,
+    const std::string& address
+)
+{
+    auto resp = co_await pimpl_->connect(host, port, target, address);
+    co_return resp;
+}
+
+template <typename Transport>
+bool basic_websocket_client<Transport>::is_connected() const {
+    return pimpl_->is_connected();
+}
+
+template <typename Transport>
+void basic_websocket_client<Transport>::set_socket_options(const socket_options& options) {
+    pimpl_->socket_options_ = options;
+}
+
+template <typename Transport>
+void basic_websocket_client<Transport>::set_dns_resolver(std::shared_ptr<dns_resolver> resolver) {
+    pimpl_->dns_resolver_ = std::move(resolver);
+}
+
+template <typename Transport>
+void basic_websocket_client<Transport>::set_write_options(const websocket_write_options& options) {
+    pimpl_->write_options_ = options;
+}
+
+template <typename Transport>
+void basic_websocket_client<Transport>::set_compression_options(const websocket_compression_options& options) {
+    /* zlib cannot produce 8 bit windows, beast rejects them as well */
+    const auto valid_window_bits = [](int bits) { return bits >= 9 && bits <= 15; };
+
+    if (!valid_window_bits(options.client_max_window_bits) || !valid_window_bits(options.server_max_window_bits)) {
+        throw std::invalid_argument("Window bits must be within 9..15");
+    }
+    if (options.compression_level < 0 || options.compression_level > 9) {
+        throw std::invalid_argument("Compression level must be within 0..9");
+    }
+    if (options.memory_level < 1 || options.memory_level > 9) {
+        throw std::invalid_argument("Memory level must be within 1..9");
+    }
+
+    pimpl_->compression_options_ = options;
+}
+
+template <typename Transport>
+void basic_websocket_client<Transport>::set_ping_options(const websocket_ping_options& options) {
+    pimpl_->ping_options_ = options;
+}
+
+template <typename Transport>
+websocket_stats basic_websocket_client<Transport>::stats() const {
+    return pimpl_->stats();
+}
+
+/* the reads and writes hand back the impl's awaitable rather than co_awaiting
+ * it, which would put a second coroutine frame on every message */
+
+template <typename Transport>
+boost::asio::awaitable<std::string> basic_websocket_client<Transport>::read() {
+    return pimpl_->read();
+}
+
+template <typename Transport>
+boost::asio::awaitable<ws_message> basic_websocket_client<Transport>::read_view() {
+    return pimpl_->read_view();
+}
+
+template <typename Transport>
+boost::asio::awaitable<ws_message> basic_websocket_client<Transport>::read_into(std::string& buffer) {
+    return pimpl_->read_into(buffer);
+}
+
+template <typename Transport>
+boost::asio::awaitable<ws_frame> basic_websocket_client<Transport>::read_some(std::string& buffer, std::size_t max_bytes) {
+    return pimpl_->read_some(buffer, max_bytes);
+}
+
+template <typename Transport>
+boost::asio::awaitable<void> basic_websocket_client<Transport>::write(const std::string& message) {
+    return pimpl_->write(message, ws_message_type::text);
+}
+
+template <typename Transport>
+boost::asio::awaitable<void> basic_websocket_client<Transport>::write(std::string_view message, ws_message_type type) {
+    return pimpl_->write(message, type);
+}
+
+template <typename Transport>
+boost::asio::awaitable<void> basic_websocket_client<Transport>::close(std::chrono::milliseconds timeout) {
+    return pimpl_->close(timeout);
+}
+
+template <typename Transport>
+void basic_websocket_client<Transport>::disconnect(std::chrono::milliseconds timeout) {
+    return pimpl_->disconnect(timeout);
+}
+
+template class basic_websocket_client<plain_transport>;
+template class basic_websocket_client<tls_transport>;
+template class basic_websocket_client<unix_transport>;
+
+
+struct websocket_client::impl {
+    plain_websocket_client plain;
+    tls_websocket_client tls;
+    unix_websocket_client local;
+
+    enum class scheme { ws, wss, ws_unix };
+    scheme active = scheme::ws;
 
-    using secured_ws_stream = boost::beast::websocket::stream<
-                                  boost::beast::ssl_stream<boost::beast::tcp_stream>
-                              >;
-    using secured_ws_stream_ptr = std::shared_ptr<secured_ws_stream>;
+    /* calls f with the client picked by the last connect() */
+    template <typename F>
+    decltype(auto) with_active(F&& f) {
+        return visit_active(*this, f);
+    }
 
-    using unsecured_ws_stream = boost::beast::websocket::stream<boost::beast::tcp_stream>;
-    using unsecured_ws_stream_ptr = std::shared_ptr<unsecured_ws_stream>;
+    template <typename F>
+    decltype(auto) with_active(F&& f) const {
+        return visit_active(*this, f);
+    }
 
-    std::variant<secured_ws_stream_ptr, unsecured_ws_stream_ptr> p_ws_stream_var_;
+    template <typename F>
+    void with_each(F&& f) {
+        f(plain);
+        f(tls);
+        f(local);
+    }
+
+private:
+    template <typename Self, typename F>
+    static decltype(auto) visit_active(Self& self, F& f) {
+        switch (self.active) {
+        case scheme::wss:
+            return f(self.tls);
+        case scheme::ws_unix:
+            return f(self.local);
+        default:
+            return f(self.plain);
+        }
+    }
 };
 
 websocket_client::websocket_client()
@@ -288,19 +1082,33 @@ boost::asio::awaitable<bool> websocket_client::connect(
     const std::string& port,
     const std::string& target
 )
+{
+    const std::string resolve_host;
+    auto resp = co_await connect(host, port, target, resolve_host);
+    co_return resp;
+}
+
+boost::asio::awaitable<bool> websocket_client::connect(
+    const std::string& host,
+    const std::string& port,
+    const std::string& target,
+    const std::string& address
+)
 {
     /* parse host for http prefix to decide which protocol to use
-     * (ws or wss) */
-    bool use_ssl = false;
+     * (ws, wss or ws+unix) */
+    auto active = impl::scheme::ws;
     std::string token{"://"};
 
     std::size_t idx = host.find(token);
     if (idx != std::string::npos) {
         auto prefix = host.substr(0, idx);
         if (prefix == "wss") {
-            use_ssl = true;
+            active = impl::scheme::wss;
         } else if (prefix == "ws") {
-            use_ssl = false;
+            active = impl::scheme::ws;
+        } else if (prefix == "ws+unix") {
+            active = impl::scheme::ws_unix;
         } else {
             throw std::invalid_argument("Unrecognized prefix: " + prefix);
         }
@@ -308,25 +1116,78 @@ boost::asio::awaitable<bool> websocket_client::connect(
 
     const std::string host_to_use = (idx != std::string::npos) ? host.substr(idx + token.length()) : host;
 
-    auto resp = co_await pimpl_->connect(host_to_use, port, target, use_ssl);
-    co_return resp;
+    pimpl_->active = active;
+
+    if (active == impl::scheme::wss) {
+        auto resp = co_await pimpl_->tls.connect(host_to_use, port, target, address);
+        co_return resp;
+    } else if (active == impl::scheme::ws_unix) {
+        auto resp = co_await pimpl_->local.connect(host_to_use, port, target, address);
+        co_return resp;
+    } else {
+        auto resp = co_await pimpl_->plain.connect(host_to_use, port, target, address);
+        co_return resp;
+    }
 }
 
 bool websocket_client::is_connected() const {
-    return pimpl_->is_connected();
+    return pimpl_->with_active([](auto& c) { return c.is_connected(); });
+}
+
+void websocket_client::set_socket_options(const socket_options& options) {
+    pimpl_->with_each([&options](auto& c) { c.set_socket_options(options); });
+}
+
+void websocket_client::set_dns_resolver(std::shared_ptr<dns_resolver> resolver) {
+    pimpl_->with_each([&resolver](auto& c) { c.set_dns_resolver(resolver); });
+}
+
+void websocket_client::set_write_options(const websocket_write_options& options) {
+    pimpl_->with_each([&options](auto& c) { c.set_write_options(options); });
+}
+
+void websocket_client::set_compression_options(const websocket_compression_options& options) {
+    pimpl_->with_each([&options](auto& c) { c.set_compression_options(options); });
+}
+
+void websocket_client::set_ping_options(const websocket_ping_options& options) {
+    pimpl_->with_each([&options](auto& c) { c.set_ping_options(options); });
+}
+
+websocket_stats websocket_client::stats() const {
+    return pimpl_->with_active([](auto& c) { return c.stats(); });
 }
 
 boost::asio::awaitable<std::string> websocket_client::read() {
-    auto res = co_await pimpl_->read();
-    co_return res;
+    return pimpl_->with_active([](auto& c) { return c.read(); });
+}
+
+boost::asio::awaitable<ws_message> websocket_client::read_view() {
+    return pimpl_->with_active([](auto& c) { return c.read_view(); });
+}
+
+boost::asio::awaitable<ws_message> websocket_client::read_into(std::string& buffer) {
+    return pimpl_->with_active([&buffer](auto& c) { return c.read_into(buffer); });
+}
+
+boost::asio::awaitable<ws_frame> websocket_client::read_some(std::string& buffer, std::size_t max_bytes) {
+    return pimpl_->with_active([&buffer, max_bytes](auto& c) { return c.read_some(buffer, max_bytes); });
 }
 
 boost::asio::awaitable<void> websocket_client::write(const std::string& message) {
-    co_await pimpl_->write(message);
+    return pimpl_->with_active([&message](auto& c) { return c.write(message); });
+}
+
+boost::asio::awaitable<void> websocket_client::write(std::string_view message, ws_message_type type) {
+    return pimpl_->with_active([message, type](auto& c) { return c.write(message, type); });
+}
+
+boost::asio::awaitable<void> websocket_client::close(std::chrono::milliseconds timeout) {
+    return pimpl_->with_active([timeout](auto& c) { return c.close(timeout); });
 }
 
-void websocket_client::disconnect() {
-    return pimpl_->disconnect();
+void websocket_client::disconnect(std::chrono::milliseconds timeout) {
+    pimpl_->with_active([timeout](auto& c) { c.disconnect(timeout); });
 }
 
 websocket_client::websocket_client(websocket_client&& other)
@@ -338,4 +1199,4 @@ websocket_client& websocket_client::operator=(websocket_client&& other) {
     return *this;
 }
 
-} // ns zclient
\ No newline at end of file
+} // ns zclient
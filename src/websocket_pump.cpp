@@ -0,0 +1,82 @@
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <exception>
+
+#include "websocket_pump.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+namespace {
+
+/* a full ring first yields the io thread this many times, which covers a
+ * consumer that is only briefly behind, then sleeps between checks so a
+ * stalled consumer does not cost the io thread a whole core */
+constexpr std::size_t full_yields = 16;
+constexpr std::chrono::microseconds full_backoff{50};
+
+} // anonymous ns
+
+websocket_pump::websocket_pump(const websocket_pump_options& options)
+    :ring_{options.capacity, [&options](pumped_message& slot) { slot.data.reserve(options.slot_size); }}
+{}
+
+boost::asio::awaitable<void> websocket_pump::run(websocket_client& client) {
+    std::exception_ptr error;
+    auto ex = co_await boost::asio::this_coro::executor;
+
+    try {
+        while (true) {
+            auto* slot = ring_.claim();
+            if (!slot) {
+                full_waits_.fetch_add(1, std::memory_order_relaxed);
+
+                boost::asio::steady_timer backoff{ex};
+                for (std::size_t yields = 0; !slot; ++yields) {
+                    if (yields < full_yields) {
+                        /* let the io thread run other handlers meanwhile */
+                        co_await boost::asio::post(ex, boost::asio::use_awaitable);
+                    } else {
+                        backoff.expires_after(full_backoff);
+                        co_await backoff.async_wait(boost::asio::use_awaitable);
+                    }
+                    slot = ring_.claim();
+                }
+            }
+
+            /* read straight into the slot, whose storage is reused */
+            const auto message = co_await client.read_into(slot->data);
+
+            /* eof reads as an empty message */
+            if (!client.is_connected()) {
+                break;
+            }
+
+            slot->type = message.type;
+            slot->received = std::chrono::steady_clock::now();
+            ring_.publish();
+
+            messages_.fetch_add(1, std::memory_order_relaxed);
+        }
+    } catch (const websocket_server_disconnected_exception& e) {
+        LOG_TRACE << "Pump stopped: " << e.what();
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    done_.store(true, std::memory_order_release);
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+websocket_pump_stats websocket_pump::stats() const {
+    return websocket_pump_stats{
+        messages_.load(std::memory_order_relaxed),
+        full_waits_.load(std::memory_order_relaxed)
+    };
+}
+
+} // ns zclient
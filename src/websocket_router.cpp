@@ -0,0 +1,288 @@
+#include <boost/asio/experimental/as_tuple.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "websocket_router.hpp"
+#include "zlogger.hpp"
+
+namespace zclient {
+
+struct websocket_subscription::impl {
+    impl(const std::string& key, const subscription_options& options)
+        :key_{key},
+        options_{options}
+    {}
+
+    /* called by the router's reader, never waits */
+    void push(std::string_view message) {
+        if (closed_) {
+            return;
+        }
+
+        if (queue_.size() >= std::max<std::size_t>(options_.capacity, 1)) {
+            switch (options_.policy) {
+            case overflow_policy::drop_oldest: {
+                /* reuses the dropped message's storage */
+                auto recycled = std::move(queue_.front());
+                queue_.pop_front();
+                recycled.assign(message);
+                queue_.push_back(std::move(recycled));
+                ++stats_.dropped;
+                return;
+            }
+            case overflow_policy::drop_newest:
+                ++stats_.dropped;
+                return;
+            case overflow_policy::conflate:
+                /* reuses the replaced message's storage */
+                queue_.back().assign(message);
+                ++stats_.conflated;
+                return;
+            }
+        }
+
+        queue_.emplace_back(message);
+        wake();
+    }
+
+    boost::asio::awaitable<std::string> read() {
+        using boost::asio::experimental::as_tuple;
+
+        while (true) {
+            if (!queue_.empty()) {
+                auto message = std::move(queue_.front());
+                queue_.pop_front();
+                ++stats_.delivered;
+                co_return message;
+            }
+
+            if (closed_) {
+                throw websocket_server_disconnected_exception("Subscription to " + key_ + " has ended");
+            }
+
+            if (!signal_) {
+                signal_.emplace(co_await boost::asio::this_coro::executor);
+            }
+
+            signal_->expires_at(std::chrono::steady_clock::time_point::max());
+            co_await signal_->async_wait(as_tuple(boost::asio::use_awaitable));
+        }
+    }
+
+    /* queued messages can still be read */
+    void close() {
+        closed_ = true;
+        wake();
+    }
+
+    void wake() {
+        if (signal_) {
+            signal_->cancel();
+        }
+    }
+
+    const std::string key_;
+    const subscription_options options_;
+    subscription_stats stats_{};
+
+    std::deque<std::string> queue_;
+    bool closed_ = false;
+
+    /* wakes read() */
+    std::optional<boost::asio::steady_timer> signal_;
+};
+
+websocket_subscription::websocket_subscription(std::shared_ptr<impl> pimpl)
+    :pimpl_{std::move(pimpl)}
+{}
+
+boost::asio::awaitable<std::string> websocket_subscription::read() {
+    return pimpl_->read();
+}
+
+const std::string& websocket_subscription::key() const {
+    return pimpl_->key_;
+}
+
+subscription_stats websocket_subscription::stats() const {
+    auto stats = pimpl_->stats_;
+    stats.queued = pimpl_->queue_.size();
+    return stats;
+}
+
+
+struct websocket_router::impl {
+    /* lets the reader look keys up by string_view, without building a string */
+    struct key_hash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view key) const {
+            return std::hash<std::string_view>{}(key);
+        }
+    };
+
+    using subscribers = std::vector<std::shared_ptr<websocket_subscription::impl>>;
+
+    impl(websocket_client& client, key_extractor extractor)
+        :client_{client},
+        extractor_{std::move(extractor)}
+    {}
+
+    websocket_subscription subscribe(const std::string& key, const subscription_options& options) {
+        auto subscription = std::make_shared<websocket_subscription::impl>(key, options);
+        if (stopped_) {
+            subscription->close();
+        } else {
+            routes_[key].push_back(subscription);
+        }
+        return websocket_subscription{std::move(subscription)};
+    }
+
+    void unsubscribe(const websocket_subscription& subscription) {
+        if (!subscription.pimpl_) {
+            return;
+        }
+
+        auto it = routes_.find(subscription.pimpl_->key_);
+        if (it != routes_.end()) {
+            auto& subs = it->second;
+            subs.erase(std::remove(subs.begin(), subs.end(), subscription.pimpl_), subs.end());
+            if (subs.empty()) {
+                routes_.erase(it);
+            }
+        }
+
+        subscription.pimpl_->close();
+    }
+
+    boost::asio::awaitable<void> run() {
+        std::exception_ptr error;
+
+        try {
+            while (true) {
+                const auto message = co_await client_.read_view();
+
+                /* eof reads as an empty message */
+                if (!client_.is_connected()) {
+                    break;
+                }
+
+                route(message.data);
+            }
+        } catch (const websocket_server_disconnected_exception& e) {
+            LOG_TRACE << "Router stopped: " << e.what();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        stopped_ = true;
+        for (auto& [key, subs] : routes_) {
+            for (auto& subscription : subs) {
+                subscription->close();
+            }
+        }
+        routes_.clear();
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /* the message is only copied into the queues subscribed to its key */
+    void route(std::string_view message) {
+        ++stats_.messages;
+
+        const auto key = extractor_(message);
+        if (!key) {
+            ++stats_.unrouted;
+            return;
+        }
+
+        auto it = routes_.find(*key);
+        if (it == routes_.end()) {
+            ++stats_.unrouted;
+            return;
+        }
+
+        for (auto& subscription : it->second) {
+            subscription->push(message);
+        }
+    }
+
+    websocket_client& client_;
+    key_extractor extractor_;
+    websocket_router_stats stats_{};
+    bool stopped_ = false;
+
+    std::unordered_map<std::string, subscribers, key_hash, std::equal_to<>> routes_;
+};
+
+websocket_router::websocket_router(websocket_client& client, key_extractor extractor)
+    :pimpl_{std::make_unique<impl>(client, std::move(extractor))}
+{}
+
+websocket_router::~websocket_router() = default;
+
+websocket_subscription websocket_router::subscribe(const std::string& key, const subscription_options& options) {
+    return pimpl_->subscribe(key, options);
+}
+
+void websocket_router::unsubscribe(const websocket_subscription& subscription) {
+    pimpl_->unsubscribe(subscription);
+}
+
+boost::asio::awaitable<void> websocket_router::run() {
+    return pimpl_->run();
+}
+
+websocket_router_stats websocket_router::stats() const {
+    return pimpl_->stats_;
+}
+
+websocket_router::key_extractor json_field_extractor(const std::string& field) {
+    return [needle = "\"" + field + "\""](std::string_view message) -> std::optional<std::string_view> {
+        const auto is_space = [](char c) {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        };
+
+        /* the name may also turn up as a value, e.g. {"e":"s","s":"BTCUSDT"}:
+         * the key is the first occurrence followed by a colon */
+        std::size_t pos = 0;
+        for (auto found = message.find(needle); ; found = message.find(needle, found + 1)) {
+            if (found == std::string_view::npos) {
+                return std::nullopt;
+            }
+
+            pos = found + needle.size();
+            while (pos < message.size() && is_space(message[pos])) {
+                ++pos;
+            }
+            if (pos < message.size() && message[pos] == ':') {
+                break;
+            }
+        }
+        ++pos;
+
+        while (pos < message.size() && is_space(message[pos])) {
+            ++pos;
+        }
+        if (pos >= message.size() || message[pos] != '"') {
+            return std::nullopt;
+        }
+        ++pos;
+
+        const auto end = message.find('"', pos);
+        if (end == std::string_view::npos) {
+            return std::nullopt;
+        }
+
+        return message.substr(pos, end - pos);
+    };
+}
+
+} // ns zclient
@@ -0,0 +1,817 @@
+#include <boost/asio/as_tuple.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/version.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include "mock_server.hpp"
+#include "zlogger.hpp"
+
+namespace zclient::mock {
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+namespace websocket = boost::beast::websocket;
+using tcp = boost::asio::ip::tcp;
+using local = boost::asio::local::stream_protocol;
+using local_stream = beast::basic_stream<local>;
+
+namespace {
+
+/* bytes [offset, offset + size) of the generated body */
+std::string generate_body(std::size_t size, std::size_t offset = 0) {
+    static constexpr char pattern[] = "0123456789abcdefghijklmnopqrstuvwxyz\n";
+
+    std::string body(size, '\0');
+    for (std::size_t i = 0; i < size; ++i) {
+        body[i] = pattern[(offset + i) % (sizeof(pattern) - 1)];
+    }
+
+    return body;
+}
+
+/* gzip member (RFC 1952) around a raw deflate stream */
+std::string gzip_compress(const std::string& input) {
+    beast::zlib::deflate_stream ds;
+    ds.reset(6, 15, 8, beast::zlib::Strategy::normal);
+
+    std::string deflated(ds.upper_bound(input.size()), '\0');
+
+    beast::zlib::z_params zs;
+    zs.next_in = input.data();
+    zs.avail_in = input.size();
+    zs.next_out = deflated.data();
+    zs.avail_out = deflated.size();
+
+    beast::error_code ec;
+    ds.write(zs, beast::zlib::Flush::finish, ec);
+    if (ec && ec != beast::zlib::error::end_of_stream) {
+        throw beast::system_error(ec);
+    }
+    deflated.resize(zs.total_out);
+
+    boost::crc_32_type crc;
+    crc.process_bytes(input.data(), input.size());
+
+    const auto put_le32 = [](std::string& out, std::uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+    };
+
+    std::string out{"\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10};
+    out += deflated;
+    put_le32(out, crc.checksum());
+    put_le32(out, static_cast<std::uint32_t>(input.size()));
+
+    return out;
+}
+
+template <typename Stream>
+void graceful_close(Stream& stream) {
+    beast::error_code ec;
+    beast::get_lowest_layer(stream).socket().shutdown(tcp::socket::shutdown_send, ec);
+}
+
+template <typename Stream>
+net::awaitable<void> graceful_close(beast::ssl_stream<Stream>& stream) {
+    beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(5));
+    co_await stream.async_shutdown(net::as_tuple(net::use_awaitable));
+}
+
+} // anonymous ns
+
+/* type-erased handle used for broadcasting to websocket sessions of any stream type */
+struct ws_sink {
+    virtual ~ws_sink() = default;
+    virtual void send(std::shared_ptr<const std::string> message, bool binary) = 0;
+    virtual void drop() = 0;
+};
+
+struct mock_server::impl {
+    explicit impl(mock_server_config config)
+        :config_{std::move(config)}
+        ,ssl_ctx_{net::ssl::context::tls_server}
+    {}
+
+    mock_server_config config_;
+    std::unordered_map<std::string, mock_endpoint> endpoints_;
+    net::ssl::context ssl_ctx_;
+
+    std::mutex sessions_mutex_;
+    std::unordered_map<std::string, std::vector<std::weak_ptr<ws_sink>>> ws_sessions_;
+
+    std::atomic<std::size_t> connections_{0};
+    std::atomic<std::size_t> requests_{0};
+    std::atomic<std::size_t> ws_messages_received_{0};
+    std::atomic<std::size_t> ws_messages_sent_{0};
+    std::atomic<std::size_t> tls_resumptions_{0};
+    std::atomic<std::size_t> tls_early_data_rejected_{0};
+    std::atomic<std::size_t> tls_early_data_accepted_{0};
+
+    /* members are destroyed last to first: the io_context, with the session
+     * frames still pending on it, goes before everything above that they
+     * refer to, and after the acceptors below that need it */
+    net::io_context ioc_;
+    std::optional<tcp::acceptor> plain_acceptor_;
+    std::optional<tcp::acceptor> tls_acceptor_;
+    std::optional<local::acceptor> unix_acceptor_;
+    std::vector<std::thread> threads_;
+
+    template <typename Stream>
+    struct ws_session : ws_sink, std::enable_shared_from_this<ws_session<Stream>> {
+        ws_session(Stream&& stream, impl& server)
+            :ws_{std::move(stream)}
+            ,signal_{ws_.get_executor(), std::chrono::steady_clock::time_point::max()}
+            ,server_{server}
+        {}
+
+        void send(std::shared_ptr<const std::string> message, bool binary) override {
+            net::post(ws_.get_executor(), [self = this->shared_from_this(), message = std::move(message), binary]() {
+                if (self->closed_) return;
+                self->outbound_.emplace_back(std::move(message), binary);
+                self->signal_.cancel_one();
+            });
+        }
+
+        /* close the socket without a close frame, like a dropped link */
+        void drop() override {
+            net::post(ws_.get_executor(), [self = this->shared_from_this()]() {
+                beast::error_code ec;
+                beast::get_lowest_layer(self->ws_).socket().close(ec);
+            });
+        }
+
+        net::awaitable<void> writer() {
+            auto self = this->shared_from_this();
+
+            while (!closed_) {
+                if (outbound_.empty()) {
+                    co_await signal_.async_wait(net::as_tuple(net::use_awaitable));
+                    continue;
+                }
+
+                auto [message, binary] = std::move(outbound_.front());
+                outbound_.pop_front();
+
+                ws_.binary(binary);
+                auto [ec, bytes] = co_await ws_.async_write(net::buffer(*message), net::as_tuple(net::use_awaitable));
+                if (ec) break;
+
+                ++server_.ws_messages_sent_;
+            }
+        }
+
+        net::awaitable<void> publisher(const mock_endpoint& ep) {
+            auto self = this->shared_from_this();
+            auto payload = std::make_shared<const std::string>(generate_body(ep.ws_publish_size));
+            net::steady_timer timer{ws_.get_executor()};
+
+            for (std::size_t i = 0; i < ep.ws_publish_count && !closed_; ++i) {
+                send(payload, false);
+
+                if (ep.ws_publish_interval.count()) {
+                    timer.expires_after(ep.ws_publish_interval);
+                    co_await timer.async_wait(net::as_tuple(net::use_awaitable));
+                }
+            }
+        }
+
+        void close() {
+            closed_ = true;
+            signal_.cancel();
+        }
+
+        websocket::stream<Stream> ws_;
+        net::steady_timer signal_;
+        std::deque<std::pair<std::shared_ptr<const std::string>, bool>> outbound_;
+        bool closed_ = false;
+        impl& server_;
+    };
+
+    const mock_endpoint* find_endpoint(beast::string_view target, beast::string_view method) const {
+        auto it = endpoints_.find(std::string(target));
+        if (it == endpoints_.end()) return nullptr;
+        if (it->second.method != "*" && !beast::iequals(it->second.method, method)) return nullptr;
+
+        return &it->second;
+    }
+
+    void register_session(const std::string& target, std::weak_ptr<ws_sink> session) {
+        std::lock_guard lock{sessions_mutex_};
+
+        auto& sessions = ws_sessions_[target];
+        std::erase_if(sessions, [](const auto& s) { return s.expired(); });
+        sessions.push_back(std::move(session));
+    }
+
+    std::size_t broadcast(const std::string& target, std::shared_ptr<const std::string> message, bool binary) {
+        std::vector<std::shared_ptr<ws_sink>> targets;
+        {
+            std::lock_guard lock{sessions_mutex_};
+
+            auto it = ws_sessions_.find(target);
+            if (it == ws_sessions_.end()) return 0;
+
+            for (const auto& weak : it->second) {
+                if (auto s = weak.lock()) targets.push_back(std::move(s));
+            }
+        }
+
+        for (auto& s : targets) {
+            s->send(message, binary);
+        }
+
+        return targets.size();
+    }
+
+    std::size_t drop_websockets(const std::string& target, std::size_t count) {
+        std::vector<std::shared_ptr<ws_sink>> targets;
+        {
+            std::lock_guard lock{sessions_mutex_};
+
+            auto it = ws_sessions_.find(target);
+            if (it == ws_sessions_.end()) return 0;
+
+            /* sessions are kept in connection order */
+            for (const auto& weak : it->second) {
+                if (targets.size() == count) break;
+                if (auto s = weak.lock()) targets.push_back(std::move(s));
+            }
+        }
+
+        for (auto& s : targets) {
+            s->drop();
+        }
+
+        return targets.size();
+    }
+
+    /* write body in paced slices honouring the chunking and throttling script */
+    template <typename Stream>
+    net::awaitable<void> write_body(Stream& stream, const std::string& body, const mock_endpoint& ep) {
+        using clock = std::chrono::steady_clock;
+
+        std::size_t slice = body.size();
+        if (ep.chunk_size) {
+            slice = ep.chunk_size;
+        } else if (ep.bytes_per_second) {
+            /* aim for ~50 writes per second when throttling */
+            slice = std::max<std::size_t>(ep.bytes_per_second / 50, 1);
+        }
+
+        net::steady_timer timer{stream.get_executor()};
+        const auto start = clock::now();
+        std::size_t written = 0;
+
+        while (written < body.size()) {
+            const std::size_t n = std::min(slice, body.size() - written);
+            const auto piece = net::buffer(body.data() + written, n);
+
+            if (ep.chunk_size) {
+                co_await net::async_write(stream, http::make_chunk(piece), net::use_awaitable);
+            } else {
+                co_await net::async_write(stream, piece, net::use_awaitable);
+            }
+            written += n;
+
+            if (written == body.size()) break;
+
+            auto next = clock::now() + ep.chunk_interval;
+            if (ep.bytes_per_second) {
+                next = std::max(next, start + std::chrono::microseconds(written * 1'000'000 / ep.bytes_per_second));
+            }
+            if (next > clock::now()) {
+                timer.expires_at(next);
+                co_await timer.async_wait(net::use_awaitable);
+            }
+        }
+
+        if (ep.chunk_size) {
+            co_await net::async_write(stream, http::make_chunk_last(), net::use_awaitable);
+        }
+    }
+
+    /* the part of the endpoint's body picked by the request's Range header,
+     * with the status and Content-Range set to match. Only the slice is generated */
+    static std::string ranged_body(const http::request<http::string_body>& req, const mock_endpoint& ep, http::response<http::empty_body>& res) {
+        const std::size_t size = ep.body.empty() ? ep.body_size : ep.body.size();
+        res.set(http::field::accept_ranges, "bytes");
+
+        const auto range = req[http::field::range];
+        const auto if_range = req[http::field::if_range];
+
+        std::size_t first = 0;
+        std::size_t last = size ? size - 1 : 0;
+        bool partial = range.starts_with("bytes=") && (if_range.empty() || if_range == ep.etag);
+
+        if (partial) {
+            const char* p = range.data() + 6;
+            const char* end = range.data() + range.size();
+
+            auto [after_first, ec] = std::from_chars(p, end, first);
+            partial = ec == std::errc{} && after_first != end && *after_first == '-';
+            if (partial && after_first + 1 != end) {
+                std::size_t requested_last = 0;
+                auto [after_last, last_ec] = std::from_chars(after_first + 1, end, requested_last);
+                partial = last_ec == std::errc{} && after_last == end && requested_last >= first;
+                if (partial) last = std::min(last, requested_last);
+            }
+        }
+
+        if (partial && first >= size) {
+            res.result(http::status::range_not_satisfiable);
+            res.set(http::field::content_range, "bytes */" + std::to_string(size));
+            return {};
+        }
+
+        if (!partial) {
+            first = 0;
+        } else {
+            res.result(http::status::partial_content);
+            res.set(http::field::content_range,
+                "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size));
+        }
+
+        const std::size_t length = size ? last - first + 1 : 0;
+        return ep.body.empty() ? generate_body(length, first) : ep.body.substr(first, length);
+    }
+
+    /* the endpoint's events after the request's Last-Event-ID, as a text/event-stream */
+    static std::string event_stream_body(const http::request<http::string_body>& req, const mock_endpoint& ep, http::response<http::empty_body>& res) {
+        res.set(http::field::content_type, "text/event-stream");
+        res.set(http::field::cache_control, "no-cache");
+
+        std::size_t next = 0;
+        const auto last_id = req["Last-Event-ID"];
+        std::from_chars(last_id.data(), last_id.data() + last_id.size(), next);
+
+        const std::size_t end = ep.sse_events_per_response
+            ? std::min(ep.sse_events.size(), next + ep.sse_events_per_response)
+            : ep.sse_events.size();
+
+        std::string body;
+        for (std::size_t i = next; i < end; ++i) {
+            body += "id: " + std::to_string(i + 1) + "\n";
+
+            std::size_t start = 0;
+            while (true) {
+                const auto eol = ep.sse_events[i].find('\n', start);
+                body += "data: " + ep.sse_events[i].substr(start, eol - start) + "\n";
+                if (eol == std::string::npos) break;
+                start = eol + 1;
+            }
+            body += "\n";
+        }
+        return body;
+    }
+
+    /* returns whether the connection should be kept alive */
+    template <typename Stream>
+    net::awaitable<bool> respond(Stream& stream, const http::request<http::string_body>& req, bool early_data = false) {
+        ++requests_;
+
+        const mock_endpoint* ep = find_endpoint(req.target(), req.method_string());
+
+        static const mock_endpoint not_found{.status = 404, .body = "Not found"};
+        static const mock_endpoint too_early{.status = 425, .body = "Too Early"};
+        const mock_endpoint& script = !ep ? not_found : early_data && ep->reject_early_data ? too_early : *ep;
+
+        if (script.latency.count()) {
+            net::steady_timer timer{stream.get_executor(), script.latency};
+            co_await timer.async_wait(net::use_awaitable);
+        }
+
+        http::response<http::empty_body> res{static_cast<http::status>(script.status), req.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+
+        std::string body;
+        if (script.echo) {
+            for (const auto& field : req) {
+                switch (field.name()) {
+                case http::field::content_length:
+                case http::field::transfer_encoding:
+                case http::field::connection:
+                case http::field::host:
+                    break;
+                default:
+                    res.set(field.name_string(), field.value());
+                }
+            }
+            body = req.body();
+        } else if (script.ranges) {
+            body = ranged_body(req, script, res);
+        } else if (!script.sse_events.empty()) {
+            body = event_stream_body(req, script, res);
+        } else {
+            body = script.body.empty() ? generate_body(script.body_size) : script.body;
+        }
+
+        if (!script.etag.empty()) {
+            res.set(http::field::etag, script.etag);
+        }
+
+        for (const auto& [name, value] : script.header_data) {
+            res.set(name, value);
+        }
+
+        if (script.gzip) {
+            body = gzip_compress(body);
+            res.set(http::field::content_encoding, "gzip");
+        }
+
+        const bool keep_alive = req.keep_alive() && !script.close_connection;
+        res.keep_alive(keep_alive);
+
+        if (script.chunk_size) {
+            res.chunked(true);
+        } else {
+            res.content_length(body.size());
+        }
+
+        http::response_serializer<http::empty_body> sr{res};
+        co_await http::async_write_header(stream, sr, net::use_awaitable);
+
+        if (req.method() != http::verb::head) {
+            co_await write_body(stream, body, script);
+        }
+
+        co_return keep_alive;
+    }
+
+    template <typename Stream>
+    net::awaitable<void> serve_websocket(Stream stream, http::request<http::string_body> req, const mock_endpoint& ep) {
+        auto session = std::make_shared<ws_session<Stream>>(std::move(stream), *this);
+        auto& ws = session->ws_;
+
+        beast::get_lowest_layer(ws).expires_never();
+        ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+
+        if (ep.ws_permessage_deflate) {
+            websocket::permessage_deflate pmd;
+            pmd.server_enable = true;
+            ws.set_option(pmd);
+        }
+
+        co_await ws.async_accept(req, net::use_awaitable);
+
+        register_session(ep.target, session);
+
+        auto ex = co_await net::this_coro::executor;
+        net::co_spawn(ex, session->writer(), net::detached);
+        if (ep.ws_publish_count) {
+            net::co_spawn(ex, session->publisher(ep), net::detached);
+        }
+
+        beast::flat_buffer buffer;
+        while (true) {
+            auto [ec, bytes] = co_await ws.async_read(buffer, net::as_tuple(net::use_awaitable));
+            if (ec) break;
+
+            ++ws_messages_received_;
+
+            auto message = std::make_shared<const std::string>(beast::buffers_to_string(buffer.data()));
+            buffer.consume(buffer.size());
+
+            if (ep.ws_mode == websocket_mode::broadcast) {
+                broadcast(ep.target, std::move(message), ws.got_binary());
+            } else if (ep.ws_mode == websocket_mode::echo) {
+                session->send(std::move(message), ws.got_binary());
+            }
+        }
+
+        session->close();
+    }
+
+    /* received: bytes read off the stream already, the first early_data_size
+     * of them sent as TLS early data */
+    template <typename Stream>
+    net::awaitable<void> serve_http(Stream stream, std::string received = {}, std::size_t early_data_size = 0) {
+        beast::flat_buffer buffer;
+        buffer.commit(net::buffer_copy(buffer.prepare(received.size()), net::buffer(received)));
+
+        while (true) {
+            http::request_parser<http::string_body> parser;
+            parser.body_limit(64 * 1024 * 1024);
+
+            beast::get_lowest_layer(stream).expires_after(config_.idle_timeout);
+            auto [ec, bytes] = co_await http::async_read(stream, buffer, parser, net::as_tuple(net::use_awaitable));
+            if (ec) break;
+
+            beast::get_lowest_layer(stream).expires_never();
+            auto req = parser.release();
+
+            if (websocket::is_upgrade(req)) {
+                const mock_endpoint* ep = find_endpoint(req.target(), req.method_string());
+                if (ep && ep->ws_mode != websocket_mode::none) {
+                    co_await serve_websocket(std::move(stream), std::move(req), *ep);
+                    co_return;
+                }
+            }
+
+            /* only a request wholly in the early data counts as sent early */
+            const bool in_early_data = bytes <= early_data_size;
+            early_data_size = 0;
+
+            if (!co_await respond(stream, req, in_early_data)) break;
+        }
+
+        if constexpr (std::is_same_v<Stream, beast::tcp_stream> || std::is_same_v<Stream, local_stream>) {
+            graceful_close(stream);
+        } else {
+            co_await graceful_close(stream);
+        }
+    }
+
+    /* writes out what OpenSSL left in the memory BIO */
+    static net::awaitable<void> flush(beast::tcp_stream& socket, BIO* out) {
+        char* data = nullptr;
+        const long size = BIO_get_mem_data(out, &data);
+        if (size <= 0) co_return;
+
+        std::string pending{data, static_cast<std::size_t>(size)};
+        (void)BIO_reset(out);
+        co_await net::async_write(socket, net::buffer(pending), net::use_awaitable);
+    }
+
+    static net::awaitable<void> fill(beast::tcp_stream& socket, BIO* in) {
+        char data[16 * 1024];
+        const std::size_t size = co_await socket.async_read_some(net::buffer(data), net::use_awaitable);
+        BIO_write(in, data, static_cast<int>(size));
+    }
+
+    /* The server handshake, run by hand through memory BIOs since asio's
+     * engine has no SSL_read_early_data. Returns the early data followed by
+     * any application data that came in with the handshake, and the size of
+     * the early data */
+    net::awaitable<std::pair<std::string, std::size_t>> accept_early_data(beast::ssl_stream<beast::tcp_stream>& stream) {
+        SSL* ssl = stream.native_handle();
+        auto& socket = beast::get_lowest_layer(stream);
+
+        BIO* in = BIO_new(BIO_s_mem());
+        BIO* out = BIO_new(BIO_s_mem());
+        BIO* engine_bio = SSL_get_rbio(ssl);
+        BIO_up_ref(engine_bio);
+        SSL_set_bio(ssl, in, out);
+        SSL_set_accept_state(ssl);
+
+        /* gives the engine back its BIO, freeing in and out */
+        struct restore_bio {
+            SSL* ssl;
+            BIO* bio;
+            ~restore_bio() { SSL_set_bio(ssl, bio, bio); }
+        } restore{ssl, engine_bio};
+
+        std::string received;
+        char data[16 * 1024];
+
+        bool reading_early_data = true;
+        while (reading_early_data) {
+            std::size_t size = 0;
+            const int rc = SSL_read_early_data(ssl, data, sizeof(data), &size);
+            co_await flush(socket, out);
+
+            if (rc == SSL_READ_EARLY_DATA_SUCCESS) {
+                received.append(data, size);
+            } else if (rc == SSL_READ_EARLY_DATA_FINISH) {
+                reading_early_data = false;
+            } else if (SSL_get_error(ssl, rc) == SSL_ERROR_WANT_READ) {
+                co_await fill(socket, in);
+            } else {
+                ERR_clear_error();
+                throw std::runtime_error("early data handshake failed");
+            }
+        }
+
+        const std::size_t early_data_size = received.size();
+
+        while (true) {
+            const int rc = SSL_do_handshake(ssl);
+            co_await flush(socket, out);
+            if (rc == 1) break;
+
+            if (SSL_get_error(ssl, rc) != SSL_ERROR_WANT_READ) {
+                ERR_clear_error();
+                throw std::runtime_error("handshake failed");
+            }
+            co_await fill(socket, in);
+        }
+
+        /* records past the handshake are still in the memory BIO */
+        while (BIO_ctrl_pending(in)) {
+            const int size = SSL_read(ssl, data, sizeof(data));
+            if (size <= 0) break;
+            received.append(data, size);
+        }
+        ERR_clear_error();
+        co_await flush(socket, out);
+
+        co_return std::make_pair(std::move(received), early_data_size);
+    }
+
+    net::awaitable<void> session(tcp::socket socket, bool tls) {
+        ++connections_;
+
+        try {
+            beast::tcp_stream stream{std::move(socket)};
+            if (!tls) {
+                co_await serve_http(std::move(stream));
+                co_return;
+            }
+
+            beast::ssl_stream<beast::tcp_stream> ssl_stream{std::move(stream), ssl_ctx_};
+            beast::get_lowest_layer(ssl_stream).expires_after(config_.idle_timeout);
+
+            std::pair<std::string, std::size_t> received;
+            if (config_.tls_accept_early_data) {
+                received = co_await accept_early_data(ssl_stream);
+            } else {
+                co_await ssl_stream.async_handshake(net::ssl::stream_base::server, net::use_awaitable);
+            }
+
+            if (SSL_session_reused(ssl_stream.native_handle())) {
+                ++tls_resumptions_;
+            }
+            switch (SSL_get_early_data_status(ssl_stream.native_handle())) {
+            case SSL_EARLY_DATA_REJECTED:
+                ++tls_early_data_rejected_;
+                break;
+            case SSL_EARLY_DATA_ACCEPTED:
+                ++tls_early_data_accepted_;
+                break;
+            }
+
+            co_await serve_http(std::move(ssl_stream), std::move(received.first), received.second);
+        } catch (std::exception& e) {
+            LOG_TRACE << "mock_server session ended: " << e.what();
+        }
+    }
+
+    net::awaitable<void> listen(tcp::acceptor& acceptor, bool tls) {
+        while (acceptor.is_open()) {
+            tcp::socket socket{net::make_strand(ioc_)};
+            auto [ec] = co_await acceptor.async_accept(socket, net::as_tuple(net::use_awaitable));
+            if (ec) {
+                if (ec == net::error::operation_aborted) break;
+                continue;
+            }
+
+            socket.set_option(tcp::no_delay{true});
+
+            auto ex = socket.get_executor();
+            net::co_spawn(ex, session(std::move(socket), tls), net::detached);
+        }
+    }
+
+    net::awaitable<void> unix_session(local::socket socket) {
+        ++connections_;
+
+        try {
+            co_await serve_http(local_stream{std::move(socket)});
+        } catch (std::exception& e) {
+            LOG_TRACE << "mock_server session ended: " << e.what();
+        }
+    }
+
+    net::awaitable<void> listen_unix(local::acceptor& acceptor) {
+        while (acceptor.is_open()) {
+            local::socket socket{net::make_strand(ioc_)};
+            auto [ec] = co_await acceptor.async_accept(socket, net::as_tuple(net::use_awaitable));
+            if (ec) {
+                if (ec == net::error::operation_aborted) break;
+                continue;
+            }
+
+            auto ex = socket.get_executor();
+            net::co_spawn(ex, unix_session(std::move(socket)), net::detached);
+        }
+    }
+
+    tcp::acceptor open_acceptor(unsigned short port) {
+        tcp::endpoint endpoint{net::ip::make_address(config_.address), port};
+
+        tcp::acceptor acceptor{ioc_};
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(net::socket_base::reuse_address(true));
+        acceptor.bind(endpoint);
+        acceptor.listen(net::socket_base::max_listen_connections);
+
+        return acceptor;
+    }
+
+    void start() {
+        plain_acceptor_.emplace(open_acceptor(config_.plain_port));
+        net::co_spawn(ioc_, listen(*plain_acceptor_, false), net::detached);
+
+        if (!config_.tls_cert_file.empty() && !config_.tls_key_file.empty()) {
+            ssl_ctx_.use_certificate_chain_file(config_.tls_cert_file);
+            ssl_ctx_.use_private_key_file(config_.tls_key_file, net::ssl::context::pem);
+            SSL_CTX_set_max_early_data(ssl_ctx_.native_handle(), config_.tls_max_early_data);
+            if (config_.tls_max_version) {
+                SSL_CTX_set_max_proto_version(ssl_ctx_.native_handle(), config_.tls_max_version);
+            }
+
+            tls_acceptor_.emplace(open_acceptor(config_.tls_port));
+            net::co_spawn(ioc_, listen(*tls_acceptor_, true), net::detached);
+        }
+
+        if (!config_.unix_socket_path.empty()) {
+            std::remove(config_.unix_socket_path.c_str());
+            unix_acceptor_.emplace(ioc_, local::endpoint{config_.unix_socket_path});
+            net::co_spawn(ioc_, listen_unix(*unix_acceptor_), net::detached);
+        }
+
+        for (unsigned i = 0; i < std::max(config_.threads, 1u); ++i) {
+            threads_.emplace_back([this]() { ioc_.run(); });
+        }
+
+        LOG_TRACE << "mock_server listening on " << config_.address << ":" << plain_acceptor_->local_endpoint().port();
+    }
+
+    void stop() {
+        if (threads_.empty()) return;
+
+        ioc_.stop();
+        for (auto& t : threads_) {
+            t.join();
+        }
+        threads_.clear();
+
+        if (unix_acceptor_) {
+            std::remove(config_.unix_socket_path.c_str());
+        }
+    }
+};
+
+mock_server::mock_server(mock_server_config config)
+    :pimpl_{std::make_unique<impl>(std::move(config))}
+{}
+
+mock_server::~mock_server() {
+    stop();
+}
+
+void mock_server::add_endpoint(mock_endpoint endpoint) {
+    auto target = endpoint.target;
+    pimpl_->endpoints_.insert_or_assign(std::move(target), std::move(endpoint));
+}
+
+void mock_server::start() {
+    pimpl_->start();
+}
+
+void mock_server::stop() {
+    pimpl_->stop();
+}
+
+unsigned short mock_server::plain_port() const {
+    return pimpl_->plain_acceptor_ ? pimpl_->plain_acceptor_->local_endpoint().port() : 0;
+}
+
+unsigned short mock_server::tls_port() const {
+    return pimpl_->tls_acceptor_ ? pimpl_->tls_acceptor_->local_endpoint().port() : 0;
+}
+
+std::size_t mock_server::broadcast(const std::string& target, const std::string& message, bool binary) {
+    return pimpl_->broadcast(target, std::make_shared<const std::string>(message), binary);
+}
+
+std::size_t mock_server::drop_websockets(const std::string& target, std::size_t count) {
+    return pimpl_->drop_websockets(target, count);
+}
+
+mock_server_stats mock_server::stats() const {
+    return mock_server_stats{
+        .connections = pimpl_->connections_,
+        .requests = pimpl_->requests_,
+        .ws_messages_received = pimpl_->ws_messages_received_,
+        .ws_messages_sent = pimpl_->ws_messages_sent_,
+        .tls_resumptions = pimpl_->tls_resumptions_,
+        .tls_early_data_rejected = pimpl_->tls_early_data_rejected_,
+        .tls_early_data_accepted = pimpl_->tls_early_data_accepted_
+    };
+}
+
+} // ns zclient::mock
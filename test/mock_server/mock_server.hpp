@@ -0,0 +1,154 @@
+#ifndef MOCK_SERVER_HPP
+#define MOCK_SERVER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zclient::mock {
+
+enum class websocket_mode {
+    none,       /* plain HTTP endpoint */
+    echo,       /* every message is sent back to its sender */
+    broadcast   /* every message is sent to all sessions connected to the endpoint */
+};
+
+/* Scriptable behaviour of a single endpoint. Everything defaults to an
+ * immediate, keep-alive, content-length delimited 200 response. */
+struct mock_endpoint {
+    std::string target;
+    std::string method = "GET"; /* "*" matches any method */
+
+    unsigned status = 200;
+    std::string body;
+    std::size_t body_size = 0; /* if non-zero (and body is empty), generate a body of this many bytes */
+    std::vector<std::pair<std::string, std::string>> header_data;
+
+    /* respond with the request's own headers and body */
+    bool echo = false;
+
+    /* delay before the response header is written */
+    std::chrono::milliseconds latency{0};
+
+    /* throttle the body to this rate. 0 = unthrottled */
+    std::size_t bytes_per_second = 0;
+
+    /* if non-zero, use Transfer-Encoding: chunked with chunks of this size,
+     * each chunk written chunk_interval after the previous one */
+    std::size_t chunk_size = 0;
+    std::chrono::milliseconds chunk_interval{0};
+
+    /* answer with Connection: close and close the socket after the response */
+    bool close_connection = false;
+
+    /* serve the body with Content-Encoding: gzip */
+    bool gzip = false;
+
+    /* sent as the ETag header when set */
+    std::string etag;
+
+    /* honour a single "Range: bytes=first-[last]" request (unless an If-Range
+     * differs from etag) with 206 and Content-Range, 416 past the end */
+    bool ranges = false;
+
+    /* serve these as a text/event-stream with ids 1, 2... (lines of an event
+     * become data lines), starting after the request's Last-Event-ID. Pace
+     * them with chunk_size/chunk_interval */
+    std::vector<std::string> sse_events;
+
+    /* end the response after this many events, 0 = after all of them */
+    std::size_t sse_events_per_response = 0;
+
+    /* websocket behaviour, the endpoint accepts upgrades when not none */
+    websocket_mode ws_mode = websocket_mode::none;
+    bool ws_permessage_deflate = false;
+
+    /* server-initiated load: on connect, push ws_publish_count messages of
+     * ws_publish_size bytes, ws_publish_interval apart */
+    std::size_t ws_publish_count = 0;
+    std::size_t ws_publish_size = 64;
+    std::chrono::microseconds ws_publish_interval{0};
+
+    /* answer 425 Too Early to a request that arrived as TLS early data */
+    bool reject_early_data = false;
+};
+
+struct mock_server_config {
+    std::string address = "127.0.0.1";
+
+    /* 0 = pick an ephemeral port, query it with plain_port() after start() */
+    unsigned short plain_port = 0;
+
+    /* the TLS listener is only started when both files are provided */
+    unsigned short tls_port = 0;
+    std::string tls_cert_file;
+    std::string tls_key_file;
+
+    /* TLS 1.3 early data the server's session tickets allow. Unless
+     * tls_accept_early_data, the server never reads it, so it is rejected and
+     * the client has to send the request again */
+    std::uint32_t tls_max_early_data = 0;
+    bool tls_accept_early_data = false;
+
+    /* highest TLS version spoken, e.g. TLS1_2_VERSION. 0 = OpenSSL's */
+    int tls_max_version = 0;
+
+    /* also serve plain HTTP/websocket on this AF_UNIX socket path when set,
+     * replacing any file left there (POSIX only) */
+    std::string unix_socket_path;
+
+    std::chrono::seconds idle_timeout{30};
+    unsigned threads = 1;
+};
+
+struct mock_server_stats {
+    std::size_t connections;
+    std::size_t requests;
+    std::size_t ws_messages_received;
+    std::size_t ws_messages_sent;
+    std::size_t tls_resumptions;
+    std::size_t tls_early_data_rejected;
+    std::size_t tls_early_data_accepted;
+};
+
+/* In-process HTTP/websocket server for tests and benchmarks. Runs on its
+ * own io_context and threads so it never competes with zclient's. */
+class mock_server {
+public:
+    explicit mock_server(mock_server_config config = {});
+    ~mock_server();
+
+    mock_server(const mock_server& other) = delete;
+    mock_server& operator=(const mock_server& other) = delete;
+
+    /* endpoints must be added before start() */
+    void add_endpoint(mock_endpoint endpoint);
+
+    void start();
+    void stop();
+
+    unsigned short plain_port() const;
+    unsigned short tls_port() const;
+
+    /* send a message to every websocket session connected to target.
+     * Returns the number of sessions it was queued to */
+    std::size_t broadcast(const std::string& target, const std::string& message, bool binary = false);
+
+    /* close the sockets of the count oldest websocket sessions on target
+     * without a close frame. Returns the number of sessions dropped */
+    std::size_t drop_websockets(const std::string& target, std::size_t count = SIZE_MAX);
+
+    mock_server_stats stats() const;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+} // ns zclient::mock
+
+#endif // MOCK_SERVER_HPP
@@ -0,0 +1,144 @@
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/program_options.hpp>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+
+#include "mock_server.hpp"
+#include "json/json.h"
+
+namespace po = boost::program_options;
+using namespace zclient::mock;
+
+/* Endpoint config is a JSON object keyed by target. A string value is served as a
+ * plain 200 text response; an object value scripts the endpoint, e.g.
+ *   "/slow": {"body": "hi", "latency_ms": 200, "bytes_per_second": 1024, "chunk_size": 16}
+ *   "/feed": {"websocket": "broadcast", "permessage_deflate": true}
+ */
+static mock_endpoint parse_endpoint(const std::string& target, const Json::Value& value) {
+    mock_endpoint ep{.target = target};
+
+    if (value.isString()) {
+        ep.body = value.asString();
+        return ep;
+    }
+
+    ep.method = value.get("method", ep.method).asString();
+    ep.status = value.get("status", ep.status).asUInt();
+    ep.body = value.get("body", "").asString();
+    ep.body_size = value.get("body_size", 0).asUInt64();
+    ep.echo = value.get("echo", false).asBool();
+    ep.latency = std::chrono::milliseconds(value.get("latency_ms", 0).asInt64());
+    ep.bytes_per_second = value.get("bytes_per_second", 0).asUInt64();
+    ep.chunk_size = value.get("chunk_size", 0).asUInt64();
+    ep.chunk_interval = std::chrono::milliseconds(value.get("chunk_interval_ms", 0).asInt64());
+    ep.close_connection = value.get("close", false).asBool();
+    ep.gzip = value.get("gzip", false).asBool();
+
+    const auto& headers = value["headers"];
+    for (const auto& name : headers.getMemberNames()) {
+        ep.header_data.emplace_back(name, headers[name].asString());
+    }
+
+    const auto ws_mode = value.get("websocket", "none").asString();
+    if (ws_mode == "echo") {
+        ep.ws_mode = websocket_mode::echo;
+    } else if (ws_mode == "broadcast") {
+        ep.ws_mode = websocket_mode::broadcast;
+    } else if (ws_mode != "none") {
+        throw std::invalid_argument("Unrecognized websocket mode: " + ws_mode);
+    }
+
+    ep.ws_permessage_deflate = value.get("permessage_deflate", false).asBool();
+    ep.ws_publish_count = value.get("publish_count", 0).asUInt64();
+    ep.ws_publish_size = value.get("publish_size", 64).asUInt64();
+    ep.ws_publish_interval = std::chrono::microseconds(value.get("publish_interval_us", 0).asInt64());
+
+    return ep;
+}
+
+int main(int argc, char *argv[]) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "print this help message")
+        ("config", po::value<std::string>(), "JSON endpoint config file")
+        ("address", po::value<std::string>()->default_value("127.0.0.1"), "Address to listen on")
+        ("port", po::value<unsigned short>()->default_value(3001), "Unsecured (http/ws) port")
+        ("tls-port", po::value<unsigned short>()->default_value(0), "Secured (https/wss) port")
+        ("cert", po::value<std::string>(), "PEM certificate chain for the secured port")
+        ("key", po::value<std::string>(), "PEM private key for the secured port")
+        ("threads", po::value<unsigned>()->default_value(1), "Number of server threads");
+
+    po::positional_options_description positional_options;
+    positional_options.add("config", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional_options).run(), vm);
+        po::notify(vm);
+    } catch (const po::error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help") || !vm.count("config")) {
+        std::cout << desc << std::endl;
+        return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    mock_server_config config{
+        .address = vm["address"].as<std::string>(),
+        .plain_port = vm["port"].as<unsigned short>(),
+        .tls_port = vm["tls-port"].as<unsigned short>(),
+        .threads = vm["threads"].as<unsigned>()
+    };
+
+    if (vm.count("cert") && vm.count("key")) {
+        config.tls_cert_file = vm["cert"].as<std::string>();
+        config.tls_key_file = vm["key"].as<std::string>();
+    }
+
+    std::ifstream ifs{vm["config"].as<std::string>()};
+    if (!ifs) {
+        std::cerr << "Could not open config file: " << vm["config"].as<std::string>() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Json::CharReaderBuilder builder;
+    Json::Value root;
+    JSONCPP_STRING errs;
+
+    if (!parseFromStream(builder, ifs, &root, &errs)) {
+        std::cerr << errs << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    mock_server server{config};
+
+    for (const auto& target : root.getMemberNames()) {
+        server.add_endpoint(parse_endpoint(target, root[target]));
+    }
+
+    /* the Node server always provided /echo, keep that contract */
+    if (!root.isMember("/echo")) {
+        server.add_endpoint(mock_endpoint{.target = "/echo", .method = "*", .echo = true});
+    }
+
+    server.start();
+
+    std::cout << "Mock server is running on http://" << config.address << ":" << server.plain_port() << std::endl;
+    if (server.tls_port()) {
+        std::cout << "Mock server is running on https://" << config.address << ":" << server.tls_port() << std::endl;
+    }
+
+    /* block until ctrl + C or a kill */
+    boost::asio::io_context signal_ioc;
+    boost::asio::signal_set signals{signal_ioc, SIGINT, SIGTERM};
+    signals.async_wait([](const boost::system::error_code&, int) {});
+    signal_ioc.run();
+
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
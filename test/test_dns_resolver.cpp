@@ -0,0 +1,341 @@
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <thread>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+
+#include "zclient.hpp"
+#include "zlogger.hpp"
+#include "mock_server.hpp"
+
+using namespace zclient;
+using boost::asio::ip::address;
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+/* Minimal authoritative DNS server on loopback, answering A and AAAA queries
+ * from a fixed table over UDP and TCP on its own thread. Names in truncated get
+ * an empty, truncated answer over UDP and the full one over TCP; unknown names
+ * get NXDOMAIN */
+class stub_dns_server {
+public:
+    stub_dns_server(std::map<std::string, std::vector<address>> records, std::set<std::string> truncated = {})
+        :records_{std::move(records)}
+        ,truncated_{std::move(truncated)}
+        ,udp_socket_{ioc_, udp::endpoint{boost::asio::ip::make_address("127.0.0.1"), 0}}
+        ,acceptor_{ioc_, tcp::endpoint{boost::asio::ip::make_address("127.0.0.1"), udp_socket_.local_endpoint().port()}}
+    {
+        boost::asio::co_spawn(ioc_, serve_udp(), boost::asio::detached);
+        boost::asio::co_spawn(ioc_, serve_tcp(), boost::asio::detached);
+        thread_ = std::thread{[this] { ioc_.run(); }};
+    }
+
+    ~stub_dns_server() {
+        ioc_.stop();
+        thread_.join();
+    }
+
+    udp::endpoint endpoint() const { return udp_socket_.local_endpoint(); }
+
+    int udp_queries() const { return udp_queries_; }
+    int tcp_queries() const { return tcp_queries_; }
+
+private:
+    std::map<std::string, std::vector<address>> records_;
+    std::set<std::string> truncated_;
+    std::atomic<int> udp_queries_{0};
+    std::atomic<int> tcp_queries_{0};
+
+    boost::asio::io_context ioc_;
+    udp::socket udp_socket_;
+    tcp::acceptor acceptor_;
+    std::thread thread_;
+
+    static std::uint16_t get_u16(const std::string& s, std::size_t pos) {
+        return static_cast<std::uint16_t>((static_cast<unsigned char>(s[pos]) << 8) | static_cast<unsigned char>(s[pos + 1]));
+    }
+
+    static void put_u16(std::string& out, std::uint16_t v) {
+        out.push_back(static_cast<char>(v >> 8));
+        out.push_back(static_cast<char>(v & 0xff));
+    }
+
+    std::string answer(const std::string& query, bool over_udp) const {
+        /* the question: name labels from offset 12, then type and class */
+        std::string name;
+        std::size_t pos = 12;
+        while (query[pos] != 0) {
+            const std::size_t length = static_cast<unsigned char>(query[pos]);
+            if (!name.empty()) name += '.';
+            name.append(query, pos + 1, length);
+            pos += length + 1;
+        }
+        const auto type = get_u16(query, pos + 1);
+        const auto question_end = pos + 5;
+
+        const auto record = records_.find(name);
+        const bool truncate = over_udp && truncated_.count(name);
+
+        std::vector<address> addresses;
+        if (record != records_.end() && !truncate) {
+            for (const auto& a : record->second) {
+                if ((type == 1 && a.is_v4()) || (type == 28 && a.is_v6())) addresses.push_back(a);
+            }
+        }
+
+        std::string out = query.substr(0, 2);
+        std::uint16_t flags = 0x8180;
+        if (record == records_.end()) flags |= 3;
+        if (truncate) flags |= 0x0200;
+        put_u16(out, flags);
+        put_u16(out, 1);
+        put_u16(out, static_cast<std::uint16_t>(addresses.size()));
+        put_u16(out, 0);
+        put_u16(out, 0);
+        out.append(query, 12, question_end - 12);
+
+        for (const auto& a : addresses) {
+            put_u16(out, 0xc00c); /* pointer to the question's name */
+            put_u16(out, type);
+            put_u16(out, 1);
+            put_u16(out, 0);
+            put_u16(out, 60);
+            if (a.is_v4()) {
+                const auto bytes = a.to_v4().to_bytes();
+                put_u16(out, 4);
+                out.append(bytes.begin(), bytes.end());
+            } else {
+                const auto bytes = a.to_v6().to_bytes();
+                put_u16(out, 16);
+                out.append(bytes.begin(), bytes.end());
+            }
+        }
+
+        return out;
+    }
+
+    boost::asio::awaitable<void> serve_udp() {
+        std::array<char, 512> buffer;
+        for (;;) {
+            udp::endpoint sender;
+            auto n = co_await udp_socket_.async_receive_from(boost::asio::buffer(buffer), sender, boost::asio::use_awaitable);
+            ++udp_queries_;
+
+            const std::string query(buffer.data(), n);
+            const auto reply = answer(query, true);
+            co_await udp_socket_.async_send_to(boost::asio::buffer(reply), sender, boost::asio::use_awaitable);
+        }
+    }
+
+    boost::asio::awaitable<void> serve_tcp() {
+        for (;;) {
+            auto socket = co_await acceptor_.async_accept(boost::asio::use_awaitable);
+            ++tcp_queries_;
+
+            std::array<char, 2> prefix;
+            co_await boost::asio::async_read(socket, boost::asio::buffer(prefix), boost::asio::use_awaitable);
+
+            std::string query(get_u16(std::string(prefix.data(), 2), 0), '\0');
+            co_await boost::asio::async_read(socket, boost::asio::buffer(query), boost::asio::use_awaitable);
+
+            const auto reply = answer(query, false);
+            std::string message;
+            put_u16(message, static_cast<std::uint16_t>(reply.size()));
+            message += reply;
+            co_await boost::asio::async_write(socket, boost::asio::buffer(message), boost::asio::use_awaitable);
+        }
+    }
+};
+
+static dns_resolver_options stub_options(const stub_dns_server& server) {
+    dns_resolver_options options;
+    options.nameservers = {server.endpoint()};
+    options.timeout = std::chrono::milliseconds(200);
+    options.hosts_file.clear();
+    return options;
+}
+
+/* expects resolve() to throw with the given error */
+static void expect_resolve_error(dns_resolver& resolver, const std::string& host, boost::system::error_code expected) {
+    zasync_exec([&resolver, host, expected]() -> zasync {
+        const std::string service{"80"};
+        bool thrown = false;
+        try {
+            co_await resolver.resolve(host, service);
+        } catch (const boost::system::system_error& e) {
+            thrown = e.code() == expected;
+        }
+        assert(thrown);
+    });
+    zrun();
+    get_io_context().restart();
+}
+
+static std::vector<tcp::endpoint> resolve(dns_resolver& resolver, const std::string& host, const std::string& service) {
+    std::vector<tcp::endpoint> endpoints;
+    zasync_exec([&]() -> zasync {
+        auto results = co_await resolver.resolve(host, service);
+        for (const auto& entry : results) {
+            endpoints.push_back(entry.endpoint());
+        }
+    });
+    zrun();
+    get_io_context().restart();
+    return endpoints;
+}
+
+void test_a_and_aaaa_records() {
+    stub_dns_server server{{{"both.zclient.test", {boost::asio::ip::make_address("10.0.0.1"), boost::asio::ip::make_address("fd00::1")}}}};
+    dns_resolver resolver{stub_options(server)};
+
+    auto endpoints = resolve(resolver, "both.zclient.test", "https");
+    assert(endpoints.size() == 2);
+    assert(endpoints[0] == tcp::endpoint(boost::asio::ip::make_address("10.0.0.1"), 443));
+    assert(endpoints[1] == tcp::endpoint(boost::asio::ip::make_address("fd00::1"), 443));
+
+    auto options = stub_options(server);
+    options.ipv6 = false;
+    dns_resolver v4_only{options};
+    endpoints = resolve(v4_only, "both.zclient.test", "8080");
+    assert(endpoints.size() == 1);
+    assert(endpoints[0] == tcp::endpoint(boost::asio::ip::make_address("10.0.0.1"), 8080));
+}
+
+void test_search_domains() {
+    stub_dns_server server{{{"api.internal.test", {boost::asio::ip::make_address("10.0.0.2")}}}};
+    auto options = stub_options(server);
+    options.search = {"other.test", "internal.test"};
+    dns_resolver resolver{options};
+
+    auto endpoints = resolve(resolver, "api", "80");
+    assert(endpoints.size() == 1);
+    assert(endpoints[0].address() == boost::asio::ip::make_address("10.0.0.2"));
+
+    /* absolute names are not expanded */
+    expect_resolve_error(resolver, "api.", boost::asio::error::host_not_found);
+}
+
+void test_nxdomain() {
+    stub_dns_server server{{}};
+    dns_resolver resolver{stub_options(server)};
+    expect_resolve_error(resolver, "missing.zclient.test", boost::asio::error::host_not_found);
+}
+
+void test_literals_and_hosts_file() {
+    stub_dns_server server{{}};
+
+    const auto hosts_file = std::filesystem::temp_directory_path() / "zclient_test_hosts";
+    std::ofstream{hosts_file} << "# comment\n10.9.8.7 Pinned.zclient.test pinned # trailing\n";
+
+    auto options = stub_options(server);
+    options.hosts_file = hosts_file.string();
+    dns_resolver resolver{options};
+
+    auto endpoints = resolve(resolver, "pinned.zclient.test", "80");
+    assert(endpoints.size() == 1);
+    assert(endpoints[0].address() == boost::asio::ip::make_address("10.9.8.7"));
+
+    endpoints = resolve(resolver, "::1", "80");
+    assert(endpoints.size() == 1);
+    assert(endpoints[0].address() == boost::asio::ip::make_address("::1"));
+
+    assert(server.udp_queries() == 0);
+    std::filesystem::remove(hosts_file);
+}
+
+void test_nameserver_fallback() {
+    stub_dns_server server{{{"fallback.zclient.test", {boost::asio::ip::make_address("10.0.0.3")}}}};
+
+    /* bound but never read, so queries to it go unanswered */
+    boost::asio::io_context ioc;
+    udp::socket silent{ioc, udp::endpoint{boost::asio::ip::make_address("127.0.0.1"), 0}};
+
+    auto options = stub_options(server);
+    options.nameservers = {silent.local_endpoint(), server.endpoint()};
+    dns_resolver resolver{options};
+
+    auto endpoints = resolve(resolver, "fallback.zclient.test", "80");
+    assert(endpoints.size() == 1);
+    assert(endpoints[0].address() == boost::asio::ip::make_address("10.0.0.3"));
+
+    options.nameservers = {silent.local_endpoint()};
+    options.attempts = 1;
+    dns_resolver unanswered{options};
+    expect_resolve_error(unanswered, "fallback.zclient.test", boost::asio::error::timed_out);
+}
+
+void test_truncated_answer_retried_over_tcp() {
+    stub_dns_server server{{{"big.zclient.test", {boost::asio::ip::make_address("10.0.0.4")}}}, {"big.zclient.test"}};
+    dns_resolver resolver{stub_options(server)};
+
+    auto endpoints = resolve(resolver, "big.zclient.test", "80");
+    assert(endpoints.size() == 1);
+    assert(endpoints[0].address() == boost::asio::ip::make_address("10.0.0.4"));
+    assert(server.tcp_queries() > 0);
+}
+
+void test_clients_use_resolver(mock::mock_server& mock) {
+    stub_dns_server server{{{"mock.zclient.test", {boost::asio::ip::make_address("127.0.0.1")}}}};
+    auto resolver = std::make_shared<dns_resolver>(stub_options(server));
+    const auto port = std::to_string(mock.plain_port());
+
+    std::string body;
+    std::string echoed;
+
+    zasync_exec([&]() -> zasync {
+        http_client client;
+        client.set_dns_resolver(resolver);
+        const http_request request{.method = http_method::get, .path = "/small"};
+        const std::string http_host{"http://mock.zclient.test"};
+        auto resp = co_await client.fetch(http_host, port, request);
+        body = resp.body;
+
+        websocket_client ws_client;
+        ws_client.set_dns_resolver(resolver);
+        const std::string ws_host{"ws://mock.zclient.test"};
+        const std::string target{"/echo"};
+        const bool connected = co_await ws_client.connect(ws_host, port, target);
+        assert(connected);
+        const std::string message{"resolved"};
+        co_await ws_client.write(message);
+        echoed = co_await ws_client.read();
+        ws_client.disconnect();
+    });
+    zrun();
+    get_io_context().restart();
+
+    assert(body == "{\"ok\":true}");
+    assert(echoed == "resolved");
+    assert(server.udp_queries() >= 2);
+}
+
+int main() {
+    mock::mock_server mock;
+    mock.add_endpoint(mock::mock_endpoint{.target = "/small", .body = "{\"ok\":true}"});
+    mock.add_endpoint(mock::mock_endpoint{.target = "/echo", .ws_mode = mock::websocket_mode::echo});
+    mock.start();
+
+    #define RUN(x) x; printf(#x); printf("\n");
+    RUN(test_a_and_aaaa_records());
+    RUN(test_search_domains());
+    RUN(test_nxdomain());
+    RUN(test_literals_and_hosts_file());
+    RUN(test_nameserver_fallback());
+    RUN(test_truncated_answer_retried_over_tcp());
+    RUN(test_clients_use_resolver(mock));
+    #undef RUN
+
+    LOG_DEBUG << "All tests pass!";
+
+    mock.stop();
+
+    return EXIT_SUCCESS;
+}
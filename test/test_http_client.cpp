@@ -1,23 +1,25 @@
 #include <iostream>
 #include <cassert>
+#include <charconv>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <optional>
+#include <thread>
 #include <unordered_map>
+#include <boost/asio/as_tuple.hpp>
+#include <boost/asio/ssl.hpp>
 
+#include "boost/certify/https_verification.hpp"
 #include "zclient.hpp"
 #include "zlogger.hpp"
 #include "json/json.h"
+#include "mock_server.hpp"
+#include "verification_cache.hpp"
 
 using namespace zclient;
 
-#ifndef MOCK_SERVER_UNSECURED_PORT
-#define MOCK_SERVER_UNSECURED_PORT "3000"
-#endif
-
-#ifndef MOCK_SERVER_SECURED_PORT
-#define MOCK_SERVER_SECURED_PORT "300"
-#endif
-
 /* Tests for unsecured HTTP */
 class ClientTester {
 public:
@@ -35,6 +37,18 @@ public:
     void test_http_basic_response();
     void test_sequential_http_responses();
     void test_http_request_header_and_body_echo();
+    void test_http_chunked_response(const std::string& path, std::size_t expected_size);
+    void test_http_large_body(const std::string& path, std::size_t expected_size);
+    void test_http_callback_on_compute_pool(compute_pool& pool);
+    void test_offload_to_compute_pool(compute_pool& pool);
+    void test_async_fetch_completion_tokens();
+    void test_fetch_then_client_settings();
+    void test_segmented_download(const std::string& path, std::size_t expected_size);
+    void test_segmented_download_resume(const std::string& slow_path, const std::string& changed_path, std::size_t expected_size);
+    void test_sse_stream(const std::string& path, const std::vector<std::string>& events, mock::mock_server& server);
+    void test_sse_incremental(const std::string& path, std::chrono::milliseconds event_interval);
+    void test_stream_read_data(const std::string& path, std::size_t expected_size);
+    void test_tls_early_data_fallback(const std::string& path, const std::string& cert_file, mock::mock_server& server);
     void test_connect_to_external_site(const std::string& hostname, const std::string& path, const std::string& port);
 
 private:
@@ -46,8 +60,8 @@ private:
     int _endpoint_index;
 
     const std::pair<std::string, std::string>& get_endpoint_and_expected_resp_pair() {
-        auto& ret = _mock_server_endpoints[++_endpoint_index];
-        _endpoint_index %= _mock_server_endpoints.size();
+        _endpoint_index = (_endpoint_index + 1) % _mock_server_endpoints.size();
+        auto& ret = _mock_server_endpoints[_endpoint_index];
 
         return ret;
     } 
@@ -184,6 +198,430 @@ void ClientTester::test_sequential_http_responses() {
     });
 }
 
+void ClientTester::test_http_chunked_response(const std::string& path, std::size_t expected_size) {
+    /* Test that a Transfer-Encoding: chunked response, delivered in slices with
+     * pauses in between, is reassembled into the full body */
+    zasync_exec([host = _host, port = _port, path = path, expected_size]() -> zasync {
+        auto resp = co_await fetch(
+            host,
+            port,
+            http_request{
+                .method = http_method::get,
+                .path = path
+            }
+        );
+
+        assert(resp.return_code == 200);
+        assert(resp.body.size() == expected_size);
+    });
+}
+
+void ClientTester::test_http_large_body(const std::string& path, std::size_t expected_size) {
+    /* Test that a multi-megabyte content-length delimited body arrives intact */
+    zasync_exec([host = _host, port = _port, path = path, expected_size]() -> zasync {
+        auto resp = co_await fetch(
+            host,
+            port,
+            http_request{
+                .method = http_method::get,
+                .path = path
+            }
+        );
+
+        assert(resp.return_code == 200);
+        assert(resp.body.size() == expected_size);
+        assert(resp.body.substr(0, 10) == "0123456789");
+    });
+}
+
+void ClientTester::test_http_callback_on_compute_pool(compute_pool& pool) {
+    /* Test that fetch_then can hand the response to a compute pool worker
+     * instead of running the callback on the io thread */
+    auto endpoint_and_expected_resp = get_endpoint_and_expected_resp_pair();
+
+    zasync_exec([host = _host,
+                 port = _port,
+                 path = endpoint_and_expected_resp.first,
+                 expected_resp = endpoint_and_expected_resp.second,
+                 &pool
+                ]() -> zasync {
+        const auto io_thread = std::this_thread::get_id();
+
+        fetch_then(
+            host,
+            port,
+            http_request{
+                .method = http_method::get,
+                .path = path
+            },
+            pool,
+            [io_thread, expected_resp](http_response&& resp) {
+                assert(std::this_thread::get_id() != io_thread);
+                assert(resp.body == expected_resp);
+            }
+        );
+
+        co_return;
+    });
+}
+
+void ClientTester::test_offload_to_compute_pool(compute_pool& pool) {
+    /* Test that offloaded work runs on a pool worker and the coroutine resumes
+     * back on its io thread with the result */
+    auto endpoint_and_expected_resp = get_endpoint_and_expected_resp_pair();
+
+    zasync_exec([host = _host,
+                 port = _port,
+                 path = endpoint_and_expected_resp.first,
+                 expected_resp = endpoint_and_expected_resp.second,
+                 &pool
+                ]() -> zasync {
+        auto resp = co_await fetch(
+            host,
+            port,
+            http_request{
+                .method = http_method::get,
+                .path = path
+            }
+        );
+
+        const auto io_thread = std::this_thread::get_id();
+
+        auto length = co_await offload(pool, [&resp, io_thread]() {
+            assert(std::this_thread::get_id() != io_thread);
+            return resp.body.size();
+        });
+
+        assert(std::this_thread::get_id() == io_thread);
+        assert(length == expected_resp.size());
+    });
+}
+
+void ClientTester::test_fetch_then_client_settings() {
+    /* Test that fetch_then fetches with the socket options set on its client
+     * (the defaults have no receive timestamps) */
+    auto endpoint_and_expected_resp = get_endpoint_and_expected_resp_pair();
+
+    http_client client;
+    socket_options options;
+    options.rx_timestamps = true;
+    client.set_socket_options(options);
+
+    const auto sent = std::chrono::system_clock::now();
+    client.fetch_then(
+        _host,
+        _port,
+        http_request{
+            .method = http_method::get,
+            .path = endpoint_and_expected_resp.first
+        },
+        [sent, expected_resp = endpoint_and_expected_resp.second](http_response&& resp) {
+            assert(resp.body == expected_resp);
+            assert(resp.rx_timestamp >= sent);
+        }
+    );
+}
+
+void ClientTester::test_async_fetch_completion_tokens() {
+    /* Test async_fetch with a plain callback, use_awaitable and as_tuple(use_awaitable) */
+    auto endpoint_and_expected_resp = get_endpoint_and_expected_resp_pair();
+
+    async_fetch(
+        _host,
+        _port,
+        http_request{
+            .method = http_method::get,
+            .path = endpoint_and_expected_resp.first
+        },
+        [expected_resp = endpoint_and_expected_resp.second](boost::system::error_code ec, http_response resp) {
+            assert(!ec);
+            assert(resp.body == expected_resp);
+        }
+    );
+
+    zasync_exec([host = _host,
+                 port = _port,
+                 path = endpoint_and_expected_resp.first,
+                 expected_resp = endpoint_and_expected_resp.second
+                ]() -> zasync {
+        /* named rather than temporary requests: gcc 12 double-destroys aggregate
+         * temporaries in a co_await full-expression on an async_initiate result */
+        const http_request request{.method = http_method::get, .path = path};
+        const http_request missing_request{.method = http_method::get, .path = "/no/such/endpoint"};
+
+        auto resp = co_await async_fetch(host, port, request, boost::asio::use_awaitable);
+        assert(resp.body == expected_resp);
+
+        auto [ec, missing] = co_await async_fetch(host, port, missing_request, boost::asio::as_tuple(boost::asio::use_awaitable));
+        assert(!ec);
+        assert(missing.return_code == 404);
+    });
+}
+
+/* whether file holds the mock server's generated body of size bytes */
+static bool is_generated_body(const std::string& file, std::size_t size) {
+    static constexpr char pattern[] = "0123456789abcdefghijklmnopqrstuvwxyz\n";
+
+    std::ifstream in{file, std::ios::binary};
+    const std::string data{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+    if (data.size() != size) return false;
+
+    for (std::size_t i = 0; i < size; ++i) {
+        if (data[i] != pattern[i % (sizeof(pattern) - 1)]) return false;
+    }
+    return true;
+}
+
+void ClientTester::test_segmented_download(const std::string& path, std::size_t expected_size) {
+    /* Test that a file fetched as concurrent ranges is reassembled in place */
+    zasync_exec([host = _host, port = _port, path = path, expected_size]() -> zasync {
+        const auto file = (std::filesystem::temp_directory_path() / ("zclient_download_" + port)).string();
+
+        download_options options;
+        options.segments = 4;
+        options.min_segment_size = 64 * 1024;
+
+        auto result = co_await download_to_file(host, port, path, file, options);
+
+        assert(result.size == expected_size);
+        assert(result.segments == 4);
+        assert(result.bytes_transferred == expected_size);
+        assert(!result.resumed);
+        assert(is_generated_body(file, expected_size));
+        assert(!std::filesystem::exists(file + ".zdl"));
+
+        std::filesystem::remove(file);
+    });
+}
+
+void ClientTester::test_segmented_download_resume(const std::string& slow_path, const std::string& changed_path, std::size_t expected_size) {
+    /* Test that an interrupted download continues where its segments stopped,
+     * and starts over when the file has since changed on the server */
+    const auto file = (std::filesystem::temp_directory_path() / ("zclient_resume_" + _port)).string();
+
+    download_options options;
+    options.segments = 4;
+    options.min_segment_size = 64 * 1024;
+
+    /* each download on its own io_context, abandoned after limit */
+    const auto run_download = [&](const std::string& path, std::chrono::milliseconds limit) {
+        std::optional<download_result> result;
+        boost::asio::io_context ioc;
+        boost::asio::co_spawn(ioc, download_to_file(_host, _port, path, file, options),
+            [&result](std::exception_ptr e, download_result r) {
+                assert(!e);
+                result = r;
+            });
+        ioc.run_for(limit);
+        return result;
+    };
+
+    assert(!run_download(slow_path, std::chrono::milliseconds(200)));
+    assert(std::filesystem::exists(file + ".zdl"));
+
+    auto resumed = run_download(slow_path, std::chrono::seconds(10));
+    assert(resumed && resumed->resumed);
+    assert(resumed->bytes_transferred < expected_size);
+    assert(is_generated_body(file, expected_size));
+    assert(!std::filesystem::exists(file + ".zdl"));
+
+    assert(!run_download(slow_path, std::chrono::milliseconds(200)));
+
+    auto restarted = run_download(changed_path, std::chrono::seconds(10));
+    assert(restarted && !restarted->resumed);
+    assert(restarted->bytes_transferred == expected_size);
+    assert(is_generated_body(file, expected_size));
+
+    std::filesystem::remove(file);
+}
+
+static void test_sse_parser() {
+    /* Test that events split anywhere, with any line ending, parse the same */
+    const std::string stream =
+        "\xEF\xBB\xBF: heartbeat\r\n"
+        "retry: 250\r\n"
+        "id: 7\r\n"
+        "data: first\r\n"
+        "data:  two lines\r\n\r\n"
+        "event: trade\r"
+        "data:{\"p\":1}\r\r"
+        "id\n"
+        "data\n\n"
+        "id: 9\n"
+        "unknown: field\n\n"
+        "data: incomplete";
+
+    for (std::size_t piece = 1; piece <= stream.size(); ++piece) {
+        sse_parser parser;
+        std::vector<sse_event> events;
+        for (std::size_t i = 0; i < stream.size(); i += piece) {
+            parser.feed(std::string_view{stream}.substr(i, piece));
+            while (auto event = parser.next()) {
+                events.push_back(std::move(*event));
+            }
+        }
+
+        assert(events.size() == 3);
+        assert(events[0].type == "message" && events[0].data == "first\n two lines" && events[0].id == "7");
+        assert(events[1].type == "trade" && events[1].data == "{\"p\":1}" && events[1].id == "7");
+        assert(events[2].type == "message" && events[2].data.empty() && events[2].id.empty());
+        assert(parser.retry() == std::chrono::milliseconds(250));
+
+        /* an id without data still counts, the unfinished event does not */
+        assert(parser.last_event_id() == "9");
+        parser.reset();
+        assert(!parser.next());
+    }
+
+    sse_parser small{16};
+    bool thrown = false;
+    try {
+        small.feed("data: 0123456789abcdef\n");
+    } catch (const std::length_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void ClientTester::test_sse_stream(const std::string& path, const std::vector<std::string>& events, mock::mock_server& server) {
+    /* Test that a stream the server ends every few events carries on after
+     * the last event id, over the same keep-alive connection */
+    const auto connections = server.stats().connections;
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        sse_options options;
+        options.reconnect_delay = std::chrono::milliseconds(10);
+        sse_client client{options};
+
+        const bool connected = co_await client.connect(_host, _port, path);
+        assert(connected);
+
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            auto event = co_await client.read();
+            assert(event.type == "message");
+            assert(event.data == events[i]);
+            assert(event.id == std::to_string(i + 1));
+        }
+        assert(client.last_event_id() == std::to_string(events.size()));
+
+        client.disconnect();
+        assert(!client.is_connected());
+
+        bool closed = false;
+        try {
+            co_await client.read();
+        } catch (const sse_stream_closed_exception&) {
+            closed = true;
+        }
+        assert(closed);
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+    assert(server.stats().connections == connections + 1);
+}
+
+void ClientTester::test_sse_incremental(const std::string& path, std::chrono::milliseconds event_interval) {
+    /* Test that each event is handed over when it arrives, not when the
+     * response ends */
+    zasync_exec([host = _host, port = _port, path = path, event_interval]() -> zasync {
+        sse_client client;
+        const bool connected = co_await client.connect(host, port, path);
+        assert(connected);
+
+        auto last = std::chrono::steady_clock::now();
+        for (int i = 0; i < 3; ++i) {
+            auto event = co_await client.read();
+            const auto now = std::chrono::steady_clock::now();
+            assert(event.id == std::to_string(i + 1));
+            assert(i == 0 || now - last >= event_interval / 2);
+            last = now;
+        }
+
+        client.disconnect();
+    });
+}
+
+void ClientTester::test_stream_read_data(const std::string& path, std::size_t expected_size) {
+    /* Test that a chunked response is handed over piece by piece */
+    zasync_exec([host = _host, port = _port, path = path, expected_size]() -> zasync {
+        sse_client client;
+        const bool connected = co_await client.connect(host, port, path);
+        assert(connected);
+
+        std::string body;
+        std::size_t pieces = 0;
+        while (body.size() < expected_size) {
+            body += co_await client.read_data();
+            ++pieces;
+        }
+
+        assert(body.size() == expected_size);
+        assert(body.substr(0, 10) == "0123456789");
+        assert(pieces > 1);
+
+        client.disconnect();
+    });
+}
+
+/* a client trusting the mock server's self-signed certificate through the
+ * default verify paths, read when its context is made */
+static tls_http_client trusting_tls_client(const std::string& cert_file) {
+    const char* cert_env = std::getenv("SSL_CERT_FILE");
+    const std::optional<std::string> previous_cert_env = cert_env ? std::optional<std::string>{cert_env} : std::nullopt;
+    setenv("SSL_CERT_FILE", cert_file.c_str(), 1);
+    tls_http_client client;
+    if (previous_cert_env) {
+        setenv("SSL_CERT_FILE", previous_cert_env->c_str(), 1);
+    } else {
+        unsetenv("SSL_CERT_FILE");
+    }
+    return client;
+}
+
+void ClientTester::test_tls_early_data_fallback(const std::string& path, const std::string& cert_file, mock::mock_server& server) {
+    /* Test that repeated https fetches resume the TLS session, and that a
+     * replay-safe GET sent as early data the server rejects is sent again
+     * after the handshake */
+    const auto stats = server.stats();
+    const auto host = _host.substr(_host.find("://") + 3);
+
+    auto client = trusting_tls_client(cert_file);
+
+    constexpr std::size_t fetches = 3;
+    std::size_t done = 0;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        for (std::size_t i = 0; i < fetches; ++i) {
+            const http_request request{
+                .method = http_method::get,
+                .path = path,
+                .replay_safe = true
+            };
+            auto resp = co_await client.fetch(host, _port, request);
+
+            assert(resp.return_code == 200);
+            assert(resp.body.size());
+            ++done;
+        }
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done == fetches);
+
+    /* every fetch after the first resumed, and offered its request early */
+    assert(server.stats().tls_resumptions == stats.tls_resumptions + fetches - 1);
+    assert(server.stats().tls_early_data_rejected == stats.tls_early_data_rejected + fetches - 1);
+}
+
 void ClientTester::test_connect_to_external_site(const std::string& hostname, const std::string& path, const std::string& port) {
     /* Test connection to a well known outside source */
     zasync_exec([port = std::move(port), path = std::move(path), hostname = std::move(hostname)]() -> zasync {
@@ -203,12 +641,744 @@ void ClientTester::test_connect_to_external_site(const std::string& hostname, co
     });
 }
 
+static void test_tls_rx_timestamp(unsigned short port, const std::string& cert_file, std::chrono::milliseconds latency) {
+    /* Test that an https response is stamped with the arrival of the response
+     * itself, not of the session tickets the server sends after the handshake */
+    auto client = trusting_tls_client(cert_file);
+
+    socket_options options;
+    options.rx_timestamps = true;
+    client.set_socket_options(options);
+
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        const http_request request{
+            .method = http_method::get,
+            .path = "/slow"
+        };
+
+        const auto sent = std::chrono::system_clock::now();
+        auto resp = co_await client.fetch("localhost", std::to_string(port), request);
+        const auto received = std::chrono::system_clock::now();
+
+        assert(resp.return_code == 200);
+        assert(resp.rx_timestamp >= sent + latency);
+        assert(resp.rx_timestamp <= received);
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+}
+
+static void test_tls_verification_cache(unsigned short port, const std::string& cert_file) {
+    /* Test that a certificate verified for a host is accepted from the cache
+     * on the next handshake, while other hosts and failures are verified in full */
+    auto make_context = [](const std::string& trusted) {
+        boost::asio::ssl::context ctx{boost::asio::ssl::context::tls_client};
+        ctx.set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
+        if (!trusted.empty()) {
+            ctx.load_verify_file(trusted);
+        }
+        boost::certify::enable_native_https_server_verification(ctx);
+        return ctx;
+    };
+
+    auto trusting_ctx = make_context(cert_file);
+    auto& cache = detail::verification_cache::enable(trusting_ctx);
+    auto untrusting_ctx = make_context("");
+    auto& untrusting_cache = detail::verification_cache::enable(untrusting_ctx);
+
+    boost::asio::io_context ioc;
+    auto handshake = [&](boost::asio::ssl::context& ctx, const std::string& hostname) {
+        boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream{ioc, ctx};
+        if (!hostname.empty()) {
+            SSL_set_tlsext_host_name(stream.native_handle(), hostname.c_str());
+        }
+        stream.next_layer().connect({boost::asio::ip::make_address("127.0.0.1"), port});
+
+        boost::system::error_code ec;
+        stream.handshake(boost::asio::ssl::stream_base::client, ec);
+        return !ec;
+    };
+
+    assert(handshake(trusting_ctx, "localhost"));
+    assert(cache.hits() == 0);
+    assert(cache.size() == 1);
+
+    assert(handshake(trusting_ctx, "localhost"));
+    assert(cache.hits() == 1);
+
+    /* the same certificate for another name is not vouched for */
+    assert(handshake(trusting_ctx, "mock.localhost"));
+    assert(cache.hits() == 1);
+    assert(cache.size() == 2);
+
+    /* nor is a connection without a hostname, as to an IP address */
+    assert(handshake(trusting_ctx, ""));
+    assert(handshake(trusting_ctx, ""));
+    assert(cache.hits() == 1);
+    assert(cache.size() == 2);
+
+    assert(!handshake(untrusting_ctx, "localhost"));
+    assert(!handshake(untrusting_ctx, "localhost"));
+    assert(untrusting_cache.hits() == 0);
+    assert(untrusting_cache.size() == 0);
+}
+
+static void test_tls_early_data_accepted(const std::string& cert_file, const std::string& key_file) {
+    /* Test that a replay-safe GET on a resumed session is answered from the
+     * early data, and that a 425 Too Early to it is fetched again after a
+     * handshake */
+    mock::mock_server server{mock::mock_server_config{
+        .tls_cert_file = cert_file,
+        .tls_key_file = key_file,
+        .tls_max_early_data = 16 * 1024,
+        .tls_accept_early_data = true
+    }};
+    server.add_endpoint(mock::mock_endpoint{.target = "/early", .body = "sent early"});
+    server.add_endpoint(mock::mock_endpoint{.target = "/too_early", .body = "sent late", .reject_early_data = true});
+    server.start();
+
+    const auto port = std::to_string(server.tls_port());
+    auto client = trusting_tls_client(cert_file);
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        const http_request early{.method = http_method::get, .path = "/early", .replay_safe = true};
+        const http_request too_early{.method = http_method::get, .path = "/too_early", .replay_safe = true};
+
+        /* the first connection has no session to send early data with */
+        auto first = co_await client.fetch("localhost", port, early);
+        assert(first.return_code == 200);
+        assert(server.stats().tls_early_data_accepted == 0);
+
+        auto resumed = co_await client.fetch("localhost", port, early);
+        assert(resumed.return_code == 200);
+        assert(resumed.body == "sent early");
+        assert(server.stats().tls_early_data_accepted == 1);
+
+        auto retried = co_await client.fetch("localhost", port, too_early);
+        assert(retried.return_code == 200);
+        assert(retried.body == "sent late");
+        assert(server.stats().tls_early_data_accepted == 2);
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+
+    /* the 425 was answered on its own connection */
+    const auto stats = server.stats();
+    assert(stats.connections == 4);
+    assert(stats.requests == 4);
+    assert(stats.tls_resumptions == 3);
+    assert(stats.tls_early_data_rejected == 0);
+
+    server.stop();
+}
+
+static void test_tls12_session_resumption(const std::string& cert_file, const std::string& key_file) {
+    /* Test that a TLS 1.2 session is offered again on every connection,
+     * unlike a TLS 1.3 ticket */
+    mock::mock_server server{mock::mock_server_config{
+        .tls_cert_file = cert_file,
+        .tls_key_file = key_file,
+        .tls_max_version = TLS1_2_VERSION
+    }};
+    server.add_endpoint(mock::mock_endpoint{.target = "/", .body = "tls 1.2"});
+    server.start();
+
+    const auto port = std::to_string(server.tls_port());
+    auto client = trusting_tls_client(cert_file);
+
+    constexpr std::size_t fetches = 3;
+    std::size_t done = 0;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        for (std::size_t i = 0; i < fetches; ++i) {
+            const http_request request{.method = http_method::get, .path = "/"};
+            auto resp = co_await client.fetch("localhost", port, request);
+            assert(resp.return_code == 200);
+            ++done;
+        }
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done == fetches);
+    assert(server.stats().tls_resumptions == fetches - 1);
+
+    server.stop();
+}
+
+static void test_json_field_extractor() {
+    /* Test that the key extractor finds the field's value, skipping the name
+     * where it appears as a value */
+    const auto extract = json_field_extractor("s");
+
+    assert(extract(R"({"e":"trade","s":"BTCUSDT","p":"1.0"})") == "BTCUSDT");
+    assert(extract(R"({"e":"s","s":"ETHUSDT"})") == "ETHUSDT");
+    assert(extract(R"({"e" : "s" , "s" : "ETHUSDT"})") == "ETHUSDT");
+    assert(extract(R"({"list":["s","s"],"s":"BNBUSDT"})") == "BNBUSDT");
+    assert(!extract(R"({"e":"s"})"));
+    assert(!extract(R"({"e":"trade","s":42})"));
+    assert(!extract(R"({"e":"trade"})"));
+}
+
+static void test_spsc_ring() {
+    /* Test that a producer and a consumer on their own threads pass every item
+     * through a small ring once and in order, filling it over and over */
+    constexpr std::uint64_t count = 1'000'000;
+    spsc_ring<std::uint64_t> ring{8};
+    assert(ring.capacity() == 8);
+    assert(ring.empty());
+
+    std::thread producer{[&ring]() {
+        for (std::uint64_t i = 0; i < count; ++i) {
+            auto* slot = ring.claim();
+            while (!slot) {
+                std::this_thread::yield();
+                slot = ring.claim();
+            }
+            *slot = i;
+            ring.publish();
+        }
+    }};
+
+    std::uint64_t expected = 0;
+    while (expected < count) {
+        if (auto* slot = ring.front()) {
+            assert(*slot == expected);
+            ++expected;
+            ring.pop();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+    assert(ring.empty());
+    assert(!ring.front());
+}
+
+static void test_websocket_echo(unsigned short port, mock::mock_server& server) {
+    /* Test a websocket round trip through the mock server's echo endpoint,
+     * in text and binary frames, and that endpoints without a websocket mode
+     * refuse the upgrade */
+    const auto stats = server.stats();
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        const std::string host{"ws://localhost"};
+        const std::string target{"/ws_echo"};
+
+        websocket_client client;
+        const bool connected = co_await client.connect(host, std::to_string(port), target);
+        assert(connected);
+
+        const std::string text{"hello"};
+        co_await client.write(text);
+        auto echoed = co_await client.read_view();
+        assert(echoed.data == text);
+        assert(echoed.type == ws_message_type::text);
+
+        const std::string binary{"\x00\x01\x02", 3};
+        co_await client.write(binary, ws_message_type::binary);
+        auto echoed_binary = co_await client.read_view();
+        assert(echoed_binary.data == binary);
+        assert(echoed_binary.type == ws_message_type::binary);
+
+        co_await client.close();
+
+        const std::string http_target{"/echo"};
+        websocket_client refused;
+        const bool upgraded = co_await refused.connect(host, std::to_string(port), http_target);
+        assert(!upgraded);
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+    assert(server.stats().ws_messages_received == stats.ws_messages_received + 2);
+    assert(server.stats().ws_messages_sent == stats.ws_messages_sent + 2);
+}
+
+static void test_websocket_write_ordering(unsigned short port) {
+    /* Test that the messages of each coroutine arrive in the order it wrote
+     * them when many coroutines on several threads share one client, with a
+     * high-water mark low enough that they queue behind each other */
+    constexpr std::size_t writers = 8;
+    constexpr std::size_t messages_per_writer = 200;
+    constexpr std::size_t threads = 4;
+
+    /* the client's connection goes before the io_context */
+    boost::asio::io_context ioc;
+    websocket_client client;
+    client.set_write_options(websocket_write_options{.high_water_mark = 1024, .coalesce_limit = 256});
+
+    std::vector<std::size_t> next(writers, 0);
+    std::size_t received = 0;
+
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        const std::string host{"ws://localhost"};
+        const std::string target{"/ws_echo"};
+        const bool connected = co_await client.connect(host, std::to_string(port), target);
+        assert(connected);
+
+        for (std::size_t w = 0; w < writers; ++w) {
+            boost::asio::co_spawn(ioc, [&client, w]() -> zasync {
+                for (std::size_t i = 0; i < messages_per_writer; ++i) {
+                    const auto message = std::to_string(w) + ":" + std::to_string(i);
+                    co_await client.write(message);
+                }
+            }, [](std::exception_ptr e) {
+                assert(!e);
+            });
+        }
+
+        while (received < writers * messages_per_writer) {
+            const auto message = co_await client.read();
+            const auto colon = message.find(':');
+            const auto w = std::stoul(message.substr(0, colon));
+            assert(std::stoul(message.substr(colon + 1)) == next[w]);
+            ++next[w];
+            ++received;
+        }
+
+        co_await client.close();
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    std::vector<std::thread> runners;
+    for (std::size_t i = 0; i < threads; ++i) {
+        runners.emplace_back([&ioc]() { ioc.run_for(std::chrono::seconds(20)); });
+    }
+    for (auto& t : runners) {
+        t.join();
+    }
+
+    assert(received == writers * messages_per_writer);
+}
+
+static void test_websocket_close_flushes_queue(unsigned short port, mock::mock_server& server) {
+    /* Test that close() sends every queued message before the close frame */
+    constexpr std::size_t messages = 500;
+    const auto stats = server.stats();
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        websocket_client client;
+        const std::string host{"ws://localhost"};
+        const std::string target{"/ws_echo"};
+        const bool connected = co_await client.connect(host, std::to_string(port), target);
+        assert(connected);
+
+        const std::string message(512, 'x');
+        for (std::size_t i = 0; i < messages; ++i) {
+            co_await client.write(message);
+        }
+
+        co_await client.close();
+        assert(!client.is_connected());
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+
+    /* the server reads the messages before the close frame it answered */
+    assert(server.stats().ws_messages_received == stats.ws_messages_received + messages);
+}
+
+static void test_websocket_write_error(unsigned short port, mock::mock_server& server) {
+    /* Test that a failed socket write is thrown by the writes and reads after it */
+    bool write_failed = false;
+    bool read_failed = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        websocket_client client;
+        const std::string host{"ws://localhost"};
+        const std::string target{"/ws_drop"};
+        const bool connected = co_await client.connect(host, std::to_string(port), target);
+        assert(connected);
+
+        const std::string message{"before the drop"};
+        co_await client.write(message);
+        auto echoed = co_await client.read();
+        assert(echoed == message);
+
+        assert(server.drop_websockets(target) == 1);
+
+        boost::asio::steady_timer timer{ioc};
+        for (int i = 0; i < 200 && !write_failed; ++i) {
+            try {
+                co_await client.write(message);
+            } catch (boost::system::system_error&) {
+                write_failed = true;
+            }
+
+            timer.expires_after(std::chrono::milliseconds(10));
+            co_await timer.async_wait(boost::asio::use_awaitable);
+        }
+
+        try {
+            co_await client.read();
+        } catch (boost::system::system_error&) {
+            read_failed = true;
+        }
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(write_failed);
+    assert(read_failed);
+}
+
+/* waits on ioc until done() holds, for at most timeout */
+template <typename Predicate>
+static zasync wait_until(Predicate done, std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)) {
+    boost::asio::steady_timer timer{co_await boost::asio::this_coro::executor};
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+        timer.expires_after(std::chrono::milliseconds(5));
+        co_await timer.async_wait(boost::asio::use_awaitable);
+    }
+}
+
+static void test_unix_socket(const std::string& socket_path, const std::pair<std::string, std::string>& endpoint) {
+    /* Test an http fetch, an async_fetch and a websocket round trip over the
+     * mock server's unix socket */
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        const http_request request{
+            .method = http_method::get,
+            .path = endpoint.first
+        };
+
+        const std::string http_host{"http+unix://" + socket_path};
+        const std::string ws_host{"ws+unix://" + socket_path};
+        const std::string no_port;
+
+        http_client client;
+        auto resp = co_await client.fetch(http_host, no_port, request);
+        assert(resp.return_code == 200);
+        assert(resp.body == endpoint.second);
+
+        auto [ec, async_resp] = co_await async_fetch(http_host, no_port, request,
+            boost::asio::as_tuple(boost::asio::use_awaitable));
+        assert(!ec);
+        assert(async_resp.body == endpoint.second);
+
+        const std::string target{"/ws_echo"};
+        websocket_client ws;
+        const bool connected = co_await ws.connect(ws_host, no_port, target);
+        assert(connected);
+
+        const std::string text{"over a unix socket"};
+        co_await ws.write(text);
+        auto echoed = co_await ws.read_view();
+        assert(echoed.data == text);
+
+        co_await ws.close();
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+}
+
+static void test_resilient_websocket_failover(unsigned short port, mock::mock_server& server) {
+    /* Test that a dropped connection fails over to the warm standby, replays
+     * the handshake on it and resumes the read, recording the gap */
+    const std::string target{"/ws_failover"};
+    std::size_t handshakes = 0;
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        resilient_websocket_client client;
+
+        /* the echo of the subscription is the first message on every connection */
+        client.set_handshake([&handshakes](websocket_client& ws) -> zasync {
+            ++handshakes;
+            const std::string subscribe{"subscribe"};
+            co_await ws.write(subscribe);
+        });
+
+        const bool connected = co_await client.connect("ws://127.0.0.1", std::to_string(port), target);
+        assert(connected);
+        assert(handshakes == 1);
+
+        auto first = co_await client.read();
+        assert(first == "subscribe");
+
+        co_await wait_until([&client]() { return client.stats().standby_connects == 1; });
+        assert(client.stats().standby_connects == 1);
+
+        /* the active connection is the older one */
+        assert(server.drop_websockets(target, 1) == 1);
+
+        auto resumed = co_await client.read();
+        assert(resumed == "subscribe");
+        assert(handshakes == 2);
+
+        const auto stats = client.stats();
+        assert(stats.failovers == 1);
+        assert(stats.cold_reconnects == 0);
+        assert(stats.last_gap.count() > 0);
+        assert(stats.max_gap == stats.last_gap);
+        assert(stats.total_gap == stats.last_gap);
+
+        /* the keeper opens the next standby */
+        co_await wait_until([&client]() { return client.stats().standby_connects == 2; });
+        assert(client.stats().standby_connects == 2);
+
+        client.disconnect();
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+}
+
+static void test_resilient_websocket_cold_reconnect(unsigned short port, mock::mock_server& server) {
+    /* Test that without a standby a dropped connection is replaced from scratch */
+    const std::string target{"/ws_cold_reconnect"};
+    std::size_t handshakes = 0;
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        resilient_websocket_client client{resilient_websocket_options{.warm_standby = false}};
+        client.set_handshake([&handshakes](websocket_client& ws) -> zasync {
+            ++handshakes;
+            const std::string subscribe{"subscribe"};
+            co_await ws.write(subscribe);
+        });
+
+        const bool connected = co_await client.connect("ws://127.0.0.1", std::to_string(port), target);
+        assert(connected);
+
+        auto first = co_await client.read();
+        assert(first == "subscribe");
+
+        assert(server.drop_websockets(target) == 1);
+
+        auto resumed = co_await client.read();
+        assert(resumed == "subscribe");
+        assert(handshakes == 2);
+
+        const auto stats = client.stats();
+        assert(stats.failovers == 0);
+        assert(stats.cold_reconnects == 1);
+        assert(stats.standby_connects == 0);
+        assert(stats.last_gap.count() > 0);
+        assert(stats.total_gap == stats.last_gap);
+
+        client.disconnect();
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+}
+
+static void test_resilient_websocket_disconnect_during_failover(unsigned short port, mock::mock_server& server) {
+    /* Test that disconnect() while the standby replays the handshake ends the
+     * pending read, and leaves no connection behind */
+    const std::string target{"/ws_disconnect_during_failover"};
+    std::size_t handshakes = 0;
+    bool read_ended = false;
+    bool done = false;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        resilient_websocket_client client;
+        client.set_handshake([&handshakes](websocket_client& ws) -> zasync {
+            /* a slow replay, so there is time to disconnect in the middle of it */
+            if (++handshakes > 1) {
+                boost::asio::steady_timer timer{co_await boost::asio::this_coro::executor, std::chrono::milliseconds(300)};
+                co_await timer.async_wait(boost::asio::use_awaitable);
+            }
+            const std::string subscribe{"subscribe"};
+            co_await ws.write(subscribe);
+        });
+
+        const bool connected = co_await client.connect("ws://127.0.0.1", std::to_string(port), target);
+        assert(connected);
+
+        auto first = co_await client.read();
+        assert(first == "subscribe");
+
+        co_await wait_until([&client]() { return client.stats().standby_connects == 1; });
+
+        boost::asio::co_spawn(ioc, [&]() -> zasync {
+            try {
+                co_await client.read();
+            } catch (const websocket_server_disconnected_exception&) {
+                read_ended = true;
+            }
+        }, [](std::exception_ptr e) {
+            assert(!e);
+        });
+
+        assert(server.drop_websockets(target, 1) == 1);
+
+        co_await wait_until([&handshakes]() { return handshakes == 2; });
+        assert(handshakes == 2);
+        client.disconnect();
+
+        co_await wait_until([&read_ended]() { return read_ended; });
+        assert(!client.is_connected());
+        assert(client.stats().failovers == 0);
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+    assert(read_ended);
+}
+
+static void test_feed_arbitrator(unsigned short port, mock::mock_server& server) {
+    /* Test that late copies are dropped and timed, a gap on one line is filled
+     * from the other, and gaps no line fills are skipped at the gap timeout, or
+     * at once past max_pending */
+    const std::string target_a{"/feed_a"};
+    const std::string target_b{"/feed_b"};
+    bool done = false;
+
+    feed_arbitrator_options options;
+    options.gap_timeout = std::chrono::milliseconds(200);
+    options.max_pending = 2;
+
+    boost::asio::io_context ioc;
+    boost::asio::co_spawn(ioc, [&]() -> zasync {
+        feed_arbitrator arbitrator{[](std::string_view data) -> std::optional<std::uint64_t> {
+            std::uint64_t sequence = 0;
+            auto [end, ec] = std::from_chars(data.data(), data.data() + data.size(), sequence);
+            if (ec != std::errc{} || end != data.data() + data.size()) {
+                return std::nullopt;
+            }
+            return sequence;
+        }, options};
+
+        const std::vector<feed_line> lines{
+            {"ws://127.0.0.1", std::to_string(port), target_a},
+            {"ws://127.0.0.1", std::to_string(port), target_b}
+        };
+        const bool connected = co_await arbitrator.connect(lines);
+        assert(connected);
+
+        /* the server registers the sessions right after the upgrade, heartbeats
+         * until it has */
+        co_await wait_until([&]() { return server.broadcast(target_a, "heartbeat") == 1; });
+        co_await wait_until([&]() { return server.broadcast(target_b, "heartbeat") == 1; });
+
+        const auto received = [&arbitrator](std::size_t line, std::uint64_t count) {
+            return [&arbitrator, line, count]() { return arbitrator.stats().lines[line].messages == count; };
+        };
+
+        /* a late copy is dropped, and timed against the first */
+        server.broadcast(target_a, "1");
+        auto first = co_await arbitrator.read();
+        assert(first.sequence == 1 && first.line == 0 && first.data == "1");
+
+        server.broadcast(target_b, "1");
+        co_await wait_until(received(1, 1));
+        auto stats = arbitrator.stats();
+        assert(stats.lines[1].duplicates == 1);
+        assert(stats.lines[1].total_lag.count() > 0);
+        assert(stats.lines[1].max_lag == stats.lines[1].total_lag);
+        assert(stats.lines[0].total_lead == stats.lines[1].total_lag);
+        assert(stats.lines[0].duplicates == 0);
+
+        /* 2 never comes on a, b fills the gap */
+        server.broadcast(target_a, "3");
+        co_await wait_until(received(0, 2));
+        server.broadcast(target_b, "2");
+        auto filled = co_await arbitrator.read();
+        assert(filled.sequence == 2 && filled.line == 1);
+        auto after_gap = co_await arbitrator.read();
+        assert(after_gap.sequence == 3 && after_gap.line == 0);
+
+        server.broadcast(target_b, "3");
+        co_await wait_until(received(1, 3));
+        assert(arbitrator.stats().lines[1].duplicates == 2);
+        assert(arbitrator.stats().missed == 0);
+
+        /* 4 never comes at all: held back until the gap timeout */
+        server.broadcast(target_a, "5");
+        co_await wait_until(received(0, 3));
+        assert(arbitrator.stats().missed == 0);
+        auto skipped_to = co_await arbitrator.read();
+        assert(skipped_to.sequence == 5);
+        assert(arbitrator.stats().missed == 1);
+
+        /* nor does 6, but three pending are past max_pending, skipped without waiting */
+        server.broadcast(target_a, "7");
+        server.broadcast(target_a, "8");
+        server.broadcast(target_a, "9");
+        co_await wait_until([&arbitrator]() { return arbitrator.stats().missed == 2; });
+        assert(arbitrator.stats().missed == 2);
+        for (std::uint64_t sequence = 7; sequence <= 9; ++sequence) {
+            auto message = co_await arbitrator.read();
+            assert(message.sequence == sequence);
+        }
+
+        stats = arbitrator.stats();
+        assert(stats.delivered == 7);
+        assert(stats.lines[0].first == 6);
+        assert(stats.lines[1].first == 1);
+        assert(stats.unsequenced >= 2);
+
+        arbitrator.disconnect();
+        done = true;
+    }, [](std::exception_ptr e) {
+        assert(!e);
+    });
+
+    ioc.run_for(std::chrono::seconds(10));
+    assert(done);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
+    if (argc != 2 && argc != 4) {
         std::cout << "Usage: \n";
-        std::cout << "./test_http_client TEST_ENDPOINT_CONFIG_JSON\n";
-        std::cout << "    where TEST_ENDPOINT_CONFIG_JSON is a JSON file of spec {'/endpoint/name': 'text_response', ...}";
+        std::cout << "./test_http_client TEST_ENDPOINT_CONFIG_JSON [SERVER_CERT SERVER_KEY]\n";
+        std::cout << "    where TEST_ENDPOINT_CONFIG_JSON is a JSON file of spec {'/endpoint/name': 'text_response', ...}\n";
+        std::cout << "    and SERVER_CERT/SERVER_KEY are PEM files enabling the mock server's TLS listener";
         std::cout << std::endl;
+        return EXIT_FAILURE;
     }
 
     LOG_DEBUG << "Attempting to load endpoint config file: " << argv[1];
@@ -241,18 +1411,119 @@ int main(int argc, char *argv[]) {
         mock_server_endpoints.push_back(std::make_pair(endpoint, root[endpoint].asString()));
     }
 
+    LOG_DEBUG << "Starting mock server";
+
+    constexpr std::size_t chunked_body_size = 64 * 1024;
+    constexpr std::size_t large_body_size = 4 * 1024 * 1024;
+
+    const auto unix_socket_path = (std::filesystem::temp_directory_path() / "zclient_test_http_client.sock").string();
+
+    mock::mock_server_config server_config;
+    server_config.unix_socket_path = unix_socket_path;
+    if (argc == 4) {
+        server_config.tls_cert_file = argv[2];
+        server_config.tls_key_file = argv[3];
+        server_config.tls_max_early_data = 16 * 1024;
+    }
+
+    mock::mock_server server{server_config};
+
+    for (const auto& [endpoint, text] : mock_server_endpoints) {
+        server.add_endpoint(mock::mock_endpoint{.target = endpoint, .body = text});
+    }
+    server.add_endpoint(mock::mock_endpoint{.target = "/echo", .method = "POST", .echo = true});
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/chunked",
+        .body_size = chunked_body_size,
+        .chunk_size = 4096,
+        .chunk_interval = std::chrono::milliseconds(1)
+    });
+    server.add_endpoint(mock::mock_endpoint{.target = "/large", .body_size = large_body_size});
+    server.add_endpoint(mock::mock_endpoint{.target = "/ranged", .body_size = large_body_size, .etag = "\"v1\"", .ranges = true});
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/ranged_slow",
+        .body_size = large_body_size,
+        .bytes_per_second = 2 * 1024 * 1024,
+        .etag = "\"v1\"",
+        .ranges = true
+    });
+    server.add_endpoint(mock::mock_endpoint{.target = "/ranged_changed", .body_size = large_body_size, .etag = "\"v2\"", .ranges = true});
+
+    const std::vector<std::string> sse_events{"first", "second\nwith two lines", "{\"price\": 4}", "", "fifth"};
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/events",
+        .chunk_size = 7,
+        .chunk_interval = std::chrono::milliseconds(1),
+        .sse_events = sse_events,
+        .sse_events_per_response = 2
+    });
+
+    constexpr std::chrono::milliseconds sse_interval{100};
+    server.add_endpoint(mock::mock_endpoint{
+        .target = "/events_slow",
+        .chunk_size = 15, /* "id: N\ndata: x\n\n", one event per chunk */
+        .chunk_interval = sse_interval,
+        .sse_events = {"a", "b", "c"}
+    });
+
+    constexpr std::chrono::milliseconds slow_latency{200};
+    server.add_endpoint(mock::mock_endpoint{.target = "/slow", .body = "slow", .latency = slow_latency});
+
+    server.add_endpoint(mock::mock_endpoint{.target = "/ws_echo", .ws_mode = mock::websocket_mode::echo});
+    server.add_endpoint(mock::mock_endpoint{.target = "/ws_drop", .ws_mode = mock::websocket_mode::echo});
+    for (const auto* target : {"/ws_failover", "/ws_cold_reconnect", "/ws_disconnect_during_failover"}) {
+        server.add_endpoint(mock::mock_endpoint{.target = target, .ws_mode = mock::websocket_mode::echo});
+    }
+    for (const auto* target : {"/feed_a", "/feed_b"}) {
+        server.add_endpoint(mock::mock_endpoint{.target = target, .ws_mode = mock::websocket_mode::broadcast});
+    }
+
+    server.start();
+
     LOG_DEBUG << "Creating tester";
 
-    ClientTester http_tester{"http://localhost", MOCK_SERVER_UNSECURED_PORT, mock_server_endpoints};
-    ClientTester https_tester{"https://localhost", MOCK_SERVER_SECURED_PORT, mock_server_endpoints};
+    ClientTester http_tester{"http://localhost", std::to_string(server.plain_port()), mock_server_endpoints};
+    ClientTester https_tester{"https://localhost", std::to_string(server.tls_port()), mock_server_endpoints};
 
     LOG_DEBUG << "Tester created, now commencing tests...";
 
+    compute_pool pool{2};
+
     /* TODO: make multithreaded */
     #define RUN(x) x; printf(#x); printf("\n");
     RUN(http_tester.test_http_basic_response());
     RUN(http_tester.test_sequential_http_responses());
     RUN(http_tester.test_http_request_header_and_body_echo());
+    RUN(http_tester.test_http_chunked_response("/chunked", chunked_body_size));
+    RUN(http_tester.test_http_large_body("/large", large_body_size));
+    RUN(http_tester.test_http_callback_on_compute_pool(pool));
+    RUN(http_tester.test_offload_to_compute_pool(pool));
+    RUN(http_tester.test_async_fetch_completion_tokens());
+    RUN(http_tester.test_fetch_then_client_settings());
+    RUN(http_tester.test_segmented_download("/ranged", large_body_size));
+    RUN(http_tester.test_segmented_download_resume("/ranged_slow", "/ranged_changed", large_body_size));
+    RUN(test_sse_parser());
+    RUN(http_tester.test_sse_stream("/events", sse_events, server));
+    RUN(http_tester.test_sse_incremental("/events_slow", sse_interval));
+    RUN(http_tester.test_stream_read_data("/chunked", chunked_body_size));
+    RUN(test_json_field_extractor());
+    RUN(test_spsc_ring());
+    RUN(test_websocket_echo(server.plain_port(), server));
+    RUN(test_websocket_write_ordering(server.plain_port()));
+    RUN(test_websocket_close_flushes_queue(server.plain_port(), server));
+    RUN(test_websocket_write_error(server.plain_port(), server));
+    RUN(test_unix_socket(unix_socket_path, mock_server_endpoints.front()));
+    RUN(test_resilient_websocket_failover(server.plain_port(), server));
+    RUN(test_resilient_websocket_cold_reconnect(server.plain_port(), server));
+    RUN(test_resilient_websocket_disconnect_during_failover(server.plain_port(), server));
+    RUN(test_feed_arbitrator(server.plain_port(), server));
+    if (argc == 4) {
+        RUN(https_tester.test_tls_early_data_fallback(mock_server_endpoints.front().first, argv[2], server));
+        RUN(test_tls_early_data_accepted(argv[2], argv[3]));
+        RUN(test_tls12_session_resumption(argv[2], argv[3]));
+        RUN(test_tls_verification_cache(server.tls_port(), argv[2]));
+        RUN(test_tls_rx_timestamp(server.tls_port(), argv[2], slow_latency));
+    }
     RUN(http_tester.test_connect_to_external_site("http://www.google.com", "/", "80"));
     RUN(https_tester.test_connect_to_external_site("https://testnet.binance.vision", "/api/v3/time", "443"));
     LOG_DEBUG << "All tests pass!";
@@ -260,5 +1531,7 @@ int main(int argc, char *argv[]) {
     zrun();
     #undef RUN
 
+    server.stop();
+
     return EXIT_SUCCESS;
 }